@@ -10,6 +10,12 @@
 namespace Config {
 
 static bool isNeo = false;
+static bool dmemHugePages = false;
+static bool dmemPrefault = false;
+static bool pinThreads = false;
+static std::string guestCpus;   // Host CPUs backing the guest cores, empty to pick them
+static std::string serviceCpus; // Host CPUs reserved for emulator threads, empty to pick them
+static bool mapThreadPriorities = false;
 static bool isFullscreen = false;
 static u32 screenWidth = 1280;
 static u32 screenHeight = 720;
@@ -20,11 +26,16 @@ static std::string userName = "shadPS4";
 static bool useSpecialPad = false;
 static int specialPadClass = 1;
 static bool isDebugDump = false;
+static std::string metricsDump = ""; // "json" or "csv" to dump metrics at exit
+static bool metricsPerFrame = false;
 static bool isShowSplash = false;
 static bool isNullGpu = false;
 static bool shouldCopyGPUBuffers = false;
 static bool shouldDumpShaders = false;
 static bool shouldDumpPM4 = false;
+static bool shouldCapturePM4 = false;
+static bool shaderCache = true;
+static bool asyncPipelines = false;
 static u32 vblankDivider = 1;
 static bool vkValidation = false;
 static bool vkValidationSync = false;
@@ -58,6 +69,30 @@ bool isNeoMode() {
     return isNeo;
 }
 
+bool dmemHugePagesEnabled() {
+    return dmemHugePages;
+}
+
+bool dmemPrefaultEnabled() {
+    return dmemPrefault;
+}
+
+bool pinThreadsEnabled() {
+    return pinThreads;
+}
+
+std::string getGuestCpus() {
+    return guestCpus;
+}
+
+std::string getServiceCpus() {
+    return serviceCpus;
+}
+
+bool mapThreadPrioritiesEnabled() {
+    return mapThreadPriorities;
+}
+
 bool isFullscreenMode() {
     return isFullscreen;
 }
@@ -98,6 +133,14 @@ bool debugDump() {
     return isDebugDump;
 }
 
+std::string getMetricsDump() {
+    return metricsDump;
+}
+
+bool metricsDumpPerFrame() {
+    return metricsPerFrame;
+}
+
 bool showSplash() {
     return isShowSplash;
 }
@@ -118,6 +161,18 @@ bool dumpPM4() {
     return shouldDumpPM4;
 }
 
+bool capturePM4() {
+    return shouldCapturePM4;
+}
+
+bool shaderCacheEnabled() {
+    return shaderCache;
+}
+
+bool asyncPipelineCompilation() {
+    return asyncPipelines;
+}
+
 bool isRdocEnabled() {
     return rdocEnable;
 }
@@ -166,6 +221,14 @@ void setDebugDump(bool enable) {
     isDebugDump = enable;
 }
 
+void setMetricsDump(const std::string& format) {
+    metricsDump = format;
+}
+
+void setMetricsDumpPerFrame(bool enable) {
+    metricsPerFrame = enable;
+}
+
 void setShowSplash(bool enable) {
     isShowSplash = enable;
 }
@@ -186,6 +249,18 @@ void setDumpPM4(bool enable) {
     shouldDumpPM4 = enable;
 }
 
+void setCapturePM4(bool enable) {
+    shouldCapturePM4 = enable;
+}
+
+void setShaderCacheEnabled(bool enable) {
+    shaderCache = enable;
+}
+
+void setAsyncPipelineCompilation(bool enable) {
+    asyncPipelines = enable;
+}
+
 void setVkValidation(bool enable) {
     vkValidation = enable;
 }
@@ -214,6 +289,30 @@ void setNeoMode(bool enable) {
     isNeo = enable;
 }
 
+void setDmemHugePages(bool enable) {
+    dmemHugePages = enable;
+}
+
+void setDmemPrefault(bool enable) {
+    dmemPrefault = enable;
+}
+
+void setPinThreads(bool enable) {
+    pinThreads = enable;
+}
+
+void setGuestCpus(const std::string& cpus) {
+    guestCpus = cpus;
+}
+
+void setServiceCpus(const std::string& cpus) {
+    serviceCpus = cpus;
+}
+
+void setMapThreadPriorities(bool enable) {
+    mapThreadPriorities = enable;
+}
+
 void setLogType(const std::string& type) {
     logType = type;
 }
@@ -365,6 +464,12 @@ void load(const std::filesystem::path& path) {
         logType = toml::find_or<std::string>(general, "logType", "sync");
         userName = toml::find_or<std::string>(general, "userName", "shadPS4");
         isShowSplash = toml::find_or<bool>(general, "showSplash", true);
+        dmemHugePages = toml::find_or<bool>(general, "dmemHugePages", false);
+        dmemPrefault = toml::find_or<bool>(general, "dmemPrefault", false);
+        pinThreads = toml::find_or<bool>(general, "pinThreads", false);
+        guestCpus = toml::find_or<std::string>(general, "guestCpus", "");
+        serviceCpus = toml::find_or<std::string>(general, "serviceCpus", "");
+        mapThreadPriorities = toml::find_or<bool>(general, "mapThreadPriorities", false);
     }
 
     if (data.contains("Input")) {
@@ -383,6 +488,9 @@ void load(const std::filesystem::path& path) {
         shouldCopyGPUBuffers = toml::find_or<bool>(gpu, "copyGPUBuffers", false);
         shouldDumpShaders = toml::find_or<bool>(gpu, "dumpShaders", false);
         shouldDumpPM4 = toml::find_or<bool>(gpu, "dumpPM4", false);
+        shouldCapturePM4 = toml::find_or<bool>(gpu, "capturePM4", false);
+        shaderCache = toml::find_or<bool>(gpu, "shaderCache", true);
+        asyncPipelines = toml::find_or<bool>(gpu, "asyncPipelineCompilation", false);
         vblankDivider = toml::find_or<int>(gpu, "vblankDivider", 1);
     }
 
@@ -402,6 +510,8 @@ void load(const std::filesystem::path& path) {
         const toml::value& debug = data.at("Debug");
 
         isDebugDump = toml::find_or<bool>(debug, "DebugDump", false);
+        metricsDump = toml::find_or<std::string>(debug, "MetricsDump", "");
+        metricsPerFrame = toml::find_or<bool>(debug, "MetricsDumpPerFrame", false);
     }
 
     if (data.contains("GUI")) {
@@ -457,6 +567,12 @@ void save(const std::filesystem::path& path) {
     data["General"]["logType"] = logType;
     data["General"]["userName"] = userName;
     data["General"]["showSplash"] = isShowSplash;
+    data["General"]["dmemHugePages"] = dmemHugePages;
+    data["General"]["dmemPrefault"] = dmemPrefault;
+    data["General"]["pinThreads"] = pinThreads;
+    data["General"]["guestCpus"] = guestCpus;
+    data["General"]["serviceCpus"] = serviceCpus;
+    data["General"]["mapThreadPriorities"] = mapThreadPriorities;
     data["Input"]["useSpecialPad"] = useSpecialPad;
     data["Input"]["specialPadClass"] = specialPadClass;
     data["GPU"]["screenWidth"] = screenWidth;
@@ -465,6 +581,9 @@ void save(const std::filesystem::path& path) {
     data["GPU"]["copyGPUBuffers"] = shouldCopyGPUBuffers;
     data["GPU"]["dumpShaders"] = shouldDumpShaders;
     data["GPU"]["dumpPM4"] = shouldDumpPM4;
+    data["GPU"]["capturePM4"] = shouldCapturePM4;
+    data["GPU"]["shaderCache"] = shaderCache;
+    data["GPU"]["asyncPipelineCompilation"] = asyncPipelines;
     data["GPU"]["vblankDivider"] = vblankDivider;
     data["Vulkan"]["gpuId"] = gpuId;
     data["Vulkan"]["validation"] = vkValidation;
@@ -474,6 +593,8 @@ void save(const std::filesystem::path& path) {
     data["Vulkan"]["rdocMarkersEnable"] = vkMarkers;
     data["Vulkan"]["crashDiagnostic"] = vkCrashDiagnostic;
     data["Debug"]["DebugDump"] = isDebugDump;
+    data["Debug"]["MetricsDump"] = metricsDump;
+    data["Debug"]["MetricsDumpPerFrame"] = metricsPerFrame;
     data["GUI"]["theme"] = mw_themes;
     data["GUI"]["iconSize"] = m_icon_size;
     data["GUI"]["sliderPos"] = m_slider_pos;
@@ -501,6 +622,12 @@ void save(const std::filesystem::path& path) {
 
 void setDefaultValues() {
     isNeo = false;
+    dmemHugePages = false;
+    dmemPrefault = false;
+    pinThreads = false;
+    guestCpus = "";
+    serviceCpus = "";
+    mapThreadPriorities = false;
     isFullscreen = false;
     screenWidth = 1280;
     screenHeight = 720;
@@ -510,10 +637,15 @@ void setDefaultValues() {
     useSpecialPad = false;
     specialPadClass = 1;
     isDebugDump = false;
+    metricsDump = "";
+    metricsPerFrame = false;
     isShowSplash = false;
     isNullGpu = false;
     shouldDumpShaders = false;
     shouldDumpPM4 = false;
+    shouldCapturePM4 = false;
+    shaderCache = true;
+    asyncPipelines = false;
     vblankDivider = 1;
     vkValidation = false;
     vkValidationSync = false;
@@ -12,6 +12,12 @@ void load(const std::filesystem::path& path);
 void save(const std::filesystem::path& path);
 
 bool isNeoMode();
+bool dmemHugePagesEnabled();
+bool dmemPrefaultEnabled();
+bool pinThreadsEnabled();
+std::string getGuestCpus();
+std::string getServiceCpus();
+bool mapThreadPrioritiesEnabled();
 bool isFullscreenMode();
 std::string getLogFilter();
 std::string getLogType();
@@ -25,20 +31,30 @@ u32 getScreenHeight();
 s32 getGpuId();
 
 bool debugDump();
+std::string getMetricsDump();
+bool metricsDumpPerFrame();
 bool showSplash();
 bool nullGpu();
 bool copyGPUCmdBuffers();
 bool dumpShaders();
 bool dumpPM4();
+bool capturePM4();
+bool shaderCacheEnabled();
+bool asyncPipelineCompilation();
 bool isRdocEnabled();
 u32 vblankDiv();
 
 void setDebugDump(bool enable);
+void setMetricsDump(const std::string& format);
+void setMetricsDumpPerFrame(bool enable);
 void setShowSplash(bool enable);
 void setNullGpu(bool enable);
 void setCopyGPUCmdBuffers(bool enable);
 void setDumpShaders(bool enable);
 void setDumpPM4(bool enable);
+void setCapturePM4(bool enable);
+void setShaderCacheEnabled(bool enable);
+void setAsyncPipelineCompilation(bool enable);
 void setVblankDiv(u32 value);
 void setGpuId(s32 selectedGpuId);
 void setScreenWidth(u32 width);
@@ -46,6 +62,12 @@ void setScreenHeight(u32 height);
 void setFullscreenMode(bool enable);
 void setLanguage(u32 language);
 void setNeoMode(bool enable);
+void setDmemHugePages(bool enable);
+void setDmemPrefault(bool enable);
+void setPinThreads(bool enable);
+void setGuestCpus(const std::string& cpus);
+void setServiceCpus(const std::string& cpus);
+void setMapThreadPriorities(bool enable);
 void setUserName(const std::string& type);
 
 void setUseSpecialPad(bool use);
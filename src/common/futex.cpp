@@ -0,0 +1,219 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include "common/arch.h"
+#include "common/futex.h"
+#include "common/metrics.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(ARCH_X86_64)
+#include <immintrin.h>
+#endif
+
+namespace Common {
+
+namespace {
+
+/// Times a contended lock is retried before sleeping, about a microsecond of spinning.
+constexpr u32 SpinCount = 100;
+
+void CpuRelax() {
+#if defined(ARCH_X86_64)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+#if !defined(_WIN32) && !defined(__linux__)
+/// Threads waiting on an address sleep on the bucket its hash selects, wakes notify the whole
+/// bucket as it may be shared with other addresses.
+struct WaitBucket {
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+WaitBucket& GetBucket(const void* address) {
+    static std::array<WaitBucket, 64> buckets;
+    const auto hash = reinterpret_cast<uintptr_t>(address) >> 2;
+    return buckets[(hash ^ (hash >> 6)) % buckets.size()];
+}
+#endif
+
+} // Anonymous namespace
+
+bool FutexWait(std::atomic<u32>& word, u32 expected, std::chrono::nanoseconds timeout) {
+    static auto& num_waits = Common::Metrics::GetCounter("sync.futex_waits");
+    num_waits.Add();
+
+#ifdef _WIN32
+    DWORD ms = INFINITE;
+    if (timeout != InfiniteTimeout) {
+        const auto ceil_ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+        ms = static_cast<DWORD>(std::clamp<s64>(ceil_ms, 0, INFINITE - 1));
+    }
+    if (!WaitOnAddress(&word, &expected, sizeof(expected), ms)) {
+        return GetLastError() != ERROR_TIMEOUT;
+    }
+    return true;
+#elif defined(__linux__)
+    timespec ts{};
+    timespec* ts_ptr = nullptr;
+    if (timeout != InfiniteTimeout) {
+        const auto ns = std::max<s64>(timeout.count(), 0);
+        ts.tv_sec = ns / 1'000'000'000;
+        ts.tv_nsec = ns % 1'000'000'000;
+        ts_ptr = &ts;
+    }
+    // Returns EAGAIN if the word changed before sleeping and EINTR on signals, both count as a
+    // wakeup so the caller rechecks its state.
+    const long result =
+        syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, ts_ptr, nullptr, 0);
+    return result == 0 || errno != ETIMEDOUT;
+#else
+    auto& bucket = GetBucket(&word);
+    std::unique_lock lock{bucket.mutex};
+    if (word.load() != expected) {
+        return true;
+    }
+    if (timeout == InfiniteTimeout) {
+        bucket.cv.wait(lock);
+        return true;
+    }
+    return bucket.cv.wait_for(lock, timeout) == std::cv_status::no_timeout;
+#endif
+}
+
+void FutexWakeOne(std::atomic<u32>& word) {
+#ifdef _WIN32
+    WakeByAddressSingle(&word);
+#elif defined(__linux__)
+    syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    auto& bucket = GetBucket(&word);
+    std::scoped_lock lock{bucket.mutex};
+    bucket.cv.notify_all();
+#endif
+}
+
+void FutexWakeAll(std::atomic<u32>& word) {
+#ifdef _WIN32
+    WakeByAddressAll(&word);
+#elif defined(__linux__)
+    syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+    auto& bucket = GetBucket(&word);
+    std::scoped_lock lock{bucket.mutex};
+    bucket.cv.notify_all();
+#endif
+}
+
+Deadline::Deadline(std::chrono::nanoseconds timeout) : infinite{timeout == InfiniteTimeout} {
+    if (!infinite) {
+        end = std::chrono::steady_clock::now() + timeout;
+    }
+}
+
+std::chrono::nanoseconds Deadline::Remaining() const {
+    if (infinite) {
+        return InfiniteTimeout;
+    }
+    return std::max(end - std::chrono::steady_clock::now(), std::chrono::nanoseconds::zero());
+}
+
+bool FutexMutex::LockSlow(const Deadline& deadline) {
+    // Spin while the owner is likely to release the lock soon, unless others already sleep.
+    for (u32 i = 0; i < SpinCount; i++) {
+        u32 value = state.load(std::memory_order_relaxed);
+        if (value == Contended) {
+            break;
+        }
+        if (value == Unlocked &&
+            state.compare_exchange_weak(value, Locked, std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+            return true;
+        }
+        CpuRelax();
+    }
+
+    static auto& num_contended = Common::Metrics::GetCounter("sync.mutex_contended");
+    num_contended.Add();
+
+    // Mark the lock contended so that the owner wakes a sleeper when releasing it.
+    while (state.exchange(Contended, std::memory_order_acquire) != Unlocked) {
+        const auto remaining = deadline.Remaining();
+        if (remaining.count() == 0 || !FutexWait(state, Contended, remaining)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FutexSharedMutex::Sleep(u32 value, const Deadline& deadline) {
+    const auto remaining = deadline.Remaining();
+    if (remaining.count() == 0) {
+        return false;
+    }
+    num_sleepers.fetch_add(1);
+    const bool woken = FutexWait(state, value, remaining);
+    num_sleepers.fetch_sub(1);
+    return woken;
+}
+
+bool FutexSharedMutex::LockSlow(const Deadline& deadline) {
+    for (u32 spins = 0;;) {
+        u32 value = state.load(std::memory_order_relaxed);
+        if (value == 0) {
+            if (state.compare_exchange_weak(value, WriterLocked, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+            continue;
+        }
+        if (spins++ < SpinCount) {
+            CpuRelax();
+            continue;
+        }
+        if (!Sleep(value, deadline)) {
+            return false;
+        }
+    }
+}
+
+bool FutexSharedMutex::LockSharedSlow(const Deadline& deadline) {
+    for (u32 spins = 0;;) {
+        u32 value = state.load(std::memory_order_relaxed);
+        if ((value & WriterLocked) == 0) {
+            if (state.compare_exchange_weak(value, value + 1, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+            continue;
+        }
+        if (spins++ < SpinCount) {
+            CpuRelax();
+            continue;
+        }
+        if (!Sleep(value, deadline)) {
+            return false;
+        }
+    }
+}
+
+} // namespace Common
@@ -0,0 +1,221 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "common/types.h"
+
+/**
+ * Synchronization primitives built directly on the host address wait API: futex on Linux,
+ * WaitOnAddress on Windows and a hashed table of condition variables elsewhere. They take a
+ * single word of memory, need no initialization beyond zeroing, only enter the kernel when a
+ * thread has to sleep and support real timeouts.
+ */
+namespace Common {
+
+/// Timeout meaning wait until woken.
+constexpr std::chrono::nanoseconds InfiniteTimeout = std::chrono::nanoseconds::max();
+
+/// Blocks while word holds expected, until woken or until timeout passes. Returns false if the
+/// timeout passed, wakeups may be spurious.
+bool FutexWait(std::atomic<u32>& word, u32 expected, std::chrono::nanoseconds timeout);
+
+inline void FutexWait(std::atomic<u32>& word, u32 expected) {
+    FutexWait(word, expected, InfiniteTimeout);
+}
+
+void FutexWakeOne(std::atomic<u32>& word);
+void FutexWakeAll(std::atomic<u32>& word);
+
+/// Point in time a timed wait gives up at, converting relative timeouts once so that loops
+/// retrying after spurious wakeups don't extend them.
+class Deadline {
+public:
+    explicit Deadline(std::chrono::nanoseconds timeout);
+
+    /// Returns the time left, 0 when it passed and InfiniteTimeout for infinite deadlines.
+    [[nodiscard]] std::chrono::nanoseconds Remaining() const;
+
+private:
+    std::chrono::steady_clock::time_point end;
+    bool infinite;
+};
+
+/// Mutex taking a single word, spinning briefly before it sleeps.
+class FutexMutex {
+public:
+    void lock() {
+        if (!try_lock()) [[unlikely]] {
+            LockSlow(Deadline{InfiniteTimeout});
+        }
+    }
+
+    bool try_lock() {
+        u32 expected = Unlocked;
+        return state.compare_exchange_strong(expected, Locked, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    /// Returns false if the mutex could not be locked within timeout.
+    bool try_lock_for(std::chrono::nanoseconds timeout) {
+        return try_lock() || LockSlow(Deadline{timeout});
+    }
+
+    void unlock() {
+        if (state.exchange(Unlocked, std::memory_order_release) == Contended) [[unlikely]] {
+            FutexWakeOne(state);
+        }
+    }
+
+private:
+    enum : u32 {
+        Unlocked = 0,
+        Locked = 1,
+        Contended = 2, ///< Locked with threads possibly sleeping on it
+    };
+
+    bool LockSlow(const Deadline& deadline);
+
+    std::atomic<u32> state{Unlocked};
+};
+
+/// Condition variable usable with any lock type, waking waiters through a sequence counter.
+class FutexCondvar {
+public:
+    /// Releases lock and waits for a notification or for timeout to pass, then relocks it.
+    /// Returns false if the timeout passed.
+    template <typename Lock>
+    bool WaitFor(Lock& lock, std::chrono::nanoseconds timeout) {
+        const u32 value = sequence.load();
+        num_waiters.fetch_add(1);
+        lock.unlock();
+        const bool woken = FutexWait(sequence, value, timeout);
+        num_waiters.fetch_sub(1);
+        lock.lock();
+        return woken;
+    }
+
+    template <typename Lock>
+    void Wait(Lock& lock) {
+        WaitFor(lock, InfiniteTimeout);
+    }
+
+    /// Waits until pred is satisfied or until timeout passes, returning the final value of pred.
+    template <typename Lock, typename Pred>
+    bool WaitFor(Lock& lock, std::chrono::nanoseconds timeout, Pred&& pred) {
+        const Deadline deadline{timeout};
+        while (!pred()) {
+            const auto remaining = deadline.Remaining();
+            if (remaining.count() == 0 || !WaitFor(lock, remaining)) {
+                return pred();
+            }
+        }
+        return true;
+    }
+
+    template <typename Lock, typename Pred>
+    void Wait(Lock& lock, Pred&& pred) {
+        while (!pred()) {
+            Wait(lock);
+        }
+    }
+
+    void NotifyOne() {
+        sequence.fetch_add(1);
+        if (num_waiters.load() != 0) {
+            FutexWakeOne(sequence);
+        }
+    }
+
+    void NotifyAll() {
+        sequence.fetch_add(1);
+        if (num_waiters.load() != 0) {
+            FutexWakeAll(sequence);
+        }
+    }
+
+private:
+    std::atomic<u32> sequence{};
+    std::atomic<u32> num_waiters{};
+};
+
+/// Reader-writer lock preferring readers like the default pthread rwlock. Readers enter whenever
+/// no writer holds the lock, so a thread may take a read lock it already holds while a writer
+/// is waiting.
+class FutexSharedMutex {
+public:
+    void lock() {
+        if (!try_lock()) [[unlikely]] {
+            LockSlow(Deadline{InfiniteTimeout});
+        }
+    }
+
+    bool try_lock() {
+        u32 expected = 0;
+        return state.compare_exchange_strong(expected, WriterLocked, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    bool try_lock_for(std::chrono::nanoseconds timeout) {
+        return try_lock() || LockSlow(Deadline{timeout});
+    }
+
+    void unlock() {
+        state.fetch_and(~WriterLocked);
+        if (num_sleepers.load() != 0) {
+            FutexWakeAll(state);
+        }
+    }
+
+    void lock_shared() {
+        if (!try_lock_shared()) [[unlikely]] {
+            LockSharedSlow(Deadline{InfiniteTimeout});
+        }
+    }
+
+    bool try_lock_shared() {
+        u32 value = state.load(std::memory_order_relaxed);
+        return (value & WriterLocked) == 0 &&
+               state.compare_exchange_strong(value, value + 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    bool try_lock_shared_for(std::chrono::nanoseconds timeout) {
+        return try_lock_shared() || LockSharedSlow(Deadline{timeout});
+    }
+
+    void unlock_shared() {
+        const u32 value = state.fetch_sub(1);
+        if ((value & ReaderMask) == 1 && num_sleepers.load() != 0) {
+            FutexWakeAll(state);
+        }
+    }
+
+    /// Returns true if a writer holds the lock.
+    [[nodiscard]] bool IsLocked() const {
+        return (state.load(std::memory_order_relaxed) & WriterLocked) != 0;
+    }
+
+    /// Returns true if readers hold the lock.
+    [[nodiscard]] bool HasReaders() const {
+        return (state.load(std::memory_order_relaxed) & ReaderMask) != 0;
+    }
+
+private:
+    static constexpr u32 WriterLocked = 1U << 31;
+    static constexpr u32 ReaderMask = WriterLocked - 1;
+
+    bool LockSlow(const Deadline& deadline);
+    bool LockSharedSlow(const Deadline& deadline);
+
+    /// Sleeps while the state holds value, returns false once the deadline passed.
+    bool Sleep(u32 value, const Deadline& deadline);
+
+    std::atomic<u32> state{};
+    std::atomic<u32> num_sleepers{};
+};
+
+} // namespace Common
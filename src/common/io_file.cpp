@@ -1,6 +1,9 @@
 // SPDX-FileCopyrightText: Copyright 2021 yuzu Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
+#include <climits>
+#include <cstddef>
 #include <vector>
 
 #include "common/alignment.h"
@@ -17,6 +20,7 @@
 #include <share.h>
 #include <windows.h>
 #else
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
@@ -271,6 +275,180 @@ uintptr_t IOFile::GetFileMapping() {
 #endif
 }
 
+namespace {
+
+#ifndef _WIN32
+static_assert(sizeof(IOFile::IoVec) == sizeof(iovec) &&
+              offsetof(IOFile::IoVec, base) == offsetof(iovec, iov_base) &&
+              offsetof(IOFile::IoVec, size) == offsetof(iovec, iov_len));
+#endif
+
+/// Makes buffered writes of the stream visible to positional accesses of the descriptor.
+void FlushIfWritable(std::FILE* file, FileAccessMode mode) {
+    constexpr auto WriteModes =
+        static_cast<u32>(FileAccessMode::Write) | static_cast<u32>(FileAccessMode::Append);
+    if ((static_cast<u32>(mode) & WriteModes) != 0) {
+        std::fflush(file);
+    }
+}
+
+/// Drops data the stream buffered for reading, which a positional write may have made stale.
+void DiscardReadBuffer(std::FILE* file, FileAccessMode mode) {
+    if ((static_cast<u32>(mode) & static_cast<u32>(FileAccessMode::Read)) != 0) {
+        std::fseek(file, 0, SEEK_CUR);
+    }
+}
+
+#ifndef _WIN32
+/// Issues a vectored access in calls of at most IOV_MAX buffers, stopping at a short transfer.
+template <typename Func>
+size_t AccessInChunks(std::span<const IOFile::IoVec> buffers, Func&& access) {
+    size_t total{};
+    while (!buffers.empty()) {
+        const auto chunk = buffers.first(std::min<size_t>(buffers.size(), IOV_MAX));
+        size_t chunk_size{};
+        for (const auto& buffer : chunk) {
+            chunk_size += buffer.size;
+        }
+        ssize_t done;
+        do {
+            done = access(reinterpret_cast<const iovec*>(chunk.data()),
+                          static_cast<int>(chunk.size()), total);
+        } while (done < 0 && errno == EINTR);
+        if (done <= 0) {
+            break;
+        }
+        total += done;
+        if (static_cast<size_t>(done) < chunk_size) {
+            break;
+        }
+        buffers = buffers.subspan(chunk.size());
+    }
+    return total;
+}
+#endif
+
+} // Anonymous namespace
+
+size_t IOFile::ReadAt(void* data, size_t size, u64 offset) const {
+    if (!IsOpen()) {
+        return 0;
+    }
+    FlushIfWritable(file, file_access_mode);
+#ifdef _WIN32
+    // Overlapped accesses move the file pointer of synchronous handles, restore it for the stream.
+    // Callers have to serialize this with the stream accesses of the file.
+    const HANDLE hfile = reinterpret_cast<HANDLE>(_get_osfhandle(fileno(file)));
+    LARGE_INTEGER pos{};
+    SetFilePointerEx(hfile, {}, &pos, FILE_CURRENT);
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD read{};
+    const bool result = ReadFile(hfile, data, static_cast<DWORD>(size), &read, &overlapped);
+    SetFilePointerEx(hfile, pos, nullptr, FILE_BEGIN);
+    return result || GetLastError() == ERROR_HANDLE_EOF ? read : 0;
+#else
+    auto* dst = static_cast<u8*>(data);
+    size_t total{};
+    while (total < size) {
+        const ssize_t read = pread(fileno(file), dst + total, size - total, offset + total);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            break;
+        }
+        total += read;
+    }
+    return total;
+#endif
+}
+
+size_t IOFile::WriteAt(const void* data, size_t size, u64 offset) const {
+    if (!IsOpen()) {
+        return 0;
+    }
+    FlushIfWritable(file, file_access_mode);
+#ifdef _WIN32
+    const HANDLE hfile = reinterpret_cast<HANDLE>(_get_osfhandle(fileno(file)));
+    LARGE_INTEGER pos{};
+    SetFilePointerEx(hfile, {}, &pos, FILE_CURRENT);
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written{};
+    WriteFile(hfile, data, static_cast<DWORD>(size), &written, &overlapped);
+    SetFilePointerEx(hfile, pos, nullptr, FILE_BEGIN);
+    DiscardReadBuffer(file, file_access_mode);
+    return written;
+#else
+    const auto* src = static_cast<const u8*>(data);
+    size_t total{};
+    while (total < size) {
+        const ssize_t written = pwrite(fileno(file), src + total, size - total, offset + total);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        total += written;
+    }
+    DiscardReadBuffer(file, file_access_mode);
+    return total;
+#endif
+}
+
+size_t IOFile::ReadvAt(std::span<const IoVec> buffers, u64 offset) const {
+    if (!IsOpen()) {
+        return 0;
+    }
+#ifdef _WIN32
+    size_t total{};
+    for (const auto& buffer : buffers) {
+        const size_t read = ReadAt(buffer.base, buffer.size, offset + total);
+        total += read;
+        if (read < buffer.size) {
+            break;
+        }
+    }
+    return total;
+#else
+    FlushIfWritable(file, file_access_mode);
+    const int fd = fileno(file);
+    return AccessInChunks(buffers, [fd, offset](const iovec* iov, int iovcnt, size_t done) {
+        return preadv(fd, iov, iovcnt, offset + done);
+    });
+#endif
+}
+
+size_t IOFile::WritevAt(std::span<const IoVec> buffers, u64 offset) const {
+    if (!IsOpen()) {
+        return 0;
+    }
+#ifdef _WIN32
+    size_t total{};
+    for (const auto& buffer : buffers) {
+        const size_t written = WriteAt(buffer.base, buffer.size, offset + total);
+        total += written;
+        if (written < buffer.size) {
+            break;
+        }
+    }
+    return total;
+#else
+    FlushIfWritable(file, file_access_mode);
+    const int fd = fileno(file);
+    const size_t total =
+        AccessInChunks(buffers, [fd, offset](const iovec* iov, int iovcnt, size_t done) {
+            return pwritev(fd, iov, iovcnt, offset + done);
+        });
+    DiscardReadBuffer(file, file_access_mode);
+    return total;
+#endif
+}
+
 std::string IOFile::ReadString(size_t length) const {
     std::vector<char> string_buffer(length);
 
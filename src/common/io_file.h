@@ -63,6 +63,12 @@ enum class SeekOrigin : u32 {
 
 class IOFile final {
 public:
+    /// Scatter/gather buffer, laid out like struct iovec.
+    struct IoVec {
+        void* base;
+        size_t size;
+    };
+
     IOFile();
 
     explicit IOFile(const std::string& path, FileAccessMode mode,
@@ -199,6 +205,19 @@ public:
         return std::fwrite(&object, sizeof(T), 1, file) == 1;
     }
 
+    /**
+     * Positional reads and writes. They don't use the stream position and may be called
+     * concurrently from multiple threads, except on Windows where they move it temporarily and
+     * must not overlap with each other or with stream accesses. Vectored calls are issued as
+     * few system calls of at most IOV_MAX buffers where the host supports it. Writes drop what
+     * the stream buffered for reading, so later stream reads see them. All of them return the
+     * amount of bytes transferred.
+     */
+    size_t ReadAt(void* data, size_t size, u64 offset) const;
+    size_t WriteAt(const void* data, size_t size, u64 offset) const;
+    size_t ReadvAt(std::span<const IoVec> buffers, u64 offset) const;
+    size_t WritevAt(std::span<const IoVec> buffers, u64 offset) const;
+
     std::string ReadString(size_t length) const;
 
     size_t WriteString(std::span<const char> string) const {
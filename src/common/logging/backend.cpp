@@ -1,6 +1,7 @@
 // SPDX-FileCopyrightText: Copyright 2014 Citra Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <array>
 #include <chrono>
 #include <filesystem>
 #include <thread>
@@ -19,6 +20,7 @@
 #include "common/logging/log.h"
 #include "common/logging/log_entry.h"
 #include "common/logging/text_formatter.h"
+#include "common/metrics.h"
 #include "common/path_util.h"
 #include "common/string_util.h"
 #include "common/thread.h"
@@ -170,6 +172,12 @@ public:
         color_console_backend.SetEnabled(enabled);
     }
 
+    /// Returns whether a message has to be formatted at all.
+    bool IsLogged(Class log_class, Level log_level) const {
+        return filter.CheckMessage(log_class, log_level) ||
+               (log_level >= Level::Warning && IsProfilerConnected());
+    }
+
     void PushEntry(Class log_class, Level log_level, const char* filename, unsigned int line_num,
                    const char* function, std::string message) {
         // Propagate important log messages to the profiler
@@ -194,12 +202,8 @@ public:
             return;
         }
 
-        using std::chrono::duration_cast;
-        using std::chrono::microseconds;
-        using std::chrono::steady_clock;
-
-        const Entry entry = {
-            .timestamp = duration_cast<microseconds>(steady_clock::now() - time_origin),
+        Entry entry = {
+            .timestamp = Timestamp(),
             .log_class = log_class,
             .log_level = log_level,
             .filename = filename,
@@ -207,25 +211,74 @@ public:
             .function = function,
             .message = std::move(message),
         };
-        if (Config::getLogType() == "async") {
-            message_queue.EmplaceWait(entry);
-        } else {
-            ForEachBackend([&entry](auto& backend) { backend.Write(entry); });
-            std::fflush(stdout);
+        WriteEntry(std::move(entry));
+    }
+
+    void PushPackedEntry(Class log_class, Level log_level, const char* filename,
+                         unsigned int line_num, const char* function, const char* format,
+                         PackedArgsFormatter formatter, std::span<const u8> args) {
+        if (log_level >= Level::Warning && IsProfilerConnected()) {
+            // The profiler needs the message right away.
+            std::string message;
+            formatter(message, format, args.data());
+            PushEntry(log_class, log_level, filename, line_num, function, std::move(message));
+            return;
+        }
+        if (!filter.CheckMessage(log_class, log_level)) {
+            return;
         }
+
+        Entry entry = {
+            .timestamp = Timestamp(),
+            .log_class = log_class,
+            .log_level = log_level,
+            .filename = filename,
+            .line_num = line_num,
+            .function = function,
+            .format = format,
+            .formatter = formatter,
+        };
+        std::memcpy(entry.packed_args.data(), args.data(), args.size());
+        WriteEntry(std::move(entry));
     }
 
 private:
     Impl(const std::filesystem::path& file_backend_filename, const Filter& filter_)
-        : filter{filter_}, file_backend{file_backend_filename} {}
+        : filter{filter_}, file_backend{file_backend_filename},
+          is_async{Config::getLogType() == "async"} {}
 
     ~Impl() = default;
 
+    std::chrono::microseconds Timestamp() const {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        using std::chrono::steady_clock;
+        return duration_cast<microseconds>(steady_clock::now() - time_origin);
+    }
+
+    void WriteEntry(Entry&& entry) {
+        if (is_async) {
+            message_queue.EmplaceWait(std::move(entry));
+        } else {
+            FormatPackedMessage(entry);
+            ForEachBackend([&entry](auto& backend) { backend.Write(entry); });
+            std::fflush(stdout);
+        }
+    }
+
+    static void FormatPackedMessage(Entry& entry) {
+        if (entry.formatter) {
+            entry.formatter(entry.message, entry.format, entry.packed_args.data());
+            entry.formatter = nullptr;
+        }
+    }
+
     void StartBackendThread() {
         backend_thread = std::jthread([this](std::stop_token stop_token) {
             Common::SetCurrentThreadName("shadPS4:Log");
             Entry entry;
             const auto write_logs = [this, &entry]() {
+                FormatPackedMessage(entry);
                 ForEachBackend([&entry](auto& backend) { backend.Write(entry); });
             };
             while (!stop_token.stop_requested()) {
@@ -271,6 +324,7 @@ private:
 
     MPSCQueue<Entry> message_queue{};
     std::chrono::steady_clock::time_point time_origin{std::chrono::steady_clock::now()};
+    bool is_async{};
     std::jthread backend_thread;
 };
 } // namespace
@@ -299,12 +353,40 @@ void SetColorConsoleBackendEnabled(bool enabled) {
     Impl::Instance().SetColorConsoleBackendEnabled(enabled);
 }
 
+/// Counts the messages issued at every level, filtered or not, to help spotting log spam.
+static void CountMessage(Level log_level) {
+    static const auto counters = [] {
+        std::array<Metrics::Counter*, static_cast<size_t>(Level::Count)> counters;
+        for (size_t i = 0; i < counters.size(); i++) {
+            const auto name = fmt::format("log.{}", GetLevelName(static_cast<Level>(i)));
+            counters[i] = &Metrics::GetCounter(name);
+        }
+        return counters;
+    }();
+    counters[static_cast<size_t>(log_level)]->Add();
+}
+
 void FmtLogMessageImpl(Class log_class, Level log_level, const char* filename,
                        unsigned int line_num, const char* function, const char* format,
                        const fmt::format_args& args) {
+    if (initialization_in_progress_suppress_logging) [[unlikely]] {
+        return;
+    }
+    CountMessage(log_level);
+    auto& impl = Impl::Instance();
+    if (impl.IsLogged(log_class, log_level)) {
+        impl.PushEntry(log_class, log_level, filename, line_num, function,
+                       fmt::vformat(format, args));
+    }
+}
+
+void PackedLogMessageImpl(Class log_class, Level log_level, const char* filename,
+                          unsigned int line_num, const char* function, const char* format,
+                          PackedArgsFormatter formatter, std::span<const u8> args) {
     if (!initialization_in_progress_suppress_logging) [[likely]] {
-        Impl::Instance().PushEntry(log_class, log_level, filename, line_num, function,
-                                   fmt::vformat(format, args));
+        CountMessage(log_level);
+        Impl::Instance().PushPackedEntry(log_class, log_level, filename, line_num, function,
+                                         format, formatter, args);
     }
 }
 } // namespace Common::Log
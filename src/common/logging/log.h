@@ -5,7 +5,12 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
+#include <span>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
 
 #include "common/logging/formatter.h"
 #include "common/logging/types.h"
@@ -20,16 +25,61 @@ constexpr const char* TrimSourcePath(std::string_view source) {
     return source.data() + idx;
 }
 
+/// Size of the argument storage of a message that is formatted by the logging thread.
+constexpr size_t MaxPackedArgsSize = 64;
+
+/// Formats the arguments packed by FmtLogMessage into out.
+using PackedArgsFormatter = void (*)(std::string& out, const char* format, const u8* args);
+
+/// Arguments that can be copied as raw bytes and formatted at a later point. Anything that may
+/// refer to memory owned by the caller (strings, spans, classes) is formatted immediately.
+template <typename T>
+constexpr bool IsPackable = std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+                            std::is_same_v<T, void*> || std::is_same_v<T, const void*>;
+
 /// Logs a message to the global logger, using fmt
 void FmtLogMessageImpl(Class log_class, Level log_level, const char* filename,
                        unsigned int line_num, const char* function, const char* format,
                        const fmt::format_args& args);
 
+/// Logs a message to the global logger, formatting the packed arguments on the logging thread
+void PackedLogMessageImpl(Class log_class, Level log_level, const char* filename,
+                          unsigned int line_num, const char* function, const char* format,
+                          PackedArgsFormatter formatter, std::span<const u8> args);
+
+template <typename T>
+T UnpackArg(const u8*& data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+template <typename... Args>
+void FormatPackedArgs(std::string& out, const char* format, const u8* data) {
+    // Elements of a braced initializer list are evaluated in order.
+    const std::tuple<Args...> args{UnpackArg<Args>(data)...};
+    std::apply(
+        [&](const auto&... unpacked) {
+            out = fmt::vformat(format, fmt::make_format_args(unpacked...));
+        },
+        args);
+}
+
 template <typename... Args>
 void FmtLogMessage(Class log_class, Level log_level, const char* filename, unsigned int line_num,
                    const char* function, const char* format, const Args&... args) {
-    FmtLogMessageImpl(log_class, log_level, filename, line_num, function, format,
-                      fmt::make_format_args(args...));
+    if constexpr ((IsPackable<Args> && ...) && (sizeof(Args) + ... + 0) <= MaxPackedArgsSize) {
+        std::array<u8, MaxPackedArgsSize> packed;
+        u8* data = packed.data();
+        ((std::memcpy(data, &args, sizeof(Args)), data += sizeof(Args)), ...);
+        PackedLogMessageImpl(log_class, log_level, filename, line_num, function, format,
+                             &FormatPackedArgs<Args...>,
+                             std::span{packed}.first(data - packed.data()));
+    } else {
+        FmtLogMessageImpl(log_class, log_level, filename, line_num, function, format,
+                          fmt::make_format_args(args...));
+    }
 }
 
 } // namespace Common::Log
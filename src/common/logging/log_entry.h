@@ -3,8 +3,11 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <string>
 
+#include "common/logging/log.h"
 #include "common/logging/types.h"
 
 namespace Common::Log {
@@ -19,8 +22,13 @@ struct Entry {
     Level log_level{};
     const char* filename = nullptr;
     u32 line_num = 0;
-    std::string function;
+    const char* function = nullptr;
     std::string message;
+
+    /// When set, message is only formatted by the logging thread from the packed arguments.
+    const char* format = nullptr;
+    PackedArgsFormatter formatter = nullptr;
+    std::array<u8, MaxPackedArgsSize> packed_args;
 };
 
 } // namespace Common::Log
@@ -0,0 +1,222 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fmt/format.h>
+
+#include "common/config.h"
+#include "common/io_file.h"
+#include "common/metrics.h"
+#include "common/path_util.h"
+
+namespace Common::Metrics {
+
+namespace {
+
+std::atomic<size_t> next_shard{};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Counter>, std::less<>> counters;
+    std::map<std::string, std::unique_ptr<Histogram>, std::less<>> histograms;
+    std::vector<CounterSample> counter_samples;
+    std::vector<HistogramSample> histogram_samples;
+    u64 frame{};
+    std::string dump_format;
+    Common::FS::IOFile dump_file;
+};
+
+Registry& GetRegistry() {
+    // Never destroyed, metrics may still be updated by threads running during exit.
+    static auto* registry = new Registry;
+    return *registry;
+}
+
+template <typename Sample>
+const Sample* FindSample(const std::vector<Sample>& samples, std::string_view name) {
+    const auto it = std::ranges::lower_bound(samples, name, {}, &Sample::name);
+    return it != samples.end() && it->name == name ? &*it : nullptr;
+}
+
+void TakeSamples(Registry& registry) {
+    std::vector<CounterSample> counter_samples;
+    counter_samples.reserve(registry.counters.size());
+    for (const auto& [name, counter] : registry.counters) {
+        const u64 value = counter->Value();
+        const auto* last = FindSample(registry.counter_samples, name);
+        counter_samples.push_back({name, value, value - (last ? last->value : 0)});
+    }
+    registry.counter_samples = std::move(counter_samples);
+
+    std::vector<HistogramSample> histogram_samples;
+    histogram_samples.reserve(registry.histograms.size());
+    for (const auto& [name, histogram] : registry.histograms) {
+        const auto snapshot = histogram->Read();
+        const auto* last = FindSample(registry.histogram_samples, name);
+        histogram_samples.push_back({
+            .name = name,
+            .count = snapshot.count,
+            .frame_count = snapshot.count - (last ? last->count : 0),
+            .mean = snapshot.count ? double(snapshot.sum) / snapshot.count : 0.0,
+            .p50 = snapshot.Percentile(0.5),
+            .p99 = snapshot.Percentile(0.99),
+        });
+    }
+    registry.histogram_samples = std::move(histogram_samples);
+}
+
+/// Opens the dump file on first use, returns false if dumps are disabled.
+bool OpenDumpFile(Registry& registry) {
+    if (registry.dump_file.IsOpen()) {
+        return true;
+    }
+    const auto format = Config::getMetricsDump();
+    if (format != "json" && format != "csv") {
+        return false;
+    }
+    const auto path = Common::FS::GetUserPath(Common::FS::PathType::LogDir) / ("metrics." + format);
+    registry.dump_file.Open(path, Common::FS::FileAccessMode::Write,
+                            Common::FS::FileType::TextFile);
+    if (!registry.dump_file.IsOpen()) {
+        return false;
+    }
+    registry.dump_format = format;
+    if (format == "csv") {
+        registry.dump_file.WriteString(std::string_view{"frame,metric,value,frame_delta\n"});
+    }
+    return true;
+}
+
+/// Appends the last samples to the dump file, as one JSON object per line or as CSV rows.
+void WriteSamples(Registry& registry) {
+    if (!OpenDumpFile(registry)) {
+        return;
+    }
+    std::string out;
+    auto it = std::back_inserter(out);
+    const u64 frame = registry.frame;
+    if (registry.dump_format == "json") {
+        fmt::format_to(it, "{{\"frame\":{},\"counters\":{{", frame);
+        for (size_t i = 0; const auto& sample : registry.counter_samples) {
+            fmt::format_to(it, "{}\"{}\":{{\"value\":{},\"frame_delta\":{}}}", i++ ? "," : "",
+                           sample.name, sample.value, sample.frame_delta);
+        }
+        out += "},\"histograms\":{";
+        for (size_t i = 0; const auto& sample : registry.histogram_samples) {
+            fmt::format_to(it,
+                           "{}\"{}\":{{\"count\":{},\"frame_count\":{},\"mean\":{:.3f},"
+                           "\"p50\":{},\"p99\":{}}}",
+                           i++ ? "," : "", sample.name, sample.count, sample.frame_count,
+                           sample.mean, sample.p50, sample.p99);
+        }
+        out += "}}\n";
+    } else {
+        for (const auto& sample : registry.counter_samples) {
+            fmt::format_to(it, "{},{},{},{}\n", frame, sample.name, sample.value,
+                           sample.frame_delta);
+        }
+        for (const auto& sample : registry.histogram_samples) {
+            fmt::format_to(it, "{},{}.count,{},{}\n", frame, sample.name, sample.count,
+                           sample.frame_count);
+            fmt::format_to(it, "{},{}.mean,{:.3f},\n", frame, sample.name, sample.mean);
+            fmt::format_to(it, "{},{}.p50,{},\n", frame, sample.name, sample.p50);
+            fmt::format_to(it, "{},{}.p99,{},\n", frame, sample.name, sample.p99);
+        }
+    }
+    registry.dump_file.WriteString(out);
+}
+
+} // Anonymous namespace
+
+size_t AssignShard() {
+    return next_shard.fetch_add(1, std::memory_order_relaxed) % NumShards;
+}
+
+u64 Counter::Value() const {
+    u64 value{};
+    for (const auto& shard : shards) {
+        value += shard.value.load(std::memory_order_relaxed);
+    }
+    return value;
+}
+
+u64 Histogram::Snapshot::Percentile(double fraction) const {
+    const u64 target = static_cast<u64>(count * fraction);
+    u64 seen{};
+    for (size_t i = 0; i < NumBuckets; i++) {
+        seen += buckets[i];
+        if (seen > target) {
+            return i == 0 ? 0 : (u64{1} << i) - 1;
+        }
+    }
+    return 0;
+}
+
+Histogram::Snapshot Histogram::Read() const {
+    Snapshot snapshot{};
+    for (const auto& shard : shards) {
+        for (size_t i = 0; i < NumBuckets; i++) {
+            const u64 count = shard.buckets[i].load(std::memory_order_relaxed);
+            snapshot.buckets[i] += count;
+            snapshot.count += count;
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+Counter& GetCounter(std::string_view name) {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    auto it = registry.counters.find(name);
+    if (it == registry.counters.end()) {
+        it = registry.counters.emplace(std::string{name}, std::make_unique<Counter>()).first;
+    }
+    return *it->second;
+}
+
+Histogram& GetHistogram(std::string_view name) {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    auto it = registry.histograms.find(name);
+    if (it == registry.histograms.end()) {
+        it = registry.histograms.emplace(std::string{name}, std::make_unique<Histogram>()).first;
+    }
+    return *it->second;
+}
+
+void EndFrame() {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    registry.frame++;
+    TakeSamples(registry);
+    if (Config::metricsDumpPerFrame()) {
+        WriteSamples(registry);
+    }
+}
+
+std::vector<CounterSample> GetCounters() {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    return registry.counter_samples;
+}
+
+std::vector<HistogramSample> GetHistograms() {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    return registry.histogram_samples;
+}
+
+void Dump() {
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex};
+    TakeSamples(registry);
+    WriteSamples(registry);
+    registry.dump_file.Flush();
+}
+
+} // namespace Common::Metrics
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/types.h"
+
+/**
+ * Always-on counters and histograms for hot paths, cheap enough to be left in release builds.
+ * Every thread updates its own shard of a metric so that concurrent updates don't bounce cache
+ * lines, and shards are only summed when the metrics are read once per frame.
+ *
+ * Metrics are registered by name on first use and live until exit, so call sites keep them in
+ * a static:
+ *
+ *     static auto& num_draws = Common::Metrics::GetCounter("gpu.draws");
+ *     num_draws.Add();
+ */
+namespace Common::Metrics {
+
+constexpr size_t NumShards = 16;
+
+size_t AssignShard();
+
+/// Returns the shard updated by the calling thread.
+inline size_t GetShard() {
+    thread_local size_t shard = NumShards;
+    if (shard == NumShards) [[unlikely]] {
+        shard = AssignShard();
+    }
+    return shard;
+}
+
+class Counter {
+public:
+    void Add(u64 value = 1) {
+        shards[GetShard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] u64 Value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<u64> value{};
+    };
+    std::array<Shard, NumShards> shards{};
+};
+
+/// Distribution of values in power of two buckets, bucket i holding values below 2^i.
+class Histogram {
+public:
+    static constexpr size_t NumBuckets = 64;
+
+    struct Snapshot {
+        u64 count;
+        u64 sum;
+        std::array<u64, NumBuckets> buckets;
+
+        /// Returns the upper bound of the bucket holding the given fraction of the values.
+        [[nodiscard]] u64 Percentile(double fraction) const;
+    };
+
+    void Record(u64 value) {
+        auto& shard = shards[GetShard()];
+        const size_t bucket = std::min<size_t>(std::bit_width(value), NumBuckets - 1);
+        shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Snapshot Read() const;
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<u64>, NumBuckets> buckets{};
+        std::atomic<u64> sum{};
+    };
+    std::array<Shard, NumShards> shards{};
+};
+
+/// Returns the metric registered under name, registering it on first use.
+Counter& GetCounter(std::string_view name);
+Histogram& GetHistogram(std::string_view name);
+
+struct CounterSample {
+    std::string name;
+    u64 value;
+    u64 frame_delta; ///< Increase during the last frame
+};
+
+struct HistogramSample {
+    std::string name;
+    u64 count;
+    u64 frame_count; ///< Values recorded during the last frame
+    double mean;
+    u64 p50;
+    u64 p99;
+};
+
+/// Samples every metric at the end of a frame and appends the sample to the dump file when
+/// per frame dumps are enabled.
+void EndFrame();
+
+/// Returns the metrics as sampled at the end of the last frame, sorted by name.
+std::vector<CounterSample> GetCounters();
+std::vector<HistogramSample> GetHistograms();
+
+/// Writes the current value of every metric to the dump file, if dumps are enabled.
+void Dump();
+
+} // namespace Common::Metrics
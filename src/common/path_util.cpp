@@ -117,6 +117,8 @@ static auto UserPaths = [] {
     create_path(PathType::PatchesDir, user_dir / PATCHES_DIR);
     create_path(PathType::AddonsDir, user_dir / ADDONS_DIR);
     create_path(PathType::MetaDataDir, user_dir / METADATA_DIR);
+    create_path(PathType::PkgCacheDir, user_dir / PKG_CACHE_DIR);
+    create_path(PathType::PatchCacheDir, user_dir / PATCH_CACHE_DIR);
 
     return paths;
 }();
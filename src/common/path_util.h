@@ -24,6 +24,8 @@ enum class PathType {
     PatchesDir,     // Where patches are stored.
     AddonsDir,      // Where additional content is stored.
     MetaDataDir,    // Where game metadata (e.g. trophies and menu backgrounds) is stored.
+    PkgCacheDir,    // Where files unpacked from mounted packages are stored.
+    PatchCacheDir,  // Where ahead-of-time CPU patch sites are cached.
 };
 
 constexpr auto PORTABLE_DIR = "user";
@@ -43,6 +45,8 @@ constexpr auto CHEATS_DIR = "cheats";
 constexpr auto PATCHES_DIR = "patches";
 constexpr auto ADDONS_DIR = "addcont";
 constexpr auto METADATA_DIR = "game_data";
+constexpr auto PKG_CACHE_DIR = "pkg_cache";
+constexpr auto PATCH_CACHE_DIR = "patch_cache";
 
 // Filenames
 constexpr auto LOG_FILE = "shad_log.txt";
@@ -180,6 +180,40 @@ void SetCurrentThreadName(const char*) {
 
 #endif
 
+#ifdef _WIN32
+
+void SetCurrentThreadAffinity(u64 cpu_mask) {
+    if (SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(cpu_mask)) == 0) {
+        LOG_ERROR(Common, "Failed to set thread affinity to {:#x}: {}", cpu_mask,
+                  GetLastErrorMsg());
+    }
+}
+
+#elif defined(__linux__) || defined(__FreeBSD__)
+
+void SetCurrentThreadAffinity(u64 cpu_mask) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (u32 cpu = 0; cpu < 64; cpu++) {
+        if (cpu_mask & (1ULL << cpu)) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    if (int e = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)) {
+        errno = e;
+        LOG_ERROR(Common, "Failed to set thread affinity to {:#x}: {}", cpu_mask,
+                  GetLastErrorMsg());
+    }
+}
+
+#else
+
+void SetCurrentThreadAffinity(u64 cpu_mask) {
+    // macOS only offers affinity tags as a hint, there is no way to pin a thread.
+}
+
+#endif
+
 AccurateTimer::AccurateTimer(std::chrono::nanoseconds target_interval)
     : target_interval(target_interval) {}
 
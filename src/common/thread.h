@@ -23,6 +23,9 @@ void SetCurrentThreadPriority(ThreadPriority new_priority);
 
 void SetCurrentThreadName(const char* name);
 
+/// Restricts the calling thread to the host CPUs whose bits are set in cpu_mask.
+void SetCurrentThreadAffinity(u64 cpu_mask);
+
 class AccurateTimer {
     std::chrono::nanoseconds target_interval{};
     std::chrono::nanoseconds total_wait{};
@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/polyfill_thread.h"
+#include "common/thread.h"
+#include "common/unique_function.h"
+
+namespace Common {
+
+/**
+ * Pool of worker threads executing queued tasks in FIFO order. When StateType is not void,
+ * every worker owns an instance of it that is passed to the tasks it runs.
+ */
+template <typename StateType = void>
+class StatefulThreadWorker {
+    static constexpr bool with_state = !std::is_same_v<StateType, void>;
+
+    struct DummyCallable {
+        int operator()() const noexcept {
+            return 0;
+        }
+    };
+
+    using Task =
+        std::conditional_t<with_state, UniqueFunction<void, StateType*>, UniqueFunction<void>>;
+    using StateMaker = std::conditional_t<with_state, std::function<StateType()>, DummyCallable>;
+
+public:
+    explicit StatefulThreadWorker(size_t num_workers, std::string name, StateMaker func = {})
+        : thread_name{std::move(name)} {
+        const auto lambda = [this, func](std::stop_token stop_token) {
+            Common::SetCurrentThreadName(thread_name.c_str());
+            [[maybe_unused]] std::conditional_t<with_state, StateType, int> state{func()};
+            while (!stop_token.stop_requested()) {
+                Task task;
+                {
+                    std::unique_lock lock{queue_mutex};
+                    if (requests.empty()) {
+                        wait_condition.notify_all();
+                    }
+                    Common::CondvarWait(condition, lock, stop_token,
+                                        [this] { return !requests.empty(); });
+                    if (stop_token.stop_requested()) {
+                        break;
+                    }
+                    task = std::move(requests.front());
+                    requests.pop();
+                }
+                if constexpr (with_state) {
+                    task(&state);
+                } else {
+                    task();
+                }
+                ++work_done;
+            }
+            wait_condition.notify_all();
+        };
+        threads.reserve(num_workers);
+        for (size_t i = 0; i < num_workers; ++i) {
+            threads.emplace_back(lambda);
+        }
+    }
+
+    ~StatefulThreadWorker() {
+        for (auto& thread : threads) {
+            thread.request_stop();
+        }
+        condition.notify_all();
+    }
+
+    StatefulThreadWorker& operator=(const StatefulThreadWorker&) = delete;
+    StatefulThreadWorker(const StatefulThreadWorker&) = delete;
+
+    template <typename Func>
+    void QueueWork(Func&& work) {
+        {
+            std::scoped_lock lock{queue_mutex};
+            requests.emplace(std::forward<Func>(work));
+            ++work_scheduled;
+        }
+        condition.notify_one();
+    }
+
+    /// Blocks until every queued task has been executed.
+    void WaitForRequests() {
+        std::unique_lock lock{queue_mutex};
+        wait_condition.wait(lock, [this] { return work_done >= work_scheduled; });
+    }
+
+    /// Returns the number of tasks that were queued but not yet executed.
+    [[nodiscard]] size_t NumPending() const {
+        return work_scheduled - work_done;
+    }
+
+private:
+    std::queue<Task> requests;
+    std::mutex queue_mutex;
+    std::condition_variable_any condition;
+    std::condition_variable wait_condition;
+    std::atomic<size_t> work_scheduled{};
+    std::atomic<size_t> work_done{};
+    std::string thread_name;
+    std::vector<std::jthread> threads;
+};
+
+using ThreadWorker = StatefulThreadWorker<>;
+
+} // namespace Common
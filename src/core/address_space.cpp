@@ -1,10 +1,12 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
 #include <boost/icl/separate_interval_set.hpp>
 #include "common/alignment.h"
 #include "common/arch.h"
 #include "common/assert.h"
+#include "common/config.h"
 #include "common/error.h"
 #include "core/address_space.h"
 #include "core/libraries/kernel/memory_management.h"
@@ -18,6 +20,10 @@
 #include <sys/mman.h>
 #endif
 
+#ifdef __linux__
+#include <fstream>
+#endif
+
 #if defined(__APPLE__) && defined(ARCH_X86_64)
 // Reserve space for the system address space using a zerofill section.
 asm(".zerofill GUEST_SYSTEM,GUEST_SYSTEM,__guest_system,0xFBFC00000");
@@ -27,6 +33,55 @@ namespace Core {
 
 static constexpr size_t BackingSize = SCE_KERNEL_MAIN_DMEM_SIZE;
 
+/// Faults in the whole backing memory upfront, so that first accesses to direct memory don't
+/// fault during gameplay. The memory is still zeroed, so writing zeroes to it is harmless.
+static void PrefaultBacking(u8* backing_base) {
+    const auto start = std::chrono::steady_clock::now();
+    bool populated = false;
+#ifdef MADV_POPULATE_WRITE
+    populated = madvise(backing_base, BackingSize, MADV_POPULATE_WRITE) == 0;
+#endif
+    if (!populated) {
+        for (size_t offset = 0; offset < BackingSize; offset += 4_KB) {
+            reinterpret_cast<volatile u8*>(backing_base)[offset] = 0;
+        }
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG_INFO(Kernel_Vmm, "Prefaulted {} MiB of direct memory in {} ms", BackingSize / 1_MB,
+             elapsed.count());
+}
+
+#ifdef __linux__
+/// Returns the transparent huge page policy for shared memory, such as "advise" or "never".
+static std::string GetShmemHugePagePolicy() {
+    std::ifstream file{"/sys/kernel/mm/transparent_hugepage/shmem_enabled"};
+    std::string modes;
+    std::getline(file, modes);
+    const auto begin = modes.find('[');
+    const auto end = modes.find(']');
+    if (begin == std::string::npos || end == std::string::npos) {
+        return "unavailable";
+    }
+    return modes.substr(begin + 1, end - begin - 1);
+}
+
+/// Returns how many bytes of the mapping starting at base are mapped with huge pages.
+static u64 GetHugePageBytes(const void* base) {
+    std::ifstream smaps{"/proc/self/smaps"};
+    const auto header = fmt::format("{:08x}-", reinterpret_cast<uintptr_t>(base));
+    bool in_mapping = false;
+    for (std::string line; std::getline(smaps, line);) {
+        if (line.starts_with(header)) {
+            in_mapping = true;
+        } else if (in_mapping && line.starts_with("ShmemPmdMapped:")) {
+            return std::strtoull(line.c_str() + 15, nullptr, 10) * 1_KB;
+        }
+    }
+    return 0;
+}
+#endif
+
 #ifdef _WIN32
 
 [[nodiscard]] constexpr u64 ToWindowsProt(Core::MemoryProt prot) {
@@ -110,6 +165,13 @@ struct AddressSpace::Impl {
         void* const ret = MapViewOfFile3(backing_handle, process, backing_base, 0, BackingSize,
                                          MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
         ASSERT_MSG(ret == backing_base, "{}", Common::GetLastErrorMsg());
+
+        if (Config::dmemHugePagesEnabled()) {
+            LOG_WARNING(Kernel_Vmm, "Huge pages for direct memory are not supported on Windows");
+        }
+        if (Config::dmemPrefaultEnabled()) {
+            PrefaultBacking(backing_base);
+        }
     }
 
     ~Impl() {
@@ -398,6 +460,43 @@ struct AddressSpace::Impl {
             LOG_CRITICAL(Kernel_Vmm, "mmap failed: {}", strerror(errno));
             throw std::bad_alloc{};
         }
+
+#ifdef __linux__
+        // Shared memory is only backed by transparent huge pages in mappings advised to use
+        // them, so every alias of the backing file made by Map is advised as well. hugetlbfs is
+        // not an option, its mappings must be 2M aligned while guests map direct memory with 16K
+        // granularity.
+        if (Config::dmemHugePagesEnabled()) {
+            const auto policy = GetShmemHugePagePolicy();
+            if (policy == "never" || policy == "deny" || policy == "unavailable") {
+                LOG_WARNING(Kernel_Vmm,
+                            "Shared memory huge page policy is {}, direct memory uses 4K pages",
+                            policy);
+            } else if (madvise(backing_base, BackingSize, MADV_HUGEPAGE) != 0) {
+                LOG_WARNING(Kernel_Vmm, "madvise failed: {}, direct memory uses 4K pages",
+                            strerror(errno));
+            } else {
+                use_huge_pages = true;
+            }
+        }
+#else
+        if (Config::dmemHugePagesEnabled()) {
+            LOG_WARNING(Kernel_Vmm, "Huge pages for direct memory are not supported on macOS");
+        }
+#endif
+
+        if (Config::dmemPrefaultEnabled()) {
+            PrefaultBacking(backing_base);
+        }
+
+#ifdef __linux__
+        if (use_huge_pages) {
+            // Pages are only allocated on first access, so without prefaulting this only tells
+            // whether huge pages could be allocated at all.
+            LOG_INFO(Kernel_Vmm, "Direct memory uses 2M pages, {} of {} MiB currently allocated",
+                     GetHugePageBytes(backing_base) / 1_MB, BackingSize / 1_MB);
+        }
+#endif
     }
 
     void* Map(VAddr virtual_addr, PAddr phys_addr, size_t size, PosixPageProtection prot,
@@ -409,6 +508,11 @@ struct AddressSpace::Impl {
         void* ret = mmap(reinterpret_cast<void*>(virtual_addr), size, prot, MAP_FIXED | flag,
                          handle, host_offset);
         ASSERT_MSG(ret != MAP_FAILED, "mmap failed: {}", strerror(errno));
+#ifdef __linux__
+        if (use_huge_pages && handle == backing_fd) {
+            madvise(ret, size, MADV_HUGEPAGE);
+        }
+#endif
         return ret;
     }
 
@@ -451,6 +555,7 @@ struct AddressSpace::Impl {
     }
 
     int backing_fd;
+    bool use_huge_pages{};
     u8* backing_base{};
     u8* system_managed_base{};
     size_t system_managed_size{};
@@ -1,18 +1,32 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <ranges>
 #include <set>
+#include <span>
+#include <thread>
 #include <Zydis/Zydis.h>
 #include <xbyak/xbyak.h>
 #include <xbyak/xbyak_util.h>
+#include <xxhash.h>
 #include "common/alignment.h"
 #include "common/arch.h"
 #include "common/assert.h"
 #include "common/decoder.h"
+#include "common/div_ceil.h"
+#include "common/io_file.h"
+#include "common/path_util.h"
+#include "common/scm_rev.h"
 #include "common/signal_context.h"
+#include "common/thread_worker.h"
 #include "common/types.h"
 #include "core/signals.h"
 #include "core/tls.h"
@@ -935,6 +949,168 @@ static bool TryPatchJit(void* code_address) {
     return TryPatch(code, module).first;
 }
 
+/// Decodes the instruction at code and returns its length, or 1 if it could not be decoded.
+static u64 DecodeForPatch(const u8* code, u64 size, bool& needs_patch) {
+    ZydisDecodedInstruction instruction;
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+    const auto status = Common::Decoder::Instance()->decodeInstruction(
+        instruction, operands, const_cast<u8*>(code), size);
+    if (!ZYAN_SUCCESS(status)) {
+        needs_patch = false;
+        return 1;
+    }
+    const auto it = Patches.find(instruction.mnemonic);
+    needs_patch = it != Patches.end() && it->second.filter(operands);
+    return instruction.length;
+}
+
+/**
+ * Part of a code segment decoded by one worker. A linear sweep started at an arbitrary offset
+ * may begin in the middle of an instruction, but x86 decoding resynchronizes within a few
+ * instructions. So every worker keeps decoding past the end of its chunk until it reaches an
+ * instruction boundary the following chunk also decoded, and from there on both agree.
+ */
+struct ScanChunk {
+    u64 start;
+    std::vector<u64> head;  ///< Instruction boundaries in the first SyncWindow bytes
+    std::vector<u64> sites; ///< Instructions to patch, up to the sync point
+    u64 sync_point;         ///< Boundary where the sweep joined the chunk below
+    size_t sync_chunk;      ///< Chunk joined at the sync point, or the number of chunks
+};
+
+static constexpr u64 SyncWindow = 4_KB;
+static constexpr u64 MinChunkSize = 1_MB;
+
+static void DecodeChunkHead(const u8* code, u64 size, ScanChunk& chunk) {
+    bool needs_patch;
+    const u64 end = std::min(chunk.start + SyncWindow, size);
+    for (u64 offset = chunk.start; offset < end;) {
+        chunk.head.push_back(offset);
+        offset += DecodeForPatch(code + offset, size - offset, needs_patch);
+    }
+}
+
+static void DecodeChunk(const u8* code, u64 size, std::span<ScanChunk> chunks, size_t index) {
+    auto& chunk = chunks[index];
+    size_t next = index + 1;
+    u64 offset = chunk.start;
+    while (offset < size) {
+        // Chunks whose head was passed without joining them are decoded by this sweep instead.
+        while (next < chunks.size() && offset >= chunks[next].start + SyncWindow) {
+            next++;
+        }
+        if (next < chunks.size() && offset >= chunks[next].start &&
+            std::ranges::binary_search(chunks[next].head, offset)) {
+            chunk.sync_point = offset;
+            chunk.sync_chunk = next;
+            return;
+        }
+        bool needs_patch;
+        const u64 length = DecodeForPatch(code + offset, size - offset, needs_patch);
+        if (needs_patch) {
+            chunk.sites.push_back(offset);
+        }
+        offset += length;
+    }
+    chunk.sync_point = size;
+    chunk.sync_chunk = chunks.size();
+}
+
+/// Returns the offsets of the instructions to patch in a code segment, in ascending order, as
+/// found by a linear sweep from its start. Large segments are decoded in parallel.
+static std::vector<u64> FindPatchSites(const u8* code, u64 size) {
+    const size_t num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+    const size_t num_chunks = std::clamp<size_t>(size / MinChunkSize, 1, num_threads * 4);
+    const u64 chunk_size = Common::AlignUp(Common::DivCeil(size, u64(num_chunks)), 16);
+    std::vector<ScanChunk> chunks;
+    for (u64 start = 0; start < size; start += chunk_size) {
+        chunks.push_back({.start = start});
+    }
+
+    if (chunks.size() == 1) {
+        DecodeChunk(code, size, chunks, 0);
+    } else {
+        Common::ThreadWorker workers{std::min(num_threads, chunks.size()), "PatchScanWorker"};
+        for (auto& chunk : chunks | std::views::drop(1)) {
+            workers.QueueWork([code, size, &chunk] { DecodeChunkHead(code, size, chunk); });
+        }
+        workers.WaitForRequests();
+        for (size_t i = 0; i < chunks.size(); i++) {
+            workers.QueueWork([code, size, &chunks, i] { DecodeChunk(code, size, chunks, i); });
+        }
+        workers.WaitForRequests();
+    }
+
+    // Follow the sweep from the segment start, switching chunks at every sync point.
+    std::vector<u64> sites;
+    u64 from = 0;
+    for (size_t i = 0; i < chunks.size(); i = chunks[i].sync_chunk) {
+        const auto& chunk = chunks[i];
+        const auto first = std::ranges::lower_bound(chunk.sites, from);
+        sites.insert(sites.end(), first, chunk.sites.end());
+        from = chunk.sync_point;
+    }
+    return sites;
+}
+
+struct PatchCacheHeader {
+    static constexpr u32 Magic = 0x48435450; // PTCH
+    u32 magic;
+    u32 num_sites;
+    u64 code_size;
+};
+
+/// Returns the cache file of a code segment. Patch sites depend on the code, on the patches in
+/// this build and on the host CPU features the patch filters check.
+static std::filesystem::path GetPatchCachePath(const u8* code, u64 size) {
+    const u64 build_hash = XXH3_64bits(Common::g_scm_rev, std::strlen(Common::g_scm_rev));
+    const u64 seed = build_hash ^ static_cast<u64>(Cpu().has(Cpu::tSSE4a));
+    const u64 hash = XXH3_64bits_withSeed(code, size, seed);
+    return Common::FS::GetUserPath(Common::FS::PathType::PatchCacheDir) /
+           fmt::format("{:016x}.bin", hash);
+}
+
+static std::optional<std::vector<u64>> LoadPatchSites(const std::filesystem::path& path,
+                                                      u64 code_size) {
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+    Common::FS::IOFile file{path, Common::FS::FileAccessMode::Read};
+    PatchCacheHeader header;
+    if (!file.IsOpen() || !file.ReadObject(header) || header.magic != PatchCacheHeader::Magic ||
+        header.code_size != code_size || header.num_sites > code_size) {
+        return std::nullopt;
+    }
+    std::vector<u64> sites(header.num_sites);
+    if (file.ReadSpan(std::span{sites}) != sites.size()) {
+        return std::nullopt;
+    }
+    // Every site must lie within the code and appear once, in the order they were found.
+    const bool valid = std::ranges::all_of(sites, [code_size](u64 offset) {
+        return offset < code_size;
+    }) && std::ranges::adjacent_find(sites, std::greater_equal{}) == sites.end();
+    if (!valid) {
+        LOG_WARNING(Core, "Discarding invalid patch cache {}", path.string());
+        return std::nullopt;
+    }
+    return sites;
+}
+
+static void SavePatchSites(const std::filesystem::path& path, u64 code_size,
+                           std::span<const u64> sites) {
+    Common::FS::IOFile file{path, Common::FS::FileAccessMode::Write};
+    if (!file.IsOpen()) {
+        return;
+    }
+    const PatchCacheHeader header{
+        .magic = PatchCacheHeader::Magic,
+        .num_sites = static_cast<u32>(sites.size()),
+        .code_size = code_size,
+    };
+    file.WriteObject(header);
+    file.WriteSpan(sites);
+}
+
 static void TryPatchAot(void* code_address, u64 code_size) {
     auto* code = static_cast<u8*>(code_address);
     auto* module = GetModule(code);
@@ -942,12 +1118,27 @@ static void TryPatchAot(void* code_address, u64 code_size) {
         return;
     }
 
-    std::unique_lock lock{module->mutex};
+    // Patch sites are cached rather than the patched code, as trampolines embed the addresses
+    // of host functions which change between runs. Regenerating them is cheap.
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto cache_path = GetPatchCachePath(code, code_size);
+    auto sites = LoadPatchSites(cache_path, code_size);
+    const bool cached = sites.has_value();
+    if (!cached) {
+        sites = FindPatchSites(code, code_size);
+        SavePatchSites(cache_path, code_size, *sites);
+    }
 
-    const auto* end = code + code_size;
-    while (code < end) {
-        code += TryPatch(code, module).second;
+    std::unique_lock lock{module->mutex};
+    u64 num_patched = 0;
+    for (const u64 offset : *sites) {
+        num_patched += TryPatch(code + offset, module).first;
     }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    LOG_INFO(Core, "Patched {} instructions of {} in {} ms{}", num_patched, fmt::ptr(code),
+             elapsed.count(), cached ? " (cached)" : "");
 }
 
 static bool PatchesAccessViolationHandler(void* context, void* /* fault_address */) {
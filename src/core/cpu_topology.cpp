@@ -0,0 +1,226 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#include "common/config.h"
+#include "common/logging/log.h"
+#include "common/thread.h"
+#include "core/cpu_topology.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace Core {
+
+namespace {
+
+/// Host CPUs past this can't be represented in the affinity masks.
+constexpr u32 MaxHostCpus = 64;
+
+struct Topology {
+    bool enabled{};
+    std::array<u32, NumGuestCores> guest_cpus{};
+    u64 guest_mask{};   ///< All CPUs backing guest cores
+    u64 service_mask{}; ///< CPUs reserved for emulator threads, 0 to leave them unpinned
+};
+
+Topology topology;
+
+/// Parses a list of CPU ids and ranges such as "0-3,8,10-11", as used by sysfs and the config.
+std::vector<u32> ParseCpuList(std::string_view list) {
+    std::vector<u32> cpus;
+    const auto parse = [](std::string_view str, u32& value) {
+        const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        return ec == std::errc{} && ptr == str.data() + str.size();
+    };
+    while (!list.empty()) {
+        const auto comma = list.find(',');
+        auto item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+        const auto first = item.find_first_not_of(" \t\n");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        item = item.substr(first, item.find_last_not_of(" \t\n") - first + 1);
+
+        const auto dash = item.find('-');
+        u32 begin{};
+        u32 end{};
+        if (!parse(item.substr(0, dash), begin) ||
+            !parse(dash == std::string_view::npos ? item : item.substr(dash + 1), end) ||
+            end < begin) {
+            LOG_WARNING(Core, "Ignoring invalid CPU list entry '{}'", item);
+            continue;
+        }
+        for (u32 cpu = begin; cpu <= end; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+u64 ToMask(const std::vector<u32>& cpus) {
+    u64 mask{};
+    for (const u32 cpu : cpus) {
+        mask |= 1ULL << cpu;
+    }
+    return mask;
+}
+
+#ifdef __linux__
+/// Returns the first CPU of a list read from sysfs, which identifies the group it describes.
+u32 ReadGroupId(u32 cpu, std::string_view file, u32 fallback) {
+    std::ifstream stream{fmt::format("/sys/devices/system/cpu/cpu{}/{}", cpu, file)};
+    std::string list;
+    std::getline(stream, list);
+    const auto cpus = ParseCpuList(list);
+    return cpus.empty() ? fallback : cpus.front();
+}
+#endif
+
+/**
+ * Returns the host CPUs the emulator is allowed to run on. One CPU of every physical core comes
+ * first, with the cores of the largest last level cache domains ahead, followed by the remaining
+ * SMT siblings.
+ */
+std::vector<u32> GetHostCpus() {
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        struct HostCpu {
+            u32 id;
+            u32 core;
+            u32 cache;
+        };
+        std::vector<HostCpu> cpus;
+        std::map<u32, u32> cache_sizes;
+        for (u32 cpu = 0; cpu < MaxHostCpus; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            const u32 core = ReadGroupId(cpu, "topology/thread_siblings_list", cpu);
+            const u32 cache = ReadGroupId(cpu, "cache/index3/shared_cpu_list", 0);
+            cpus.push_back({cpu, core, cache});
+            cache_sizes[cache]++;
+        }
+        const auto is_primary = [](const HostCpu& cpu) { return cpu.id == cpu.core; };
+        std::ranges::stable_sort(cpus, [&](const HostCpu& a, const HostCpu& b) {
+            if (is_primary(a) != is_primary(b)) {
+                return is_primary(a);
+            }
+            if (cache_sizes[a.cache] != cache_sizes[b.cache]) {
+                return cache_sizes[a.cache] > cache_sizes[b.cache];
+            }
+            return a.cache < b.cache;
+        });
+        std::vector<u32> ids;
+        for (const auto& cpu : cpus) {
+            ids.push_back(cpu.id);
+        }
+        return ids;
+    }
+#endif
+    std::vector<u32> ids(std::clamp(std::thread::hardware_concurrency(), 1U, MaxHostCpus));
+    for (u32 cpu = 0; cpu < ids.size(); cpu++) {
+        ids[cpu] = cpu;
+    }
+    return ids;
+}
+
+/// Parses a configured CPU list, dropping the CPUs the emulator isn't allowed to run on.
+std::vector<u32> ParseConfigCpus(std::string_view list, const std::vector<u32>& host_cpus) {
+    std::vector<u32> cpus = ParseCpuList(list);
+    std::erase_if(cpus, [&](u32 cpu) {
+        if (std::ranges::find(host_cpus, cpu) != host_cpus.end()) {
+            return false;
+        }
+        LOG_WARNING(Core, "Host CPU {} is not available, ignoring it", cpu);
+        return true;
+    });
+    return cpus;
+}
+
+} // Anonymous namespace
+
+void InitCpuTopology() {
+    if (!Config::pinThreadsEnabled()) {
+        return;
+    }
+
+    const auto host_cpus = GetHostCpus();
+    std::vector<u32> service_cpus = ParseConfigCpus(Config::getServiceCpus(), host_cpus);
+    std::vector<u32> guest_cpus = ParseConfigCpus(Config::getGuestCpus(), host_cpus);
+    if (guest_cpus.empty()) {
+        for (const u32 cpu : host_cpus) {
+            if (guest_cpus.size() < NumGuestCores &&
+                std::ranges::find(service_cpus, cpu) == service_cpus.end()) {
+                guest_cpus.push_back(cpu);
+            }
+        }
+    }
+    if (guest_cpus.empty()) {
+        LOG_WARNING(Core, "No host CPUs left for guest threads, not pinning threads");
+        return;
+    }
+    if (service_cpus.empty() && Config::getServiceCpus().empty()) {
+        // Reserve whatever the guest cores don't use, if anything.
+        for (const u32 cpu : host_cpus) {
+            if (std::ranges::find(guest_cpus, cpu) == guest_cpus.end()) {
+                service_cpus.push_back(cpu);
+            }
+        }
+    }
+
+    topology.enabled = true;
+    for (u32 core = 0; core < NumGuestCores; core++) {
+        // Guest cores share host CPUs when there are fewer of them.
+        topology.guest_cpus[core] = guest_cpus[core % guest_cpus.size()];
+    }
+    topology.guest_mask = ToMask(guest_cpus);
+    topology.service_mask = ToMask(service_cpus);
+
+    std::string mapping;
+    for (u32 core = 0; core < NumGuestCores; core++) {
+        mapping += fmt::format("{}{}->{}", core ? ", " : "", core, topology.guest_cpus[core]);
+    }
+    LOG_INFO(Core, "Guest core to host CPU mapping: {}", mapping);
+    if (topology.service_mask != 0) {
+        LOG_INFO(Core, "Host CPUs reserved for emulator threads: {}",
+                 fmt::join(service_cpus, ","));
+    } else {
+        LOG_INFO(Core, "No host CPUs left to reserve for emulator threads");
+    }
+}
+
+u64 GetHostCpuMask(u64 guest_mask) {
+    if (!topology.enabled) {
+        return 0;
+    }
+    u64 host_mask{};
+    for (u32 core = 0; core < NumGuestCores; core++) {
+        if (guest_mask & (1ULL << core)) {
+            host_mask |= 1ULL << topology.guest_cpus[core];
+        }
+    }
+    return host_mask != 0 ? host_mask : topology.guest_mask;
+}
+
+void PinServiceThread() {
+    if (topology.service_mask != 0) {
+        Common::SetCurrentThreadAffinity(topology.service_mask);
+    }
+}
+
+} // namespace Core
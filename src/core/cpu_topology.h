@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "common/types.h"
+
+namespace Core {
+
+/// Number of CPU cores games can schedule their threads on.
+constexpr u32 NumGuestCores = 7;
+
+/**
+ * Decides which host CPUs back each guest core and which are reserved for emulator threads,
+ * and logs the mapping. The CPUs are taken from the config when set, otherwise one CPU per
+ * physical core is picked, filling the largest last level cache domain first, so that the
+ * guest sees cores that share a cache like it would on the console.
+ */
+void InitCpuTopology();
+
+/// Returns the host CPUs backing the guest cores set in guest_mask, or 0 when threads aren't
+/// pinned.
+u64 GetHostCpuMask(u64 guest_mask);
+
+/// Restricts the calling emulator thread to the host CPUs reserved for emulator threads.
+void PinServiceThread();
+
+} // namespace Core
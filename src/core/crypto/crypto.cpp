@@ -1,7 +1,11 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
 #include <array>
+#include <thread>
+#include <vector>
+#include "common/div_ceil.h"
 #include "crypto.h"
 
 CryptoPP::RSA::PrivateKey Crypto::key_pkg_derived_key3_keyset_init() {
@@ -187,28 +191,63 @@ void Crypto::PfsGenCryptoKey(std::span<const CryptoPP::byte, 32> ekpfs,
 
 void Crypto::decryptPFS(std::span<const CryptoPP::byte, 16> dataKey,
                         std::span<const CryptoPP::byte, 16> tweakKey, std::span<const u8> src_image,
-                        std::span<CryptoPP::byte> dst_image, u64 sector) {
-    // Start at 0x10000 to keep the header when decrypting the whole pfs_image.
-    for (int i = 0; i < src_image.size(); i += 0x1000) {
-        const u64 current_sector = sector + (i / 0x1000);
+                        std::span<CryptoPP::byte> dst_image, u64 sector, u32 num_threads) {
+    static constexpr size_t SectorSize = 0x1000;
+    static constexpr size_t NumWords = SectorSize / sizeof(u64);
+    const size_t num_sectors = src_image.size() / SectorSize;
+
+    const auto decrypt_sectors = [&](size_t first, size_t last) {
+        // Expand the keys once, the AES implementation pipelines whole sectors with AES-NI.
         CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption encrypt(tweakKey.data(), tweakKey.size());
         CryptoPP::ECB_Mode<CryptoPP::AES>::Decryption decrypt(dataKey.data(), dataKey.size());
-
-        std::array<CryptoPP::byte, 16> tweak{};
-        std::array<CryptoPP::byte, 16> encryptedTweak;
-        std::array<CryptoPP::byte, 16> xorBuffer;
-        std::memcpy(tweak.data(), &current_sector, sizeof(u64));
-
-        // Encrypt the tweak for each sector.
-        encrypt.ProcessData(encryptedTweak.data(), tweak.data(), 16);
-
-        for (int plaintextOffset = 0; plaintextOffset < 0x1000; plaintextOffset += 16) {
-            xtsXorBlock(xorBuffer.data(), src_image.data() + i + plaintextOffset,
-                        encryptedTweak.data());                          // x, c, t
-            decrypt.ProcessData(xorBuffer.data(), xorBuffer.data(), 16); // x, x
-            xtsXorBlock(dst_image.data() + i + plaintextOffset, xorBuffer.data(),
-                        encryptedTweak.data()); //(p)  c, x , t
-            xtsMult(encryptedTweak);
+        std::array<u64, NumWords> tweaks;
+        std::array<u64, NumWords> buffer;
+
+        for (size_t i = first; i < last; i++) {
+            const u64 current_sector = sector + i;
+            std::array<CryptoPP::byte, 16> tweak{};
+            std::memcpy(tweak.data(), &current_sector, sizeof(u64));
+
+            // Encrypt the tweak of the sector, then multiply it by x in GF(2^128) for every
+            // following block.
+            encrypt.ProcessData(reinterpret_cast<CryptoPP::byte*>(tweaks.data()), tweak.data(),
+                                tweak.size());
+            for (size_t j = 2; j < NumWords; j += 2) {
+                const u64 lo = tweaks[j - 2];
+                const u64 hi = tweaks[j - 1];
+                tweaks[j] = (lo << 1) ^ ((hi >> 63) * 0x87);
+                tweaks[j + 1] = (hi << 1) | (lo >> 63);
+            }
+
+            const u8* src = src_image.data() + i * SectorSize;
+            u8* dst = dst_image.data() + i * SectorSize;
+            std::memcpy(buffer.data(), src, SectorSize);
+            for (size_t j = 0; j < NumWords; j++) {
+                buffer[j] ^= tweaks[j];
+            }
+            auto* data = reinterpret_cast<CryptoPP::byte*>(buffer.data());
+            decrypt.ProcessData(data, data, SectorSize);
+            for (size_t j = 0; j < NumWords; j++) {
+                buffer[j] ^= tweaks[j];
+            }
+            std::memcpy(dst, buffer.data(), SectorSize);
         }
+    };
+
+    // Only split images large enough to amortize starting the threads.
+    static constexpr size_t MinSectorsPerThread = 256;
+    num_threads = std::clamp<u32>(num_sectors / MinSectorsPerThread, 1, std::max(num_threads, 1U));
+    if (num_threads == 1) {
+        decrypt_sectors(0, num_sectors);
+        return;
+    }
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads - 1);
+    const size_t sectors_per_thread = Common::DivCeil(num_sectors, size_t{num_threads});
+    for (u32 i = 1; i < num_threads; i++) {
+        const size_t first = std::min(num_sectors, i * sectors_per_thread);
+        const size_t last = std::min(num_sectors, first + sectors_per_thread);
+        threads.emplace_back(decrypt_sectors, first, last);
     }
+    decrypt_sectors(0, std::min(num_sectors, sectors_per_thread));
 }
@@ -38,25 +38,9 @@ public:
                          std::span<const CryptoPP::byte, 16> seed,
                          std::span<CryptoPP::byte, 16> dataKey,
                          std::span<CryptoPP::byte, 16> tweakKey);
+    /// Decrypts AES-XTS encrypted 0x1000 byte sectors of a PFS image, starting at the given
+    /// sector number. Large images are split across up to num_threads threads.
     void decryptPFS(std::span<const CryptoPP::byte, 16> dataKey,
                     std::span<const CryptoPP::byte, 16> tweakKey, std::span<const u8> src_image,
-                    std::span<CryptoPP::byte> dst_image, u64 sector);
-
-    void xtsXorBlock(CryptoPP::byte* x, const CryptoPP::byte* a, const CryptoPP::byte* b) {
-        for (int i = 0; i < 16; i++) {
-            x[i] = a[i] ^ b[i];
-        }
-    }
-
-    void xtsMult(std::span<CryptoPP::byte, 16> encryptedTweak) {
-        int feedback = 0;
-        for (int k = 0; k < encryptedTweak.size(); k++) {
-            const auto tmp = (encryptedTweak[k] >> 7) & 1;
-            encryptedTweak[k] = ((encryptedTweak[k] << 1) + feedback) & 0xFF;
-            feedback = tmp;
-        }
-        if (feedback != 0) {
-            encryptedTweak[0] ^= 0x87;
-        }
-    }
+                    std::span<CryptoPP::byte> dst_image, u64 sector, u32 num_threads = 1);
 };
@@ -1,8 +1,16 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <semaphore>
+#include <thread>
 #include <zlib-ng.h>
+#include "common/alignment.h"
 #include "common/io_file.h"
+#include "common/thread_worker.h"
 #include "core/file_format/pkg.h"
 #include "core/file_format/pkg_type.h"
 
@@ -97,6 +105,16 @@ bool PKG::Open(const std::filesystem::path& filepath) {
 
 bool PKG::Extract(const std::filesystem::path& filepath, const std::filesystem::path& extract,
                   std::string& failreason) {
+    return ReadImage(filepath, extract, failreason, true);
+}
+
+bool PKG::Mount(const std::filesystem::path& filepath, const std::filesystem::path& sys_dir,
+                std::string& failreason) {
+    return ReadImage(filepath, sys_dir, failreason, false);
+}
+
+bool PKG::ReadImage(const std::filesystem::path& filepath, const std::filesystem::path& extract,
+                    std::string& failreason, bool create_dirs) {
     extract_path = extract;
     pkgpath = filepath;
     Common::FS::IOFile file(filepath, Common::FS::FileAccessMode::Read);
@@ -254,7 +272,8 @@ bool PKG::Extract(const std::filesystem::path& filepath, const std::filesystem::
         file.Close();
         // Decrypt the pfs_image.
         std::vector<u8> pfs_decrypted(length);
-        PKG::crypto.decryptPFS(dataKey, tweakKey, pfs_encrypted, pfs_decrypted, 0);
+        PKG::crypto.decryptPFS(dataKey, tweakKey, pfs_encrypted, pfs_decrypted, 0,
+                               std::thread::hardware_concurrency());
 
         // Retrieve PFSC from decrypted pfs_image.
         pfsc_offset = GetPFSCOffset(pfs_decrypted);
@@ -375,7 +394,7 @@ bool PKG::Extract(const std::filesystem::path& filepath, const std::filesystem::
                     current_dir.string() / std::filesystem::path(table.name);
 
                 if (table.type == PFS_FILE || table.type == PFS_DIR) {
-                    if (table.type == PFS_DIR) { // Create dirs.
+                    if (table.type == PFS_DIR && create_dirs) { // Create dirs.
                         std::filesystem::create_directory(extractPaths[table.inode]);
                     }
                     ndinode_counter++;
@@ -391,6 +410,50 @@ bool PKG::Extract(const std::filesystem::path& filepath, const std::filesystem::
     return true;
 }
 
+PKG::BlockLocation PKG::GetBlockLocation(u64 block) const {
+    const u64 sectorOffset = sectorMap[block]; // offset into PFSC_image and not pfs_image.
+    const u64 sectorSize =
+        sectorMap[block + 1] - sectorOffset; // indicates if data is compressed or not.
+    const u64 fileOffset = (pkgheader.pfs_image_offset + pfsc_offset + sectorOffset);
+    const u64 currentSector1 =
+        (pfsc_offset + sectorOffset) / 0x1000; // block size is 0x1000 for xts decryption.
+
+    const int sectorOffsetMask = (sectorOffset + pfsc_offset) & 0xFFFFF000;
+    const int previousData = (sectorOffset + pfsc_offset) - sectorOffsetMask;
+
+    // Only the xts sectors overlapping the block need to be read and decrypted.
+    const u64 readSize = std::min<u64>(Common::AlignUp(previousData + sectorSize, 0x1000),
+                                       BlockSize + 0x1000);
+    return {fileOffset - previousData, readSize, sectorSize, currentSector1, previousData};
+}
+
+void PKG::ReadEncryptedBlock(Common::FS::IOFile& file, u64 block, BlockBuffers& buffers) const {
+    const auto location = GetBlockLocation(block);
+    file.Seek(location.file_offset);
+    file.ReadRaw<u8>(buffers.encrypted.data(), location.read_size);
+}
+
+void PKG::DecodeBlock(u64 block, BlockBuffers& buffers, std::span<char> out) {
+    const auto location = GetBlockLocation(block);
+    PKG::crypto.decryptPFS(dataKey, tweakKey,
+                           std::span{buffers.encrypted}.first(location.read_size),
+                           buffers.decrypted, location.xts_sector);
+
+    const auto data = std::span{reinterpret_cast<const char*>(buffers.decrypted.data()) +
+                                    location.previous_data,
+                                location.sector_size};
+    if (location.sector_size == BlockSize) // Uncompressed data
+        std::memcpy(out.data(), data.data(), BlockSize);
+    else if (location.sector_size < BlockSize) // Compressed data
+        DecompressPFSC(data, out);
+}
+
+void PKG::ReadBlock(Common::FS::IOFile& file, u64 block, BlockBuffers& buffers,
+                    std::span<char> out) {
+    ReadEncryptedBlock(file, block, buffers);
+    DecodeBlock(block, buffers, out);
+}
+
 void PKG::ExtractFiles(const int index) {
     int inode_number = fsTable[index].inode;
     int inode_type = fsTable[index].type;
@@ -408,39 +471,13 @@ void PKG::ExtractFiles(const int index) {
         pkgFile.Open(pkgpath, Common::FS::FileAccessMode::Read);
 
         int size_decompressed = 0;
-        std::vector<char> compressedData;
-        std::vector<char> decompressedData(0x10000);
-
-        u64 pfsc_buf_size = 0x11000; // extra 0x1000
-        std::vector<u8> pfsc(pfsc_buf_size);
-        std::vector<u8> pfs_decrypted(pfsc_buf_size);
+        std::vector<char> decompressedData(BlockSize);
+        BlockBuffers buffers;
 
         for (int j = 0; j < nblocks; j++) {
-            u64 sectorOffset =
-                sectorMap[sector_loc + j]; // offset into PFSC_image and not pfs_image.
-            u64 sectorSize = sectorMap[sector_loc + j + 1] -
-                             sectorOffset; // indicates if data is compressed or not.
-            u64 fileOffset = (pkgheader.pfs_image_offset + pfsc_offset + sectorOffset);
-            u64 currentSector1 =
-                (pfsc_offset + sectorOffset) / 0x1000; // block size is 0x1000 for xts decryption.
+            ReadBlock(pkgFile, sector_loc + j, buffers, decompressedData);
 
-            int sectorOffsetMask = (sectorOffset + pfsc_offset) & 0xFFFFF000;
-            int previousData = (sectorOffset + pfsc_offset) - sectorOffsetMask;
-
-            pkgFile.Seek(fileOffset - previousData);
-            pkgFile.Read(pfsc);
-
-            PKG::crypto.decryptPFS(dataKey, tweakKey, pfsc, pfs_decrypted, currentSector1);
-
-            compressedData.resize(sectorSize);
-            std::memcpy(compressedData.data(), pfs_decrypted.data() + previousData, sectorSize);
-
-            if (sectorSize == 0x10000) // Uncompressed data
-                std::memcpy(decompressedData.data(), compressedData.data(), 0x10000);
-            else if (sectorSize < 0x10000) // Compressed data
-                DecompressPFSC(compressedData, decompressedData);
-
-            size_decompressed += 0x10000;
+            size_decompressed += BlockSize;
 
             if (j < nblocks - 1) {
                 inflated.WriteRaw<u8>(decompressedData.data(), decompressedData.size());
@@ -454,3 +491,157 @@ void PKG::ExtractFiles(const int index) {
         inflated.Close();
     }
 }
+
+namespace {
+
+struct ExtractJob {
+    u64 seq;
+    u32 file;  ///< Index of the file in the extraction order
+    u64 index; ///< Index of the block in the file
+    PKG::BlockBuffers buffers;
+    std::vector<char> data = std::vector<char>(PKG::BlockSize);
+};
+
+} // Anonymous namespace
+
+bool PKG::ExtractAllFiles(u32 num_workers, const ProgressCallback& callback,
+                          std::stop_token stop_token) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+
+    ExtractProgress progress{};
+    std::vector<u32> files;
+    u64 num_jobs{};
+    for (const auto& entry : fsTable) {
+        if (entry.type != PFS_FILE) {
+            continue;
+        }
+        const auto& node = iNodeBuf[entry.inode];
+        progress.total_bytes += node.Size;
+        progress.num_files++;
+        if (node.Blocks == 0) {
+            // Nothing to stream, just create the file.
+            Common::FS::IOFile out(extractPaths.at(entry.inode), Common::FS::FileAccessMode::Write);
+            progress.files_written++;
+            continue;
+        }
+        files.push_back(entry.inode);
+        num_jobs += node.Blocks;
+    }
+
+    Common::FS::IOFile file(pkgpath, Common::FS::FileAccessMode::Read);
+    if (!file.IsOpen()) {
+        return false;
+    }
+
+    // Bound the amount of blocks in flight, each job owns about 200 KiB of buffers.
+    num_workers = std::max(num_workers, 1U);
+    const u32 max_jobs = num_workers * 4;
+    std::counting_semaphore<> free_jobs{max_jobs};
+    std::mutex pool_mutex;
+    std::vector<std::unique_ptr<ExtractJob>> job_pool;
+
+    std::mutex decoded_mutex;
+    std::condition_variable decoded_cv;
+    std::unordered_map<u64, std::unique_ptr<ExtractJob>> decoded_jobs;
+    bool cancelled{};
+
+    const auto report = [&] {
+        if (callback) {
+            progress.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            callback(progress);
+        }
+    };
+
+    // Writes decoded blocks in order, so that every file is written sequentially.
+    std::jthread writer([&] {
+        static constexpr u64 ReportInterval = 16_MB;
+        Common::FS::IOFile out;
+        u32 current_file = std::numeric_limits<u32>::max();
+        u64 last_report{};
+        for (u64 seq = 0; seq < num_jobs; seq++) {
+            std::unique_ptr<ExtractJob> job;
+            {
+                std::unique_lock lock{decoded_mutex};
+                decoded_cv.wait(lock, [&] { return cancelled || decoded_jobs.contains(seq); });
+                const auto it = decoded_jobs.find(seq);
+                if (it == decoded_jobs.end()) {
+                    return;
+                }
+                job = std::move(it->second);
+                decoded_jobs.erase(it);
+            }
+            const u32 inode = files[job->file];
+            const auto& node = iNodeBuf[inode];
+            if (job->file != current_file) {
+                out.Open(extractPaths.at(inode), Common::FS::FileAccessMode::Write);
+                out.SetSize(node.Size);
+                current_file = job->file;
+            }
+            const u64 offset = job->index * BlockSize;
+            const u64 size = std::min<u64>(BlockSize, node.Size - offset);
+            out.WriteRaw<u8>(job->data.data(), size);
+            progress.bytes_written += size;
+            if (job->index + 1 == node.Blocks) {
+                out.Close();
+                progress.files_written++;
+                report();
+                last_report = progress.bytes_written;
+            } else if (progress.bytes_written - last_report >= ReportInterval) {
+                report();
+                last_report = progress.bytes_written;
+            }
+            {
+                std::scoped_lock lock{pool_mutex};
+                job_pool.push_back(std::move(job));
+            }
+            free_jobs.release();
+        }
+    });
+
+    // Read the encrypted blocks on this thread and decode them on the workers.
+    Common::ThreadWorker workers(num_workers, "PkgExtract");
+    u64 seq{};
+    for (u32 i = 0; i < files.size() && !stop_token.stop_requested(); i++) {
+        const auto& node = iNodeBuf[files[i]];
+        for (u64 j = 0; j < node.Blocks && !stop_token.stop_requested(); j++) {
+            free_jobs.acquire();
+            std::unique_ptr<ExtractJob> job;
+            {
+                std::scoped_lock lock{pool_mutex};
+                if (!job_pool.empty()) {
+                    job = std::move(job_pool.back());
+                    job_pool.pop_back();
+                }
+            }
+            if (!job) {
+                job = std::make_unique<ExtractJob>();
+            }
+            job->seq = seq++;
+            job->file = i;
+            job->index = j;
+            ReadEncryptedBlock(file, node.loc + j, job->buffers);
+            workers.QueueWork([&, block = node.loc + j, job = std::move(job)]() mutable {
+                DecodeBlock(block, job->buffers, job->data);
+                {
+                    std::scoped_lock lock{decoded_mutex};
+                    decoded_jobs.emplace(job->seq, std::move(job));
+                }
+                decoded_cv.notify_one();
+            });
+        }
+    }
+    workers.WaitForRequests();
+
+    if (stop_token.stop_requested()) {
+        {
+            std::scoped_lock lock{decoded_mutex};
+            cancelled = true;
+        }
+        decoded_cv.notify_one();
+        return false;
+    }
+    writer.join();
+    report();
+    return true;
+}
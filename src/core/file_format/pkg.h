@@ -5,10 +5,14 @@
 
 #include <array>
 #include <filesystem>
+#include <functional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "common/endian.h"
+#include "common/io_file.h"
+#include "common/polyfill_thread.h"
 #include "core/crypto/crypto.h"
 #include "pfs.h"
 #include "trp.h"
@@ -103,11 +107,52 @@ public:
     PKG();
     ~PKG();
 
+    static constexpr u64 BlockSize = 0x10000;
+
+    /// Scratch memory used to decrypt a PFSC block, kept by the caller between reads.
+    struct BlockBuffers {
+        std::vector<u8> encrypted = std::vector<u8>(BlockSize + 0x1000);
+        std::vector<u8> decrypted = std::vector<u8>(BlockSize + 0x1000);
+    };
+
+    struct ExtractProgress {
+        u64 bytes_written;
+        u64 total_bytes;
+        u32 files_written;
+        u32 num_files;
+        double seconds; ///< Time elapsed since the extraction started
+    };
+    using ProgressCallback = std::function<void(const ExtractProgress&)>;
+
     bool Open(const std::filesystem::path& filepath);
     void ExtractFiles(const int index);
     bool Extract(const std::filesystem::path& filepath, const std::filesystem::path& extract,
                  std::string& failreason);
 
+    /// Reads the package and its file system tables like Extract, but only writes the sce_sys
+    /// entries to sys_dir. File contents are left in the image to be read with ReadBlock.
+    bool Mount(const std::filesystem::path& filepath, const std::filesystem::path& sys_dir,
+               std::string& failreason);
+
+    /// Decrypts and inflates one 64 KiB block of the PFSC image into out.
+    void ReadBlock(Common::FS::IOFile& file, u64 block, BlockBuffers& buffers,
+                   std::span<char> out);
+
+    /// Reads the encrypted sectors of a block into buffers, to be decoded with DecodeBlock.
+    void ReadEncryptedBlock(Common::FS::IOFile& file, u64 block, BlockBuffers& buffers) const;
+
+    /// Decrypts and inflates a block previously read with ReadEncryptedBlock into out. Safe to
+    /// call from multiple threads with different buffers.
+    void DecodeBlock(u64 block, BlockBuffers& buffers, std::span<char> out);
+
+    /// Writes the contents of every file to the paths set up by Extract. Blocks are read on the
+    /// calling thread, decoded on num_workers threads and written in order by a writer thread
+    /// that preallocates every output file. The callback is invoked from the writer thread when
+    /// a file completes or every few megabytes. Returns false if stopped or the package could
+    /// not be opened.
+    bool ExtractAllFiles(u32 num_workers, const ProgressCallback& callback = {},
+                         std::stop_token stop_token = {});
+
     std::vector<u8> sfo;
 
     u32 GetNumberOfFiles() {
@@ -130,6 +175,19 @@ public:
         return pkgheader;
     }
 
+    const std::vector<pfs_fs_table>& GetFsTable() const {
+        return fsTable;
+    }
+
+    const Inode& GetInode(u32 inode) const {
+        return iNodeBuf[inode];
+    }
+
+    /// Returns the host path every inode is extracted to.
+    const std::unordered_map<int, std::filesystem::path>& GetExtractPaths() const {
+        return extractPaths;
+    }
+
     static bool isFlagSet(u32_be variable, PKGContentFlag flag) {
         return (variable) & static_cast<u32>(flag);
     }
@@ -146,6 +204,19 @@ public:
          {PKGContentFlag::DELTA_PATCH, "DELTA_PATCH"},
          {PKGContentFlag::CUMULATIVE_PATCH, "CUMULATIVE_PATCH"}}};
 
+private:
+    bool ReadImage(const std::filesystem::path& filepath, const std::filesystem::path& extract,
+                   std::string& failreason, bool create_dirs);
+
+    struct BlockLocation {
+        u64 file_offset; ///< Offset of the first xts sector holding the block in the package
+        u64 read_size;   ///< Size of the xts sectors holding the block
+        u64 sector_size; ///< Size of the block in the image, smaller if it is compressed
+        u64 xts_sector;
+        u64 previous_data; ///< Offset of the block in the first xts sector
+    };
+    BlockLocation GetBlockLocation(u64 block) const;
+
 private:
     Crypto crypto;
     TRP trp;
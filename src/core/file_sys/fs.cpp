@@ -2,17 +2,51 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include <algorithm>
+#include "common/logging/log.h"
+#include "common/metrics.h"
 #include "common/string_util.h"
 #include "core/file_sys/fs.h"
+#include "core/file_sys/pkg_image.h"
 
 namespace Core::FileSys {
 
 constexpr int RESERVED_HANDLES = 3; // First 3 handles are stdin,stdout,stderr
 
+/// Entries kept by each path cache before it is dropped and refilled.
+constexpr size_t MaxCachedPaths = 16384;
+constexpr size_t MaxCachedDirs = 4096;
+
+static std::string CorrectPath(std::string_view guest_path) {
+    // Evil games like Turok2 pass double slashes e.g /app0//game.kpf
+    std::string corrected_path(guest_path);
+    size_t pos = corrected_path.find("//");
+    while (pos != std::string::npos) {
+        corrected_path.replace(pos, 2, "/");
+        pos = corrected_path.find("//", pos + 1);
+    }
+    return corrected_path;
+}
+
+/// Returns true if path is prefix itself or lies below it.
+static bool IsWithin(const std::filesystem::path::string_type& path,
+                     const std::filesystem::path::string_type& prefix) {
+    return path.starts_with(prefix) && (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
 void MntPoints::Mount(const std::filesystem::path& host_folder, const std::string& guest_folder,
                       bool read_only) {
     std::scoped_lock lock{m_mutex};
     m_mnt_pairs.emplace_back(host_folder, guest_folder, read_only);
+    path_cache.clear();
+    dir_cache.clear();
+}
+
+void MntPoints::Mount(std::shared_ptr<PkgImage> pkg, const std::string& guest_folder) {
+    std::scoped_lock lock{m_mutex};
+    const auto host_folder = pkg->GetSysDir();
+    m_mnt_pairs.emplace_back(host_folder, guest_folder, true, std::move(pkg));
+    path_cache.clear();
+    dir_cache.clear();
 }
 
 void MntPoints::Unmount(const std::filesystem::path& host_folder, const std::string& guest_folder) {
@@ -20,22 +54,19 @@ void MntPoints::Unmount(const std::filesystem::path& host_folder, const std::str
     auto it = std::remove_if(m_mnt_pairs.begin(), m_mnt_pairs.end(),
                              [&](const MntPair& pair) { return pair.mount == guest_folder; });
     m_mnt_pairs.erase(it, m_mnt_pairs.end());
+    path_cache.clear();
+    dir_cache.clear();
 }
 
 void MntPoints::UnmountAll() {
     std::scoped_lock lock{m_mutex};
     m_mnt_pairs.clear();
+    path_cache.clear();
+    dir_cache.clear();
 }
 
 std::filesystem::path MntPoints::GetHostPath(std::string_view guest_directory, bool* is_read_only) {
-    // Evil games like Turok2 pass double slashes e.g /app0//game.kpf
-    std::string corrected_path(guest_directory);
-    size_t pos = corrected_path.find("//");
-    while (pos != std::string::npos) {
-        corrected_path.replace(pos, 2, "/");
-        pos = corrected_path.find("//", pos + 1);
-    }
-
+    const auto corrected_path = CorrectPath(guest_directory);
     const MntPair* mount = GetMount(corrected_path);
     if (!mount) {
         return "";
@@ -51,108 +82,265 @@ std::filesystem::path MntPoints::GetHostPath(std::string_view guest_directory, b
     }
 
     // Remove device (e.g /app0) from path to retrieve relative path.
-    pos = mount->mount.size() + 1;
+    const size_t pos = mount->mount.size() + 1;
     const auto rel_path = std::string_view(corrected_path).substr(pos);
     const auto host_path = mount->host_path / rel_path;
     if (!NeedsCaseInsensitiveSearch) {
         return host_path;
     }
 
-    // If the path does not exist attempt to verify this.
-    // Retrieve parent path until we find one that exists.
+    static auto& num_resolutions = Common::Metrics::GetCounter("fs.path_resolutions");
+    static auto& num_cache_hits = Common::Metrics::GetCounter("fs.path_cache_hits");
+    num_resolutions.Add();
     std::scoped_lock lk{m_mutex};
-    path_parts.clear();
-    auto current_path = host_path;
-    while (!std::filesystem::exists(current_path)) {
-        // We have probably cached this if it's a folder.
-        if (auto it = path_cache.find(current_path); it != path_cache.end()) {
-            current_path = it->second;
-            break;
+    if (const auto it = path_cache.find(corrected_path); it != path_cache.end()) {
+        num_cache_hits.Add();
+        return it->second;
+    }
+
+    // Paths that don't exist resolve to the path as given, which at least gives a better error
+    // message than an empty path. They are cached as well, titles probe for missing files a lot.
+    auto resolved = ResolvePath(mount->host_path, rel_path).value_or(host_path);
+    if (path_cache.size() >= MaxCachedPaths) {
+        path_cache.clear();
+    }
+    path_cache.emplace(corrected_path, resolved);
+    return resolved;
+}
+
+void MntPoints::InvalidatePath(const std::filesystem::path& host_path) {
+    if (!NeedsCaseInsensitiveSearch) {
+        return;
+    }
+    std::scoped_lock lk{m_mutex};
+    const auto parent = host_path.parent_path().native();
+    dir_cache.erase(parent);
+
+    // The path may be a directory that was removed or renamed, drop the indices below it.
+    const auto& prefix = host_path.native();
+    for (auto it = dir_cache.begin(); it != dir_cache.end();) {
+        if (IsWithin(it->first, prefix)) {
+            it = dir_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Resolutions below the parent may now match a different entry, or one that was missing.
+    for (auto it = path_cache.begin(); it != path_cache.end();) {
+        if (IsWithin(it->second.native(), parent)) {
+            it = path_cache.erase(it);
+        } else {
+            ++it;
         }
-        path_parts.emplace_back(current_path.filename());
-        current_path = current_path.parent_path();
-    }
-
-    // We have found an anchor. Traverse parts we recoded and see if they
-    // exist in filesystem but in different case.
-    auto guest_path = current_path;
-    while (!path_parts.empty()) {
-        const auto part = path_parts.back();
-        const auto add_match = [&](const auto& host_part) {
-            current_path /= host_part;
-            guest_path /= part;
-            path_cache[guest_path] = current_path;
-            path_parts.pop_back();
-        };
-
-        // Can happen when the mismatch is in upper folder.
-        if (std::filesystem::exists(current_path / part)) {
-            add_match(part);
+    }
+}
+
+void MntPoints::LogPathStats() {
+    const u64 resolutions = Common::Metrics::GetCounter("fs.path_resolutions").Value();
+    const u64 cache_hits = Common::Metrics::GetCounter("fs.path_cache_hits").Value();
+    size_t num_dirs;
+    {
+        std::scoped_lock lk{m_mutex};
+        num_dirs = dir_cache.size();
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - creation_time).count();
+    LOG_INFO(Kernel_Fs,
+             "Path cache: {} resolutions ({:.1f}/s), {:.1f}% hit rate, {} indexed directories",
+             resolutions, resolutions / seconds,
+             100.0 * cache_hits / std::max<u64>(resolutions, 1), num_dirs);
+}
+
+const MntPoints::DirIndex* MntPoints::GetDirIndex(const std::filesystem::path& dir) {
+    if (const auto it = dir_cache.find(dir.native()); it != dir_cache.end()) {
+        return &it->second;
+    }
+    std::error_code ec;
+    std::filesystem::directory_iterator dir_it{dir, ec};
+    if (ec) {
+        return nullptr;
+    }
+    DirIndex index;
+    for (const auto& entry : dir_it) {
+        const auto name = entry.path().filename().string();
+        index.emplace(Common::ToLower(name), name);
+    }
+    if (dir_cache.size() >= MaxCachedDirs) {
+        // Only the index of the previous component is dropped, which the caller is done with.
+        dir_cache.clear();
+    }
+    return &dir_cache.emplace(dir.native(), std::move(index)).first->second;
+}
+
+std::optional<std::filesystem::path> MntPoints::ResolvePath(const std::filesystem::path& base,
+                                                            std::string_view rel_path) {
+    auto current_path = base;
+    while (!rel_path.empty()) {
+        const size_t slash = rel_path.find('/');
+        const auto part = rel_path.substr(0, slash);
+        rel_path = slash == std::string_view::npos ? std::string_view{}
+                                                   : rel_path.substr(slash + 1);
+        if (part.empty() || part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            current_path = current_path.parent_path();
             continue;
         }
-        const auto part_low = Common::ToLower(part.string());
-        bool found_match = false;
-        for (const auto& path : std::filesystem::directory_iterator(current_path)) {
-            const auto candidate = path.path().filename();
-            const auto filename = Common::ToLower(candidate.string());
-            // Check if a filename matches in case insensitive manner.
-            if (filename != part_low) {
-                continue;
+        const auto* index = GetDirIndex(current_path);
+        if (!index) {
+            return std::nullopt;
+        }
+        const auto it = index->find(Common::ToLower(part));
+        if (it == index->end()) {
+            if (rel_path.find_first_not_of('/') != std::string_view::npos) {
+                return std::nullopt;
             }
-            // We found a match, record the actual path in the cache.
-            add_match(candidate);
-            found_match = true;
+            current_path /= part;
             break;
         }
-        if (!found_match) {
-            // Opening the guest path will surely fail but at least gives
-            // a better error message than the empty path.
-            return host_path;
-        }
+        current_path /= it->second;
     }
-
-    // The path was found.
     return current_path;
 }
 
+std::optional<MntPoints::PkgNode> MntPoints::GetPkgNode(std::string_view guest_path) {
+    const auto corrected_path = CorrectPath(guest_path);
+    const MntPair* mount = GetMount(corrected_path);
+    if (!mount || !mount->pkg) {
+        return std::nullopt;
+    }
+    auto rel_path = std::string_view(corrected_path).substr(mount->mount.size());
+    while (rel_path.starts_with('/')) {
+        rel_path.remove_prefix(1);
+    }
+    while (rel_path.ends_with('/')) {
+        rel_path.remove_suffix(1);
+    }
+    const auto* node = mount->pkg->Find(rel_path);
+    if (!node) {
+        return std::nullopt;
+    }
+    return PkgNode{mount->pkg.get(), node->inode, node->is_dir};
+}
+
+std::filesystem::path MntPoints::GetHostFile(std::string_view guest_path) {
+    if (const auto node = GetPkgNode(guest_path); node && !node->is_dir) {
+        return node->image->Extract(node->inode);
+    }
+    return GetHostPath(guest_path);
+}
+
+HandleTable::HandleTable() : m_slots{std::make_unique<Slot[]>(MaxHandles)} {}
+
+HandleTable::~HandleTable() = default;
+
+int HandleTable::MakeDescriptor(u32 index, u32 generation) {
+    return static_cast<int>((generation << IndexBits) | index) + RESERVED_HANDLES;
+}
+
+HandleTable::Slot* HandleTable::FindSlot(int d, u32& generation) {
+    if (d < RESERVED_HANDLES) {
+        return nullptr;
+    }
+    const u32 value = d - RESERVED_HANDLES;
+    const u32 index = value & ((1U << IndexBits) - 1);
+    generation = value >> IndexBits;
+    if (index >= MaxHandles || generation > GenerationMask) {
+        return nullptr;
+    }
+    return &m_slots[index];
+}
+
 int HandleTable::CreateHandle() {
-    std::scoped_lock lock{m_mutex};
+    u32 index = InvalidSlot;
+    u64 head = m_free_head.load(std::memory_order_acquire);
+    while (static_cast<u32>(head) != InvalidSlot) {
+        const u32 next = m_slots[static_cast<u32>(head)].next_free.load(std::memory_order_relaxed);
+        const u64 new_head = (((head >> 32) + 1) << 32) | next;
+        if (m_free_head.compare_exchange_weak(head, new_head, std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+            index = static_cast<u32>(head);
+            break;
+        }
+    }
+    if (index == InvalidSlot) {
+        index = m_num_used_slots.fetch_add(1, std::memory_order_relaxed);
+        if (index >= MaxHandles) {
+            m_num_used_slots.fetch_sub(1, std::memory_order_relaxed);
+            return -1;
+        }
+    }
 
-    auto* file = new File{};
+    auto file = std::make_shared<File>();
     file->is_directory = false;
     file->is_opened = false;
+    auto& slot = m_slots[index];
+    std::scoped_lock lock{slot.mutex};
+    slot.file = std::move(file);
+    return MakeDescriptor(index, slot.generation);
+}
 
-    int existingFilesNum = m_files.size();
-
-    for (int index = 0; index < existingFilesNum; index++) {
-        if (m_files.at(index) == nullptr) {
-            m_files[index] = file;
-            return index + RESERVED_HANDLES;
+void HandleTable::DeleteHandle(int d) {
+    u32 generation;
+    auto* slot = FindSlot(d, generation);
+    if (slot == nullptr) {
+        return;
+    }
+    std::shared_ptr<File> file;
+    {
+        std::scoped_lock lock{slot->mutex};
+        if (slot->generation != generation || slot->file == nullptr) {
+            return;
+        }
+        file = std::move(slot->file);
+        slot->generation = (slot->generation + 1) & GenerationMask;
+    }
+    {
+        std::scoped_lock lock{m_path_mutex};
+        auto [begin, end] = m_path_index.equal_range(file->m_host_name.native());
+        const auto it = std::find_if(begin, end, [d](const auto& entry) {
+            return entry.second == d;
+        });
+        if (it != end) {
+            m_path_index.erase(it);
         }
     }
 
-    m_files.push_back(file);
-    return m_files.size() + RESERVED_HANDLES - 1;
+    const u32 index = static_cast<u32>(slot - m_slots.get());
+    u64 head = m_free_head.load(std::memory_order_relaxed);
+    u64 new_head;
+    do {
+        slot->next_free.store(static_cast<u32>(head), std::memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | index;
+    } while (!m_free_head.compare_exchange_weak(head, new_head, std::memory_order_release,
+                                                std::memory_order_relaxed));
 }
 
-void HandleTable::DeleteHandle(int d) {
-    std::scoped_lock lock{m_mutex};
-    delete m_files.at(d - RESERVED_HANDLES);
-    m_files[d - RESERVED_HANDLES] = nullptr;
+std::shared_ptr<File> HandleTable::GetFile(int d) {
+    u32 generation;
+    auto* slot = FindSlot(d, generation);
+    if (slot == nullptr) {
+        return nullptr;
+    }
+    std::scoped_lock lock{slot->mutex};
+    return slot->generation == generation ? slot->file : nullptr;
 }
 
-File* HandleTable::GetFile(int d) {
-    std::scoped_lock lock{m_mutex};
-    return m_files.at(d - RESERVED_HANDLES);
+std::shared_ptr<File> HandleTable::GetFile(const std::filesystem::path& host_name) {
+    std::scoped_lock lock{m_path_mutex};
+    const auto it = m_path_index.find(host_name.native());
+    return it == m_path_index.end() ? nullptr : GetFile(it->second);
 }
 
-File* HandleTable::GetFile(const std::filesystem::path& host_name) {
-    for (auto* file : m_files) {
-        if (file != nullptr && file->m_host_name == host_name) {
-            return file;
-        }
+void HandleTable::SetHostName(int d, const std::filesystem::path& host_name) {
+    const auto file = GetFile(d);
+    if (file == nullptr) {
+        return;
     }
-    return nullptr;
+    std::scoped_lock lock{m_path_mutex};
+    file->m_host_name = host_name;
+    m_path_index.emplace(host_name.native(), d);
 }
 
 } // namespace Core::FileSys
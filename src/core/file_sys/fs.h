@@ -4,14 +4,23 @@
 #pragma once
 
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <tsl/robin_map.h>
+#include "common/futex.h"
 #include "common/io_file.h"
 
 namespace Core::FileSys {
 
+class PkgImage;
+
 class MntPoints {
 #ifdef _WIN64
     static constexpr bool NeedsCaseInsensitiveSearch = false;
@@ -23,6 +32,13 @@ public:
         std::filesystem::path host_path;
         std::string mount; // e.g /app0/
         bool read_only;
+        std::shared_ptr<PkgImage> pkg; ///< Package serving the files of the mount, if any.
+    };
+
+    struct PkgNode {
+        PkgImage* image;
+        u32 inode;
+        bool is_dir;
     };
 
     explicit MntPoints() = default;
@@ -30,12 +46,28 @@ public:
 
     void Mount(const std::filesystem::path& host_folder, const std::string& guest_folder,
                bool read_only = false);
+    /// Mounts the file system image of a package. Paths that are not part of the image are
+    /// looked up in the directory the package unpacks its sce_sys entries and executables to.
+    void Mount(std::shared_ptr<PkgImage> pkg, const std::string& guest_folder);
     void Unmount(const std::filesystem::path& host_folder, const std::string& guest_folder);
     void UnmountAll();
 
     std::filesystem::path GetHostPath(std::string_view guest_directory,
                                       bool* is_read_only = nullptr);
 
+    /// Drops cached resolutions after the guest created, removed or renamed host_path.
+    void InvalidatePath(const std::filesystem::path& host_path);
+
+    /// Logs the resolution rate and hit rate of the path cache.
+    void LogPathStats();
+
+    /// Looks up a guest path in the image of a package mount.
+    std::optional<PkgNode> GetPkgNode(std::string_view guest_path);
+
+    /// Like GetHostPath, but unpacks files read from a package image first so that the path can
+    /// be handed to host libraries.
+    std::filesystem::path GetHostFile(std::string_view guest_path);
+
     const MntPair* GetMount(const std::string& guest_path) {
         std::scoped_lock lock{m_mutex};
         const auto it = std::ranges::find_if(
@@ -43,10 +75,24 @@ public:
         return it == m_mnt_pairs.end() ? nullptr : &*it;
     }
 
+private:
+    /// Lower case name to actual name of every entry of a host directory.
+    using DirIndex = tsl::robin_map<std::string, std::string>;
+
+    /// Returns the index of a host directory, listing it on first use, or null if the directory
+    /// does not exist.
+    const DirIndex* GetDirIndex(const std::filesystem::path& dir);
+
+    /// Matches every component of rel_path against the entries of its parent ignoring case. A
+    /// missing last component is kept as is so that new files can be created.
+    std::optional<std::filesystem::path> ResolvePath(const std::filesystem::path& base,
+                                                     std::string_view rel_path);
+
 private:
     std::vector<MntPair> m_mnt_pairs;
-    std::vector<std::filesystem::path> path_parts;
-    tsl::robin_map<std::filesystem::path, std::filesystem::path> path_cache;
+    tsl::robin_map<std::string, std::filesystem::path> path_cache; ///< Guest to host paths
+    tsl::robin_map<std::filesystem::path::string_type, DirIndex> dir_cache;
+    std::chrono::steady_clock::time_point creation_time = std::chrono::steady_clock::now();
     std::mutex m_mutex;
 };
 
@@ -58,27 +104,66 @@ struct DirEntry {
 struct File {
     std::atomic_bool is_opened{};
     std::atomic_bool is_directory{};
-    std::filesystem::path m_host_name;
+    std::filesystem::path m_host_name; ///< Set under the path mutex while the file is opened
     std::string m_guest_name;
     Common::FS::IOFile f;
     std::vector<DirEntry> dirents;
     u32 dirents_index;
     std::mutex m_mutex;
+    PkgImage* pkg_image{}; ///< Set when the file is read from a mounted package
+    u32 pkg_inode{};
+    u64 pkg_offset{};
 };
 
+/**
+ * Table of open guest file descriptors. Lookups by descriptor only lock the slot they read, and
+ * free slots are kept on a lock-free list so that opening a file takes constant time. Files are
+ * handed out by shared ownership, so closing a descriptor while another thread still uses its
+ * file only drops the reference of the table.
+ */
 class HandleTable {
 public:
-    HandleTable() = default;
-    virtual ~HandleTable() = default;
+    static constexpr size_t MaxHandles = 4096;
+
+    HandleTable();
+    virtual ~HandleTable();
 
+    /// Returns a descriptor for a new file, or -1 if all descriptors are in use.
     int CreateHandle();
     void DeleteHandle(int d);
-    File* GetFile(int d);
-    File* GetFile(const std::filesystem::path& host_name);
+    std::shared_ptr<File> GetFile(int d);
+    std::shared_ptr<File> GetFile(const std::filesystem::path& host_name);
+
+    /// Sets the host path of a file and indexes it for lookups by path.
+    void SetHostName(int d, const std::filesystem::path& host_name);
 
 private:
-    std::vector<File*> m_files;
-    std::mutex m_mutex;
+    struct Slot {
+        Common::FutexMutex mutex;
+        std::shared_ptr<File> file;   ///< Guarded by mutex
+        u32 generation{};             ///< Guarded by mutex, bumped whenever the slot is freed
+        std::atomic<u32> next_free{}; ///< Following slot on the free list
+    };
+
+    /// Descriptors hold the slot index in their low bits and the generation of the slot above
+    /// it, so that a descriptor that was closed is rejected after its slot is reused. Only a few
+    /// generation bits are used, as some titles store descriptors in 16-bit variables.
+    static constexpr u32 IndexBits = std::bit_width(MaxHandles - 1);
+    static constexpr u32 GenerationMask = 0x3;
+    static constexpr u32 InvalidSlot = std::numeric_limits<u32>::max();
+
+    static int MakeDescriptor(u32 index, u32 generation);
+    /// Returns the slot a descriptor refers to, or nullptr if it is out of range.
+    Slot* FindSlot(int d, u32& generation);
+
+    std::unique_ptr<Slot[]> m_slots;
+    /// Index of the first free slot in the lower half, and a counter in the upper half that is
+    /// bumped by every update so that a slot popped and pushed back meanwhile fails the CAS.
+    std::atomic<u64> m_free_head{InvalidSlot};
+    std::atomic<u32> m_num_used_slots{}; ///< Slots that were handed out at least once
+
+    std::mutex m_path_mutex;
+    std::unordered_multimap<std::filesystem::path::string_type, int> m_path_index;
 };
 
 } // namespace Core::FileSys
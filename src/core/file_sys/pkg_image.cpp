@@ -0,0 +1,272 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "common/div_ceil.h"
+#include "common/logging/log.h"
+#include "common/metrics.h"
+#include "common/path_util.h"
+#include "common/string_util.h"
+#include "core/file_sys/pkg_image.h"
+
+namespace Core::FileSys {
+
+namespace {
+
+constexpr u64 BlockSize = PKG::BlockSize;
+constexpr size_t MaxCachedBlocks = 128_MB / BlockSize;
+constexpr u64 ReadAheadBlocks = 8;
+
+/// Returns the lower case path of an extracted inode relative to the image root.
+std::string GetRelativePath(const std::filesystem::path& path, const std::filesystem::path& root) {
+    // Directory paths may end in . or .. components, see PKG::Extract.
+    auto relative = path.lexically_normal().lexically_relative(root).generic_string();
+    while (relative.ends_with('/') || relative.ends_with("/.")) {
+        relative.resize(relative.rfind('/'));
+    }
+    if (relative == ".") {
+        relative.clear();
+    }
+    return Common::ToLower(relative);
+}
+
+bool IsExecutable(std::string_view path) {
+    return path == "eboot.bin" || path.ends_with(".prx") || path.ends_with(".sprx");
+}
+
+} // Anonymous namespace
+
+PkgImage::PkgImage() = default;
+
+PkgImage::~PkgImage() = default;
+
+bool PkgImage::Open(const std::filesystem::path& path) {
+    pkg_path = path;
+    if (!pkg.Open(pkg_path)) {
+        LOG_ERROR(Loader, "Unable to open package {}", pkg_path.string());
+        return false;
+    }
+    sys_dir = Common::FS::GetUserPath(Common::FS::PathType::PkgCacheDir) / pkg.GetTitleID();
+    std::filesystem::create_directories(sys_dir);
+
+    std::string failreason;
+    if (!pkg.Mount(pkg_path, sys_dir, failreason)) {
+        LOG_ERROR(Loader, "Unable to mount package {}: {}", pkg_path.string(), failreason);
+        return false;
+    }
+
+    const auto& fs_table = pkg.GetFsTable();
+    const auto& paths = pkg.GetExtractPaths();
+    std::vector<std::string> relative_paths(fs_table.size());
+    for (size_t i = 0; i < fs_table.size(); i++) {
+        const auto& entry = fs_table[i];
+        if (entry.type != PFS_FILE && entry.type != PFS_DIR && entry.type != PFS_CURRENT_DIR) {
+            continue;
+        }
+        const auto relative = GetRelativePath(paths.at(entry.inode), sys_dir);
+        if (relative == ".." || relative.starts_with("../")) {
+            continue;
+        }
+        nodes.try_emplace(relative, Node{entry.inode, entry.type != PFS_FILE});
+        if (entry.type != PFS_CURRENT_DIR) {
+            relative_paths[i] = relative;
+        }
+    }
+
+    for (size_t i = 0; i < fs_table.size(); i++) {
+        const auto& relative = relative_paths[i];
+        if (relative.empty()) {
+            continue;
+        }
+        const auto& entry = fs_table[i];
+        const auto slash = relative.rfind('/');
+        const auto parent = slash == std::string::npos ? std::string{} : relative.substr(0, slash);
+        if (const auto it = nodes.find(parent); it != nodes.end()) {
+            dir_entries[it->second.inode].push_back({entry.name, entry.type == PFS_FILE});
+        }
+
+        // Executables are loaded from host paths, unpack them unless a previous boot did.
+        if (entry.type == PFS_FILE && IsExecutable(relative)) {
+            const auto& host_path = paths.at(entry.inode);
+            std::error_code ec;
+            if (std::filesystem::file_size(host_path, ec) != GetSize(entry.inode)) {
+                std::filesystem::create_directories(host_path.parent_path());
+                pkg.ExtractFiles(static_cast<int>(i));
+            }
+        }
+    }
+
+    read_ahead_worker = std::make_unique<ReadAheadWorker>(1, "PkgReadAhead",
+                                                          [this] { return MakeScratch(); });
+    LOG_INFO(Loader, "Mounted package {} with {} files and directories", pkg_path.string(),
+             nodes.size());
+    return true;
+}
+
+const PkgImage::Node* PkgImage::Find(std::string_view path) const {
+    const auto it = nodes.find(Common::ToLower(path));
+    return it == nodes.end() ? nullptr : &it->second;
+}
+
+u64 PkgImage::GetSize(u32 inode) const {
+    return pkg.GetInode(inode).Size;
+}
+
+std::vector<DirEntry> PkgImage::GetDirEntries(u32 inode) const {
+    const auto it = dir_entries.find(inode);
+    return it == dir_entries.end() ? std::vector<DirEntry>{} : it->second;
+}
+
+size_t PkgImage::Read(u32 inode, u64 offset, void* data, size_t size) {
+    const auto& node = pkg.GetInode(inode);
+    const u64 file_size = node.Size;
+    if (offset >= file_size) {
+        return 0;
+    }
+    size = std::min<u64>(size, file_size - offset);
+    const u64 end = offset + size;
+
+    bool is_sequential{};
+    {
+        std::scoped_lock lk{cache_mutex};
+        auto [it, is_new] = next_offset.try_emplace(inode, end);
+        is_sequential = !is_new && it->second == offset;
+        it.value() = end;
+    }
+
+    auto* dst = static_cast<u8*>(data);
+    for (u64 pos = offset; pos < end;) {
+        const u64 block_offset = pos % BlockSize;
+        const size_t copy_size = std::min(BlockSize - block_offset, end - pos);
+        CopyBlock(node.loc + pos / BlockSize, block_offset, dst, copy_size);
+        dst += copy_size;
+        pos += copy_size;
+    }
+
+    if (is_sequential) {
+        QueueReadAhead(node.loc + Common::DivCeil(end, BlockSize), node.loc + node.Blocks);
+    }
+    return size;
+}
+
+std::filesystem::path PkgImage::Extract(u32 inode) {
+    const auto& host_path = pkg.GetExtractPaths().at(inode);
+    const u64 size = GetSize(inode);
+    std::scoped_lock lk{extract_mutex};
+    std::error_code ec;
+    if (std::filesystem::file_size(host_path, ec) == size) {
+        return host_path;
+    }
+    std::filesystem::create_directories(host_path.parent_path(), ec);
+    Common::FS::IOFile out(host_path, Common::FS::FileAccessMode::Write);
+    if (!out.IsOpen()) {
+        LOG_ERROR(Loader, "Unable to unpack {}", host_path.string());
+        return {};
+    }
+    std::vector<u8> buffer(BlockSize);
+    for (u64 offset = 0; offset < size;) {
+        const size_t read = Read(inode, offset, buffer.data(), buffer.size());
+        if (read == 0 || out.WriteRaw<u8>(buffer.data(), read) != read) {
+            LOG_ERROR(Loader, "Unable to unpack {}", host_path.string());
+            return {};
+        }
+        offset += read;
+    }
+    return host_path;
+}
+
+void PkgImage::LogStats() const {
+    const u64 hits = Common::Metrics::GetCounter("pkg.block_hits").Value();
+    const u64 misses = Common::Metrics::GetCounter("pkg.block_misses").Value();
+    const u64 fetch_ns = Common::Metrics::GetHistogram("pkg.block_fetch_ns").Read().sum;
+    const u64 num_reads = std::max<u64>(hits + misses, 1);
+    LOG_INFO(Loader, "PKG block cache: {} hits, {} misses ({:.1f}% hit rate), {:.1f} ms fetching",
+             hits, misses, 100.0 * hits / num_reads, fetch_ns / 1e6);
+}
+
+std::unique_ptr<PkgImage::Scratch> PkgImage::MakeScratch() const {
+    auto scratch = std::make_unique<Scratch>();
+    scratch->file.Open(pkg_path, Common::FS::FileAccessMode::Read);
+    return scratch;
+}
+
+void PkgImage::CopyBlock(u64 block, u64 offset, u8* data, size_t size) {
+    static auto& num_hits = Common::Metrics::GetCounter("pkg.block_hits");
+    static auto& num_misses = Common::Metrics::GetCounter("pkg.block_misses");
+    {
+        std::unique_lock lk{cache_mutex};
+        block_cv.wait(lk, [&] { return !pending_blocks.contains(block); });
+        if (const auto it = cached_blocks.find(block); it != cached_blocks.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            std::memcpy(data, it->second->data.get() + offset, size);
+            num_hits.Add();
+            return;
+        }
+        // Make concurrent readers of the block wait for this fetch.
+        pending_blocks.insert(block);
+    }
+    num_misses.Add();
+
+    std::unique_ptr<Scratch> scratch;
+    {
+        std::scoped_lock lk{scratch_mutex};
+        if (!scratch_pool.empty()) {
+            scratch = std::move(scratch_pool.back());
+            scratch_pool.pop_back();
+        }
+    }
+    if (!scratch) {
+        scratch = MakeScratch();
+    }
+    FetchBlock(block, *scratch);
+    std::memcpy(data, scratch->block.data() + offset, size);
+
+    std::scoped_lock lk{scratch_mutex};
+    scratch_pool.push_back(std::move(scratch));
+}
+
+void PkgImage::FetchBlock(u64 block, Scratch& scratch) {
+    static auto& fetch_ns = Common::Metrics::GetHistogram("pkg.block_fetch_ns");
+    const auto start = std::chrono::steady_clock::now();
+    pkg.ReadBlock(scratch.file, block, scratch.buffers, scratch.block);
+    fetch_ns.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+
+    std::scoped_lock lk{cache_mutex};
+    pending_blocks.erase(block);
+    block_cv.notify_all();
+    if (cached_blocks.contains(block)) {
+        return;
+    }
+    std::unique_ptr<char[]> data;
+    if (lru.size() >= MaxCachedBlocks) {
+        // Reuse the memory of the least recently used block.
+        auto& victim = lru.back();
+        cached_blocks.erase(victim.block);
+        data = std::move(victim.data);
+        lru.pop_back();
+    } else {
+        data = std::make_unique<char[]>(BlockSize);
+    }
+    std::memcpy(data.get(), scratch.block.data(), BlockSize);
+    lru.push_front({block, std::move(data)});
+    cached_blocks.emplace(block, lru.begin());
+}
+
+void PkgImage::QueueReadAhead(u64 block, u64 end_block) {
+    end_block = std::min(end_block, block + ReadAheadBlocks);
+    std::scoped_lock lk{cache_mutex};
+    for (; block < end_block; block++) {
+        if (cached_blocks.contains(block) || !pending_blocks.insert(block).second) {
+            continue;
+        }
+        read_ahead_worker->QueueWork(
+            [this, block](std::unique_ptr<Scratch>* scratch) { FetchBlock(block, **scratch); });
+    }
+}
+
+} // namespace Core::FileSys
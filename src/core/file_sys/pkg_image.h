@@ -0,0 +1,116 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
+
+#include "common/io_file.h"
+#include "common/thread_worker.h"
+#include "common/types.h"
+#include "core/file_format/pkg.h"
+#include "core/file_sys/fs.h"
+
+namespace Core::FileSys {
+
+/**
+ * Read-only view of the file system image of a PKG. File contents are decrypted and inflated
+ * on demand one 64 KiB block at a time, and recently used blocks are kept in a bounded LRU
+ * cache. Sequential reads prefetch the following blocks on a worker thread.
+ */
+class PkgImage {
+public:
+    struct Node {
+        u32 inode;
+        bool is_dir;
+    };
+
+    explicit PkgImage();
+    ~PkgImage();
+
+    /// Parses the package and unpacks its sce_sys entries and executables to a per-title cache
+    /// directory, as those are accessed through host paths. Returns false on failure.
+    bool Open(const std::filesystem::path& path);
+
+    /// Looks up a path relative to the image root, ignoring case.
+    [[nodiscard]] const Node* Find(std::string_view path) const;
+
+    [[nodiscard]] u64 GetSize(u32 inode) const;
+
+    [[nodiscard]] std::vector<DirEntry> GetDirEntries(u32 inode) const;
+
+    /// Reads up to size bytes of a file starting at offset and returns the amount read.
+    size_t Read(u32 inode, u64 offset, void* data, size_t size);
+
+    /// Unpacks a file to its path in the directory of the package unless a previous call did,
+    /// for host code that needs a file rather than a stream. Returns an empty path on failure.
+    std::filesystem::path Extract(u32 inode);
+
+    /// Logs the block cache hit rate and the time spent fetching blocks.
+    void LogStats() const;
+
+    /// Returns the directory holding the unpacked files of the package.
+    [[nodiscard]] const std::filesystem::path& GetSysDir() const {
+        return sys_dir;
+    }
+
+private:
+    /// Memory needed to fetch a block, owned by one thread at a time.
+    struct Scratch {
+        Common::FS::IOFile file;
+        PKG::BlockBuffers buffers;
+        std::vector<char> block = std::vector<char>(PKG::BlockSize);
+    };
+
+    struct CachedBlock {
+        u64 block;
+        std::unique_ptr<char[]> data;
+    };
+    using LruList = std::list<CachedBlock>;
+
+    std::unique_ptr<Scratch> MakeScratch() const;
+
+    /// Copies part of a block to data, fetching it if it isn't cached. Waits for a read ahead of
+    /// the block that is in flight instead of fetching it twice.
+    void CopyBlock(u64 block, u64 offset, u8* data, size_t size);
+
+    /// Reads a block from the image and inserts it in the cache.
+    void FetchBlock(u64 block, Scratch& scratch);
+
+    void QueueReadAhead(u64 block, u64 end_block);
+
+private:
+    PKG pkg;
+    std::filesystem::path pkg_path;
+    std::filesystem::path sys_dir;
+    tsl::robin_map<std::string, Node> nodes;
+    tsl::robin_map<u32, std::vector<DirEntry>> dir_entries;
+
+    std::mutex scratch_mutex;
+    std::vector<std::unique_ptr<Scratch>> scratch_pool;
+
+    std::mutex cache_mutex;
+    LruList lru; ///< Cached blocks, most recently used first
+    tsl::robin_map<u64, LruList::iterator> cached_blocks;
+    tsl::robin_set<u64> pending_blocks;   ///< Blocks being fetched, signaled by block_cv
+    std::condition_variable block_cv;
+    tsl::robin_map<u32, u64> next_offset; ///< Offset following the last read of every file
+
+    std::mutex extract_mutex;
+
+    // Declared last so that running prefetches finish before the cache is destroyed.
+    using ReadAheadWorker = Common::StatefulThreadWorker<std::unique_ptr<Scratch>>;
+    std::unique_ptr<ReadAheadWorker> read_ahead_worker;
+};
+
+} // namespace Core::FileSys
@@ -60,7 +60,7 @@ bool AvPlayerSource::Init(const SceAvPlayerInitData& init_data, std::string_view
         }
     } else {
         const auto mnt = Common::Singleton<Core::FileSys::MntPoints>::Instance();
-        const auto filepath = mnt->GetHostPath(path);
+        const auto filepath = mnt->GetHostFile(path);
         if (AVPLAYER_IS_ERROR(
                 avformat_open_input(&context, filepath.string().c_str(), nullptr, nullptr))) {
             return false;
@@ -0,0 +1,422 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <tsl/robin_map.h>
+
+#include "common/logging/log.h"
+#include "common/polyfill_thread.h"
+#include "common/singleton.h"
+#include "common/thread.h"
+#include "core/cpu_topology.h"
+#include "core/libraries/error_codes.h"
+#include "core/libraries/kernel/aio.h"
+#include "core/libraries/kernel/file_system.h"
+#include "core/libraries/libs.h"
+
+namespace Libraries::Kernel {
+
+namespace {
+
+constexpr size_t NumAioWorkers = 4;
+
+bool IsFinished(s32 state) {
+    return state == ORBIS_KERNEL_AIO_STATE_COMPLETED || state == ORBIS_KERNEL_AIO_STATE_ABORTED;
+}
+
+/**
+ * Executes guest read and write commands on a pool of host threads. Pending submissions are
+ * picked by priority and then in submission order. Each submission runs its commands in
+ * sequence on one worker, with positional I/O so that workers don't contend on file locks.
+ */
+class AioEngine {
+    struct Submission {
+        OrbisKernelAioSubmitId id;
+        s32 priority;
+        bool is_write;
+        std::vector<OrbisKernelAioRWRequest> requests;
+        s32 state = ORBIS_KERNEL_AIO_STATE_SUBMITTED;
+    };
+    using SubmissionPtr = std::shared_ptr<Submission>;
+
+    /// Orders pending submissions with the highest priority first, then by id.
+    using QueueKey = std::pair<s32, OrbisKernelAioSubmitId>;
+
+public:
+    AioEngine() {
+        for (size_t i = 0; i < NumAioWorkers; i++) {
+            workers.emplace_back([this](std::stop_token stop_token) { WorkerLoop(stop_token); });
+        }
+    }
+
+    ~AioEngine() {
+        for (auto& worker : workers) {
+            worker.request_stop();
+        }
+        work_cv.notify_all();
+    }
+
+    /// Queues the commands as one submission, or one submission per command if split is set.
+    /// All submissions are queued at once before any worker is woken up.
+    void Submit(std::span<const OrbisKernelAioRWRequest> requests, s32 priority, bool is_write,
+                bool split, OrbisKernelAioSubmitId* ids) {
+        const auto queue = [&](std::span<const OrbisKernelAioRWRequest> commands) {
+            auto submission = std::make_shared<Submission>();
+            submission->id = next_id++;
+            submission->priority = priority;
+            submission->is_write = is_write;
+            submission->requests.assign(commands.begin(), commands.end());
+            for (const auto& request : commands) {
+                if (request.result) {
+                    request.result->state = ORBIS_KERNEL_AIO_STATE_SUBMITTED;
+                }
+            }
+            pending.emplace(QueueKey{-priority, submission->id}, submission);
+            submissions.emplace(submission->id, submission);
+            return submission->id;
+        };
+        {
+            std::scoped_lock lock{mutex};
+            if (split) {
+                for (size_t i = 0; i < requests.size(); i++) {
+                    ids[i] = queue(requests.subspan(i, 1));
+                }
+            } else {
+                ids[0] = queue(requests);
+            }
+        }
+        work_cv.notify_all();
+    }
+
+    s32 Poll(std::span<const OrbisKernelAioSubmitId> ids, s32* states) {
+        std::scoped_lock lock{mutex};
+        for (size_t i = 0; i < ids.size(); i++) {
+            const auto it = submissions.find(ids[i]);
+            if (it == submissions.end()) {
+                return ORBIS_KERNEL_ERROR_ESRCH;
+            }
+            states[i] = it->second->state;
+        }
+        return ORBIS_OK;
+    }
+
+    s32 Wait(std::span<const OrbisKernelAioSubmitId> ids, s32* states, bool wait_all, u32* usec) {
+        std::unique_lock lock{mutex};
+        for (const auto id : ids) {
+            if (!submissions.contains(id)) {
+                return ORBIS_KERNEL_ERROR_ESRCH;
+            }
+        }
+        const auto is_finished = [this](OrbisKernelAioSubmitId id) {
+            // Submissions deleted by another thread while waiting are done as well.
+            const auto it = submissions.find(id);
+            return it == submissions.end() || IsFinished(it->second->state);
+        };
+        const auto pred = [&] {
+            return wait_all ? std::ranges::all_of(ids, is_finished)
+                            : std::ranges::any_of(ids, is_finished);
+        };
+
+        bool done = true;
+        if (usec) {
+            const auto start = std::chrono::steady_clock::now();
+            done = done_cv.wait_for(lock, std::chrono::microseconds(*usec), pred);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+            *usec = done && elapsed < *usec ? *usec - static_cast<u32>(elapsed) : 0;
+        } else {
+            done_cv.wait(lock, pred);
+        }
+
+        if (states) {
+            for (size_t i = 0; i < ids.size(); i++) {
+                const auto it = submissions.find(ids[i]);
+                states[i] = it == submissions.end() ? ORBIS_KERNEL_AIO_STATE_COMPLETED
+                                                    : it->second->state;
+            }
+        }
+        return done ? ORBIS_OK : ORBIS_KERNEL_ERROR_ETIMEDOUT;
+    }
+
+    s32 Cancel(OrbisKernelAioSubmitId id, s32* state) {
+        std::unique_lock lock{mutex};
+        const auto it = submissions.find(id);
+        if (it == submissions.end()) {
+            return ORBIS_KERNEL_ERROR_ESRCH;
+        }
+        const auto submission = it->second;
+        if (submission->state == ORBIS_KERNEL_AIO_STATE_SUBMITTED) {
+            // Only commands that didn't start yet can be aborted.
+            pending.erase(QueueKey{-submission->priority, id});
+            submission->state = ORBIS_KERNEL_AIO_STATE_ABORTED;
+            for (const auto& request : submission->requests) {
+                if (request.result) {
+                    request.result->state = ORBIS_KERNEL_AIO_STATE_ABORTED;
+                }
+            }
+            done_cv.notify_all();
+        }
+        if (state) {
+            *state = submission->state;
+        }
+        return ORBIS_OK;
+    }
+
+    s32 Delete(OrbisKernelAioSubmitId id, s32* ret) {
+        if (const s32 result = Cancel(id, nullptr); result != ORBIS_OK) {
+            return result;
+        }
+        std::scoped_lock lock{mutex};
+        const auto it = submissions.find(id);
+        if (it == submissions.end()) {
+            return ORBIS_KERNEL_ERROR_ESRCH;
+        }
+        if (!IsFinished(it->second->state)) {
+            return ORBIS_KERNEL_ERROR_EBUSY;
+        }
+        submissions.erase(it);
+        if (ret) {
+            *ret = ORBIS_OK;
+        }
+        return ORBIS_OK;
+    }
+
+private:
+    void WorkerLoop(std::stop_token stop_token) {
+        Common::SetCurrentThreadName("Kernel_AioWorker");
+        Core::PinServiceThread();
+        while (!stop_token.stop_requested()) {
+            SubmissionPtr submission;
+            {
+                std::unique_lock lock{mutex};
+                Common::CondvarWait(work_cv, lock, stop_token, [this] { return !pending.empty(); });
+                if (stop_token.stop_requested()) {
+                    break;
+                }
+                submission = std::move(pending.begin()->second);
+                pending.erase(pending.begin());
+                submission->state = ORBIS_KERNEL_AIO_STATE_PROCESSING;
+            }
+            Execute(*submission);
+            // Completion reaches guests through polls and waits only. None of the exported
+            // entry points attaches an event queue to a submission, so no Aio event is raised.
+            {
+                std::scoped_lock lock{mutex};
+                submission->state = ORBIS_KERNEL_AIO_STATE_COMPLETED;
+            }
+            done_cv.notify_all();
+        }
+    }
+
+    void Execute(const Submission& submission) {
+        for (const auto& request : submission.requests) {
+            if (request.result) {
+                request.result->state = ORBIS_KERNEL_AIO_STATE_PROCESSING;
+            }
+            const s64 result =
+                submission.is_write
+                    ? sceKernelPwrite(request.fd, request.buf, request.nbyte, request.offset)
+                    : sceKernelPread(request.fd, request.buf, request.nbyte, request.offset);
+            if (request.result) {
+                request.result->returnValue = result;
+                request.result->state = ORBIS_KERNEL_AIO_STATE_COMPLETED;
+            }
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable_any work_cv;
+    std::condition_variable done_cv;
+    std::map<QueueKey, SubmissionPtr> pending;
+    tsl::robin_map<OrbisKernelAioSubmitId, SubmissionPtr> submissions;
+    OrbisKernelAioSubmitId next_id = 1;
+    std::vector<std::jthread> workers;
+};
+
+AioEngine* GetEngine() {
+    return Common::Singleton<AioEngine>::Instance();
+}
+
+bool IsValidPriority(s32 priority) {
+    return priority >= ORBIS_KERNEL_AIO_PRIORITY_LOW && priority <= ORBIS_KERNEL_AIO_PRIORITY_HIGH;
+}
+
+s32 SubmitCommands(const OrbisKernelAioRWRequest req[], s32 size, s32 priority,
+                   OrbisKernelAioSubmitId* id, bool is_write, bool split) {
+    if (req == nullptr || id == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    if (size <= 0 || !IsValidPriority(priority)) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    GetEngine()->Submit({req, static_cast<size_t>(size)}, priority, is_write, split, id);
+    return ORBIS_OK;
+}
+
+} // Anonymous namespace
+
+s32 PS4_SYSV_ABI sceKernelAioInitializeImpl(void* p, s32 size) {
+    LOG_INFO(Kernel_Fs, "called size = {}", size);
+    return ORBIS_OK;
+}
+
+s32 PS4_SYSV_ABI sceKernelAioInitializeParam(OrbisKernelAioParam* param) {
+    if (param == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    static constexpr OrbisKernelAioSchedulingParam Default = {
+        .schedulingWindowSize = 0x20,
+        .delayedCountLimit = 0x20,
+        .enableSplit = 1,
+        .splitSize = 0x100000,
+        .splitChunkSize = 0x100000,
+    };
+    param->low = Default;
+    param->mid = Default;
+    param->high = Default;
+    return ORBIS_OK;
+}
+
+s32 PS4_SYSV_ABI sceKernelAioSetParam(OrbisKernelAioSchedulingParam* param, s32 priority) {
+    // Host I/O is not split or delayed, scheduling only honors priorities.
+    LOG_DEBUG(Kernel_Fs, "(STUBBED) called priority = {}", priority);
+    return ORBIS_OK;
+}
+
+s32 PS4_SYSV_ABI sceKernelAioSubmitReadCommands(const OrbisKernelAioRWRequest req[], s32 size,
+                                                s32 priority, OrbisKernelAioSubmitId* id) {
+    return SubmitCommands(req, size, priority, id, false, false);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioSubmitReadCommandsMultiple(const OrbisKernelAioRWRequest req[],
+                                                        s32 size, s32 priority,
+                                                        OrbisKernelAioSubmitId id[]) {
+    return SubmitCommands(req, size, priority, id, false, true);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioSubmitWriteCommands(const OrbisKernelAioRWRequest req[], s32 size,
+                                                 s32 priority, OrbisKernelAioSubmitId* id) {
+    return SubmitCommands(req, size, priority, id, true, false);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioSubmitWriteCommandsMultiple(const OrbisKernelAioRWRequest req[],
+                                                         s32 size, s32 priority,
+                                                         OrbisKernelAioSubmitId id[]) {
+    return SubmitCommands(req, size, priority, id, true, true);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioPollRequest(OrbisKernelAioSubmitId id, s32* state) {
+    if (state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    return GetEngine()->Poll({&id, 1}, state);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioPollRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                          s32 state[]) {
+    if (id == nullptr || state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    if (num <= 0) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    return GetEngine()->Poll({id, static_cast<size_t>(num)}, state);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioWaitRequest(OrbisKernelAioSubmitId id, s32* state, u32* usec) {
+    if (state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    return GetEngine()->Wait({&id, 1}, state, true, usec);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioWaitRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                          s32 state[], u32 mode, u32* usec) {
+    if (id == nullptr || state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    if (num <= 0 || (mode != ORBIS_KERNEL_AIO_WAIT_AND && mode != ORBIS_KERNEL_AIO_WAIT_OR)) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    return GetEngine()->Wait({id, static_cast<size_t>(num)}, state,
+                             mode == ORBIS_KERNEL_AIO_WAIT_AND, usec);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioCancelRequest(OrbisKernelAioSubmitId id, s32* state) {
+    if (state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    return GetEngine()->Cancel(id, state);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioCancelRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                            s32 state[]) {
+    if (id == nullptr || state == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    if (num <= 0) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    for (s32 i = 0; i < num; i++) {
+        if (const s32 result = GetEngine()->Cancel(id[i], &state[i]); result != ORBIS_OK) {
+            return result;
+        }
+    }
+    return ORBIS_OK;
+}
+
+s32 PS4_SYSV_ABI sceKernelAioDeleteRequest(OrbisKernelAioSubmitId id, s32* ret) {
+    if (ret == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    return GetEngine()->Delete(id, ret);
+}
+
+s32 PS4_SYSV_ABI sceKernelAioDeleteRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                            s32 ret[]) {
+    if (id == nullptr || ret == nullptr) {
+        return ORBIS_KERNEL_ERROR_EFAULT;
+    }
+    if (num <= 0) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    for (s32 i = 0; i < num; i++) {
+        if (const s32 result = GetEngine()->Delete(id[i], &ret[i]); result != ORBIS_OK) {
+            return result;
+        }
+    }
+    return ORBIS_OK;
+}
+
+void RegisterAio(Core::Loader::SymbolsResolver* sym) {
+    LIB_FUNCTION("fR521KIGgb8", "libkernel", 1, "libkernel", 1, 1, sceKernelAioCancelRequest);
+    LIB_FUNCTION("3Lca1XBrQdY", "libkernel", 1, "libkernel", 1, 1, sceKernelAioCancelRequests);
+    LIB_FUNCTION("5TgME6AYty4", "libkernel", 1, "libkernel", 1, 1, sceKernelAioDeleteRequest);
+    LIB_FUNCTION("Ft3EtsZzAoY", "libkernel", 1, "libkernel", 1, 1, sceKernelAioDeleteRequests);
+    LIB_FUNCTION("vYU8P9Td2Zo", "libkernel", 1, "libkernel", 1, 1, sceKernelAioInitializeImpl);
+    LIB_FUNCTION("nu4a0-arQis", "libkernel", 1, "libkernel", 1, 1, sceKernelAioInitializeParam);
+    LIB_FUNCTION("2pOuoWoCxdk", "libkernel", 1, "libkernel", 1, 1, sceKernelAioPollRequest);
+    LIB_FUNCTION("o7O4z3jwKzo", "libkernel", 1, "libkernel", 1, 1, sceKernelAioPollRequests);
+    LIB_FUNCTION("9WK-vhNXimw", "libkernel", 1, "libkernel", 1, 1, sceKernelAioSetParam);
+    LIB_FUNCTION("HgX7+AORI58", "libkernel", 1, "libkernel", 1, 1,
+                 sceKernelAioSubmitReadCommands);
+    LIB_FUNCTION("lXT0m3P-vs4", "libkernel", 1, "libkernel", 1, 1,
+                 sceKernelAioSubmitReadCommandsMultiple);
+    LIB_FUNCTION("XQ8C8y+de+E", "libkernel", 1, "libkernel", 1, 1,
+                 sceKernelAioSubmitWriteCommands);
+    LIB_FUNCTION("xT3Cpz0yh6Y", "libkernel", 1, "libkernel", 1, 1,
+                 sceKernelAioSubmitWriteCommandsMultiple);
+    LIB_FUNCTION("KOF-oJbQVvc", "libkernel", 1, "libkernel", 1, 1, sceKernelAioWaitRequest);
+    LIB_FUNCTION("lgK+oIWkJyA", "libkernel", 1, "libkernel", 1, 1, sceKernelAioWaitRequests);
+}
+
+} // namespace Libraries::Kernel
@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "common/types.h"
+
+namespace Core::Loader {
+class SymbolsResolver;
+}
+
+namespace Libraries::Kernel {
+
+constexpr s32 ORBIS_KERNEL_AIO_STATE_SUBMITTED = 1;
+constexpr s32 ORBIS_KERNEL_AIO_STATE_PROCESSING = 2;
+constexpr s32 ORBIS_KERNEL_AIO_STATE_COMPLETED = 3;
+constexpr s32 ORBIS_KERNEL_AIO_STATE_ABORTED = 4;
+
+constexpr s32 ORBIS_KERNEL_AIO_PRIORITY_LOW = 1;
+constexpr s32 ORBIS_KERNEL_AIO_PRIORITY_MID = 2;
+constexpr s32 ORBIS_KERNEL_AIO_PRIORITY_HIGH = 3;
+
+constexpr u32 ORBIS_KERNEL_AIO_WAIT_AND = 0x01;
+constexpr u32 ORBIS_KERNEL_AIO_WAIT_OR = 0x02;
+
+using OrbisKernelAioSubmitId = s32;
+
+struct OrbisKernelAioResult {
+    s64 returnValue;
+    u32 state;
+};
+
+struct OrbisKernelAioRWRequest {
+    s64 offset;
+    s64 nbyte;
+    void* buf;
+    OrbisKernelAioResult* result;
+    s32 fd;
+};
+
+struct OrbisKernelAioSchedulingParam {
+    s32 schedulingWindowSize;
+    s32 delayedCountLimit;
+    u32 enableSplit;
+    u32 splitSize;
+    u32 splitChunkSize;
+};
+
+struct OrbisKernelAioParam {
+    OrbisKernelAioSchedulingParam low;
+    OrbisKernelAioSchedulingParam mid;
+    OrbisKernelAioSchedulingParam high;
+};
+
+s32 PS4_SYSV_ABI sceKernelAioInitializeImpl(void* p, s32 size);
+s32 PS4_SYSV_ABI sceKernelAioInitializeParam(OrbisKernelAioParam* param);
+s32 PS4_SYSV_ABI sceKernelAioSetParam(OrbisKernelAioSchedulingParam* param, s32 priority);
+
+s32 PS4_SYSV_ABI sceKernelAioSubmitReadCommands(const OrbisKernelAioRWRequest req[], s32 size,
+                                                s32 priority, OrbisKernelAioSubmitId* id);
+s32 PS4_SYSV_ABI sceKernelAioSubmitReadCommandsMultiple(const OrbisKernelAioRWRequest req[],
+                                                        s32 size, s32 priority,
+                                                        OrbisKernelAioSubmitId id[]);
+s32 PS4_SYSV_ABI sceKernelAioSubmitWriteCommands(const OrbisKernelAioRWRequest req[], s32 size,
+                                                 s32 priority, OrbisKernelAioSubmitId* id);
+s32 PS4_SYSV_ABI sceKernelAioSubmitWriteCommandsMultiple(const OrbisKernelAioRWRequest req[],
+                                                         s32 size, s32 priority,
+                                                         OrbisKernelAioSubmitId id[]);
+
+s32 PS4_SYSV_ABI sceKernelAioPollRequest(OrbisKernelAioSubmitId id, s32* state);
+s32 PS4_SYSV_ABI sceKernelAioPollRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                          s32 state[]);
+s32 PS4_SYSV_ABI sceKernelAioWaitRequest(OrbisKernelAioSubmitId id, s32* state, u32* usec);
+s32 PS4_SYSV_ABI sceKernelAioWaitRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                          s32 state[], u32 mode, u32* usec);
+s32 PS4_SYSV_ABI sceKernelAioCancelRequest(OrbisKernelAioSubmitId id, s32* state);
+s32 PS4_SYSV_ABI sceKernelAioCancelRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                            s32 state[]);
+s32 PS4_SYSV_ABI sceKernelAioDeleteRequest(OrbisKernelAioSubmitId id, s32* ret);
+s32 PS4_SYSV_ABI sceKernelAioDeleteRequests(const OrbisKernelAioSubmitId id[], s32 num,
+                                            s32 ret[]);
+
+void RegisterAio(Core::Loader::SymbolsResolver* sym);
+
+} // namespace Libraries::Kernel
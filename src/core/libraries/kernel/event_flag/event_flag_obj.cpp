@@ -1,6 +1,8 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
+#include <mutex>
 #include <thread>
 
 #include "core/libraries/error_codes.h"
@@ -22,7 +24,7 @@ int EventFlagInternal::Wait(u64 bits, WaitMode wait_mode, ClearMode clear_mode,
         return ORBIS_KERNEL_ERROR_EPERM;
     }
 
-    auto const start = std::chrono::system_clock::now();
+    auto const start = std::chrono::steady_clock::now();
     m_waiting_threads++;
     auto waitFunc = [this, wait_mode, bits] {
         return (m_status == Status::Canceled || m_status == Status::Deleted ||
@@ -31,9 +33,9 @@ int EventFlagInternal::Wait(u64 bits, WaitMode wait_mode, ClearMode clear_mode,
     };
 
     if (infinitely) {
-        m_cond_var.wait(lock, waitFunc);
+        m_cond_var.Wait(lock, waitFunc);
     } else {
-        if (!m_cond_var.wait_for(lock, std::chrono::microseconds(micros), waitFunc)) {
+        if (!m_cond_var.WaitFor(lock, std::chrono::microseconds(micros), waitFunc)) {
             if (result != nullptr) {
                 *result = m_bits;
             }
@@ -48,7 +50,7 @@ int EventFlagInternal::Wait(u64 bits, WaitMode wait_mode, ClearMode clear_mode,
     }
 
     auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                       std::chrono::system_clock::now() - start)
+                       std::chrono::steady_clock::now() - start)
                        .count();
     if (result != nullptr) {
         *result = m_bits;
@@ -94,7 +96,7 @@ void EventFlagInternal::Set(u64 bits) {
 
     m_bits |= bits;
 
-    m_cond_var.notify_all();
+    m_cond_var.NotifyAll();
 }
 
 void EventFlagInternal::Clear(u64 bits) {
@@ -3,9 +3,9 @@
 
 #pragma once
 
-#include <condition_variable>
-#include <mutex>
+#include <string>
 
+#include "common/futex.h"
 #include "common/types.h"
 
 namespace Libraries::Kernel {
@@ -32,8 +32,8 @@ public:
 private:
     enum class Status { Set, Canceled, Deleted };
 
-    std::mutex m_mutex;
-    std::condition_variable m_cond_var;
+    Common::FutexMutex m_mutex;
+    Common::FutexCondvar m_cond_var;
     Status m_status = Status::Set;
     int m_waiting_threads = 0;
     std::string m_name;
@@ -3,9 +3,9 @@
 
 #include "common/assert.h"
 #include "common/logging/log.h"
-#include "common/scope_exit.h"
 #include "common/singleton.h"
 #include "core/file_sys/fs.h"
+#include "core/file_sys/pkg_image.h"
 #include "core/libraries/error_codes.h"
 #include "core/libraries/kernel/file_system.h"
 #include "core/libraries/libs.h"
@@ -56,12 +56,33 @@ int PS4_SYSV_ABI sceKernelOpen(const char* path, int flags, u16 mode) {
     if (std::string_view{path} == "/dev/urandom") {
         return 2003;
     }
-    u32 handle = h->CreateHandle();
-    auto* file = h->GetFile(handle);
-    if (directory) {
+    const int handle = h->CreateHandle();
+    if (handle < 0) {
+        return ORBIS_KERNEL_ERROR_EMFILE;
+    }
+    auto file = h->GetFile(handle);
+    if (const auto node = mnt->GetPkgNode(path)) {
+        // Served from the image of a mounted package.
+        if (!read || create || truncate) {
+            h->DeleteHandle(handle);
+            return ORBIS_KERNEL_ERROR_EROFS;
+        }
+        if (directory && !node->is_dir) {
+            h->DeleteHandle(handle);
+            return ORBIS_KERNEL_ERROR_ENOTDIR;
+        }
+        file->is_directory = node->is_dir;
+        file->m_guest_name = path;
+        file->pkg_image = node->image;
+        file->pkg_inode = node->inode;
+        if (node->is_dir) {
+            file->dirents = node->image->GetDirEntries(node->inode);
+            file->dirents_index = 0;
+        }
+    } else if (directory) {
         file->is_directory = true;
         file->m_guest_name = path;
-        file->m_host_name = mnt->GetHostPath(file->m_guest_name);
+        h->SetHostName(handle, mnt->GetHostPath(file->m_guest_name));
         if (!std::filesystem::is_directory(file->m_host_name)) { // directory doesn't exist
             h->DeleteHandle(handle);
             return ORBIS_KERNEL_ERROR_ENOTDIR;
@@ -75,7 +96,7 @@ int PS4_SYSV_ABI sceKernelOpen(const char* path, int flags, u16 mode) {
         }
     } else {
         file->m_guest_name = path;
-        file->m_host_name = mnt->GetHostPath(file->m_guest_name);
+        h->SetHostName(handle, mnt->GetHostPath(file->m_guest_name));
         int e = 0;
         if (read) {
             e = file->f.Open(file->m_host_name, Common::FS::FileAccessMode::Read);
@@ -98,6 +119,10 @@ int PS4_SYSV_ABI sceKernelOpen(const char* path, int flags, u16 mode) {
             h->DeleteHandle(handle);
             return ErrnoToSceKernelError(e);
         }
+        if (!read) {
+            // The file may have been created.
+            mnt->InvalidatePath(file->m_host_name);
+        }
     }
     file->is_opened = true;
     return handle;
@@ -131,13 +156,11 @@ int PS4_SYSV_ABI sceKernelClose(int d) {
         return SCE_OK;
     }
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
     if (file == nullptr) {
         return SCE_KERNEL_ERROR_EBADF;
     }
-    if (!file->is_directory) {
-        file->f.Close();
-    }
+    // The host file is closed with the last reference, which may be held by a concurrent access.
     file->is_opened = false;
     LOG_INFO(Kernel_Fs, "Closing {}", file->m_guest_name);
     h->DeleteHandle(d);
@@ -164,11 +187,15 @@ size_t PS4_SYSV_ABI sceKernelWrite(int d, const void* buf, size_t nbytes) {
         return nbytes;
     }
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
     if (file == nullptr) {
         return SCE_KERNEL_ERROR_EBADF;
     }
 
+    if (file->pkg_image) {
+        return SCE_KERNEL_ERROR_EBADF;
+    }
+
     std::scoped_lock lk{file->m_mutex};
     return file->f.WriteRaw<u8>(buf, nbytes);
 }
@@ -195,29 +222,66 @@ int PS4_SYSV_ABI sceKernelUnlink(const char* path) {
         return SCE_KERNEL_ERROR_EPERM;
     }
 
-    auto* file = h->GetFile(host_path);
+    auto file = h->GetFile(host_path);
     if (file != nullptr) {
         file->f.Unlink();
     }
+    mnt->InvalidatePath(host_path);
 
     LOG_INFO(Kernel_Fs, "Unlinked {}", path);
     return SCE_OK;
 }
 
+static_assert(sizeof(SceKernelIovec) == sizeof(Common::FS::IOFile::IoVec));
+
+static std::span<const Common::FS::IOFile::IoVec> ToIoVecs(const SceKernelIovec* iov, int iovcnt) {
+    return {reinterpret_cast<const Common::FS::IOFile::IoVec*>(iov), static_cast<size_t>(iovcnt)};
+}
+
+/// Positional host accesses leave the stream offset alone and need no locking, except on Windows
+/// where they briefly move the file pointer of the handle shared with the stream.
+static std::unique_lock<std::mutex> LockPositionalAccess(Core::FileSys::File* file) {
+#ifdef _WIN32
+    return std::unique_lock{file->m_mutex};
+#else
+    return {};
+#endif
+}
+
+/// Reads into every buffer of iov in turn from a file of a mounted package.
+static size_t ReadPkgv(Core::FileSys::File* file, const SceKernelIovec* iov, int iovcnt,
+                       u64 offset) {
+    size_t total_read = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        const size_t read = file->pkg_image->Read(file->pkg_inode, offset + total_read,
+                                                  iov[i].iov_base, iov[i].iov_len);
+        total_read += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total_read;
+}
+
 size_t PS4_SYSV_ABI _readv(int d, const SceKernelIovec* iov, int iovcnt) {
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
-    size_t total_read = 0;
+    auto file = h->GetFile(d);
     std::scoped_lock lk{file->m_mutex};
-    for (int i = 0; i < iovcnt; i++) {
-        total_read += file->f.ReadRaw<u8>(iov[i].iov_base, iov[i].iov_len);
+    if (file->pkg_image) {
+        const size_t total_read = ReadPkgv(file.get(), iov, iovcnt, file->pkg_offset);
+        file->pkg_offset += total_read;
+        return total_read;
     }
+    // Read all buffers with a single call and advance the stream past them.
+    const s64 pos = file->f.Tell();
+    const size_t total_read = file->f.ReadvAt(ToIoVecs(iov, iovcnt), pos);
+    file->f.Seek(pos + total_read);
     return total_read;
 }
 
 s64 PS4_SYSV_ABI sceKernelLseek(int d, s64 offset, int whence) {
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
 
     Common::FS::SeekOrigin origin{};
     if (whence == 0) {
@@ -229,6 +293,16 @@ s64 PS4_SYSV_ABI sceKernelLseek(int d, s64 offset, int whence) {
     }
 
     std::scoped_lock lk{file->m_mutex};
+    if (file->pkg_image) {
+        const s64 base = whence == 1   ? s64(file->pkg_offset)
+                         : whence == 2 ? s64(file->pkg_image->GetSize(file->pkg_inode))
+                                       : 0;
+        if (base + offset < 0) {
+            return ORBIS_KERNEL_ERROR_EINVAL;
+        }
+        file->pkg_offset = base + offset;
+        return file->pkg_offset;
+    }
     file->f.Seek(offset, origin);
     return file->f.Tell();
 }
@@ -252,12 +326,18 @@ s64 PS4_SYSV_ABI sceKernelRead(int d, void* buf, size_t nbytes) {
         return nbytes;
     }
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
     if (file == nullptr) {
         return SCE_KERNEL_ERROR_EBADF;
     }
 
     std::scoped_lock lk{file->m_mutex};
+    if (file->pkg_image) {
+        const size_t read =
+            file->pkg_image->Read(file->pkg_inode, file->pkg_offset, buf, nbytes);
+        file->pkg_offset += read;
+        return read;
+    }
     return file->f.ReadRaw<u8>(buf, nbytes);
 }
 
@@ -293,6 +373,7 @@ int PS4_SYSV_ABI sceKernelMkdir(const char* path, u16 mode) {
     if (dir_name.empty() || !std::filesystem::create_directory(dir_name)) {
         return SCE_KERNEL_ERROR_EIO;
     }
+    mnt->InvalidatePath(dir_name);
 
     if (!std::filesystem::exists(dir_name)) {
         return SCE_KERNEL_ERROR_ENOENT;
@@ -313,9 +394,16 @@ int PS4_SYSV_ABI posix_mkdir(const char* path, u16 mode) {
 int PS4_SYSV_ABI sceKernelStat(const char* path, OrbisKernelStat* sb) {
     LOG_INFO(Kernel_Fs, "(PARTIAL) path = {}", path);
     auto* mnt = Common::Singleton<Core::FileSys::MntPoints>::Instance();
+    std::memset(sb, 0, sizeof(OrbisKernelStat));
+    if (const auto node = mnt->GetPkgNode(path)) {
+        sb->st_mode = (node->is_dir ? 0040000u : 0100000u) | 0000222u;
+        sb->st_size = node->is_dir ? 0 : node->image->GetSize(node->inode);
+        sb->st_blksize = 512;
+        sb->st_blocks = (sb->st_size + 511) / 512;
+        return ORBIS_OK;
+    }
     bool ro = false;
     const auto path_name = mnt->GetHostPath(path, &ro);
-    std::memset(sb, 0, sizeof(OrbisKernelStat));
     const bool is_dir = std::filesystem::is_directory(path_name);
     const bool is_file = std::filesystem::is_regular_file(path_name);
     if (!is_dir && !is_file) {
@@ -353,6 +441,9 @@ int PS4_SYSV_ABI posix_stat(const char* path, OrbisKernelStat* sb) {
 
 int PS4_SYSV_ABI sceKernelCheckReachability(const char* path) {
     auto* mnt = Common::Singleton<Core::FileSys::MntPoints>::Instance();
+    if (mnt->GetPkgNode(path)) {
+        return ORBIS_OK;
+    }
     const auto path_name = mnt->GetHostPath(path);
     if (!std::filesystem::exists(path_name)) {
         return SCE_KERNEL_ERROR_ENOENT;
@@ -369,18 +460,37 @@ s64 PS4_SYSV_ABI sceKernelPread(int d, void* buf, size_t nbytes, s64 offset) {
     }
 
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
     if (file == nullptr) {
         return ORBIS_KERNEL_ERROR_EBADF;
     }
 
-    std::scoped_lock lk{file->m_mutex};
-    const s64 pos = file->f.Tell();
-    SCOPE_EXIT {
-        file->f.Seek(pos);
-    };
-    file->f.Seek(offset);
-    return file->f.ReadRaw<u8>(buf, nbytes);
+    if (file->pkg_image) {
+        return file->pkg_image->Read(file->pkg_inode, offset, buf, nbytes);
+    }
+    const auto lock = LockPositionalAccess(file.get());
+    return file->f.ReadAt(buf, nbytes, offset);
+}
+
+s64 PS4_SYSV_ABI sceKernelPreadv(int d, const SceKernelIovec* iov, int iovcnt, s64 offset) {
+    if (d < 3) {
+        return ORBIS_KERNEL_ERROR_EPERM;
+    }
+    if (offset < 0 || iovcnt < 0) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+
+    auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
+    auto file = h->GetFile(d);
+    if (file == nullptr) {
+        return ORBIS_KERNEL_ERROR_EBADF;
+    }
+
+    if (file->pkg_image) {
+        return ReadPkgv(file.get(), iov, iovcnt, offset);
+    }
+    const auto lock = LockPositionalAccess(file.get());
+    return file->f.ReadvAt(ToIoVecs(iov, iovcnt), offset);
 }
 
 int PS4_SYSV_ABI sceKernelFStat(int fd, OrbisKernelStat* sb) {
@@ -392,7 +502,7 @@ int PS4_SYSV_ABI sceKernelFStat(int fd, OrbisKernelStat* sb) {
         return ORBIS_KERNEL_ERROR_EFAULT;
     }
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(fd);
+    auto file = h->GetFile(fd);
     if (file == nullptr) {
         return ORBIS_KERNEL_ERROR_EBADF;
     }
@@ -406,7 +516,8 @@ int PS4_SYSV_ABI sceKernelFStat(int fd, OrbisKernelStat* sb) {
         // TODO incomplete
     } else {
         sb->st_mode = 0000777u | 0100000u;
-        sb->st_size = file->f.GetSize();
+        sb->st_size = file->pkg_image ? file->pkg_image->GetSize(file->pkg_inode)
+                                      : file->f.GetSize();
         sb->st_blksize = 512;
         sb->st_blocks = (sb->st_size + 511) / 512;
         // TODO incomplete
@@ -426,14 +537,14 @@ int PS4_SYSV_ABI posix_fstat(int fd, OrbisKernelStat* sb) {
 
 s32 PS4_SYSV_ABI sceKernelFsync(int fd) {
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(fd);
+    auto file = h->GetFile(fd);
     file->f.Flush();
     return ORBIS_OK;
 }
 
 int PS4_SYSV_ABI sceKernelFtruncate(int fd, s64 length) {
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(fd);
+    auto file = h->GetFile(fd);
 
     if (file == nullptr) {
         return SCE_KERNEL_ERROR_EBADF;
@@ -456,7 +567,7 @@ static int GetDents(int fd, char* buf, int nbytes, s64* basep) {
         return ORBIS_KERNEL_ERROR_EFAULT;
     }
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(fd);
+    auto file = h->GetFile(fd);
     if (file == nullptr) {
         return ORBIS_KERNEL_ERROR_EBADF;
     }
@@ -503,18 +614,37 @@ s64 PS4_SYSV_ABI sceKernelPwrite(int d, void* buf, size_t nbytes, s64 offset) {
     }
 
     auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
-    auto* file = h->GetFile(d);
+    auto file = h->GetFile(d);
     if (file == nullptr) {
         return ORBIS_KERNEL_ERROR_EBADF;
     }
 
-    std::scoped_lock lk{file->m_mutex};
-    const s64 pos = file->f.Tell();
-    SCOPE_EXIT {
-        file->f.Seek(pos);
-    };
-    file->f.Seek(offset);
-    return file->f.WriteRaw<u8>(buf, nbytes);
+    if (file->pkg_image) {
+        return ORBIS_KERNEL_ERROR_EBADF;
+    }
+    const auto lock = LockPositionalAccess(file.get());
+    return file->f.WriteAt(buf, nbytes, offset);
+}
+
+s64 PS4_SYSV_ABI sceKernelPwritev(int d, const SceKernelIovec* iov, int iovcnt, s64 offset) {
+    if (d < 3) {
+        return ORBIS_KERNEL_ERROR_EPERM;
+    }
+    if (offset < 0 || iovcnt < 0) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+
+    auto* h = Common::Singleton<Core::FileSys::HandleTable>::Instance();
+    auto file = h->GetFile(d);
+    if (file == nullptr) {
+        return ORBIS_KERNEL_ERROR_EBADF;
+    }
+
+    if (file->pkg_image) {
+        return ORBIS_KERNEL_ERROR_EBADF;
+    }
+    const auto lock = LockPositionalAccess(file.get());
+    return file->f.WritevAt(ToIoVecs(iov, iovcnt), offset);
 }
 
 s32 PS4_SYSV_ABI sceKernelRename(const char* from, const char* to) {
@@ -543,6 +673,7 @@ s32 PS4_SYSV_ABI sceKernelRename(const char* from, const char* to) {
         return ORBIS_KERNEL_ERROR_ENOTEMPTY;
     }
     std::filesystem::copy(src_path, dst_path, std::filesystem::copy_options::overwrite_existing);
+    mnt->InvalidatePath(dst_path);
     return ORBIS_OK;
 }
 
@@ -572,11 +703,13 @@ void fileSystemSymbolsRegister(Core::Loader::SymbolsResolver* sym) {
 
     LIB_FUNCTION("E6ao34wPw+U", "libScePosix", 1, "libkernel", 1, 1, posix_stat);
     LIB_FUNCTION("+r3rMFwItV4", "libkernel", 1, "libkernel", 1, 1, sceKernelPread);
+    LIB_FUNCTION("yTj62I7kw4s", "libkernel", 1, "libkernel", 1, 1, sceKernelPreadv);
     LIB_FUNCTION("uWyW3v98sU4", "libkernel", 1, "libkernel", 1, 1, sceKernelCheckReachability);
     LIB_FUNCTION("fTx66l5iWIA", "libkernel", 1, "libkernel", 1, 1, sceKernelFsync);
     LIB_FUNCTION("j2AIqSqJP0w", "libkernel", 1, "libkernel", 1, 1, sceKernelGetdents);
     LIB_FUNCTION("taRWhTJFTgE", "libkernel", 1, "libkernel", 1, 1, sceKernelGetdirentries);
     LIB_FUNCTION("nKWi-N2HBV4", "libkernel", 1, "libkernel", 1, 1, sceKernelPwrite);
+    LIB_FUNCTION("mBd4AfLP+u8", "libkernel", 1, "libkernel", 1, 1, sceKernelPwritev);
     LIB_FUNCTION("AUXVxWeJU-A", "libkernel", 1, "libkernel", 1, 1, sceKernelUnlink);
 
     // openOrbis (to check if it is valid out of OpenOrbis
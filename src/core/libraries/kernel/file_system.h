@@ -69,6 +69,8 @@ int PS4_SYSV_ABI sceKernelOpen(const char* path, int flags, /* SceKernelMode*/ u
 
 int PS4_SYSV_ABI posix_open(const char* path, int flags, /* SceKernelMode*/ u16 mode);
 s64 PS4_SYSV_ABI lseek(int d, s64 offset, int whence);
+s64 PS4_SYSV_ABI sceKernelPread(int d, void* buf, size_t nbytes, s64 offset);
+s64 PS4_SYSV_ABI sceKernelPwrite(int d, void* buf, size_t nbytes, s64 offset);
 
 void fileSystemSymbolsRegister(Core::Loader::SymbolsResolver* sym);
 
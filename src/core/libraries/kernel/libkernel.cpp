@@ -13,9 +13,11 @@
 #include "common/polyfill_thread.h"
 #include "common/singleton.h"
 #include "common/thread.h"
+#include "core/cpu_topology.h"
 #include "core/file_format/psf.h"
 #include "core/file_sys/fs.h"
 #include "core/libraries/error_codes.h"
+#include "core/libraries/kernel/aio.h"
 #include "core/libraries/kernel/cpu_management.h"
 #include "core/libraries/kernel/event_flag/event_flag.h"
 #include "core/libraries/kernel/event_queues.h"
@@ -57,6 +59,7 @@ void KernelSignalRequest() {
 
 static void KernelServiceThread(std::stop_token stoken) {
     Common::SetCurrentThreadName("Kernel_ServiceThread");
+    Core::PinServiceThread();
 
     while (!stoken.stop_requested()) {
         HLE_TRACE;
@@ -169,7 +172,23 @@ int PS4_SYSV_ABI sceKernelMmap(void* addr, u64 len, int prot, int flags, int fd,
         return memory->MapMemory(res, std::bit_cast<VAddr>(addr), len, mem_prot, mem_flags,
                                  Core::VMAType::Flexible);
     } else {
-        const uintptr_t handle = h->GetFile(fd)->f.GetFileMapping();
+        const auto file = h->GetFile(fd);
+        if (file == nullptr) {
+            return ORBIS_KERNEL_ERROR_EBADF;
+        }
+        std::scoped_lock lk{file->m_mutex};
+        if (file->pkg_image && !file->f.IsOpen()) {
+            // Files of a package image have no host file to map, unpack them first.
+            const auto host_path = file->pkg_image->Extract(file->pkg_inode);
+            if (host_path.empty() ||
+                file->f.Open(host_path, Common::FS::FileAccessMode::Read) != 0) {
+                return ORBIS_KERNEL_ERROR_EIO;
+            }
+        }
+        if (!file->f.IsOpen()) {
+            return ORBIS_KERNEL_ERROR_EBADF;
+        }
+        const uintptr_t handle = file->f.GetFileMapping();
         return memory->MapFile(res, std::bit_cast<VAddr>(addr), len, mem_prot, mem_flags, handle,
                                offset);
     }
@@ -476,6 +495,7 @@ void LibKernel_Register(Core::Loader::SymbolsResolver* sym) {
     Libraries::Kernel::timeSymbolsRegister(sym);
     Libraries::Kernel::pthreadSymbolsRegister(sym);
     Libraries::Kernel::RegisterKernelEventFlag(sym);
+    Libraries::Kernel::RegisterAio(sym);
 
     // temp
     LIB_FUNCTION("NWtTN10cJzE", "libSceLibcInternalExt", 1, "libSceLibcInternal", 1, 1,
@@ -1,19 +1,24 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
 #include <mutex>
 #include <semaphore>
 #include <thread>
+#include <utility>
 
 #include "common/alignment.h"
 #include "common/assert.h"
+#include "common/config.h"
 #include "common/error.h"
 #include "common/logging/log.h"
 #include "common/singleton.h"
 #include "common/thread.h"
+#include "core/cpu_topology.h"
 #include "core/libraries/error_codes.h"
 #include "core/libraries/kernel/libkernel.h"
 #include "core/libraries/kernel/thread_management.h"
+#include "core/libraries/kernel/time_management.h"
 #include "core/libraries/kernel/threads/threads.h"
 #include "core/libraries/libs.h"
 #include "core/linker.h"
@@ -23,12 +28,79 @@
 #else
 #include <sys/mman.h>
 #endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace Libraries::Kernel {
 
 thread_local ScePthread g_pthread_self{};
 PThreadCxt* g_pthread_cxt = nullptr;
 
+/// Guest priorities range from 256 (highest) to 767 (lowest), 700 being the default.
+constexpr int HighPriorityThreshold = 478;
+constexpr int LowPriorityThreshold = 733;
+
+/// Restricts a host thread to the host CPUs backing the guest cores in guest_mask.
+static void ApplyHostAffinity(pthread_t pth, u64 guest_mask) {
+    const u64 host_mask = Core::GetHostCpuMask(guest_mask);
+    if (host_mask == 0) {
+        return;
+    }
+#ifdef _WIN64
+    SetThreadAffinityMask(pthread_gethandle(pth), static_cast<DWORD_PTR>(host_mask));
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (u32 cpu = 0; cpu < 64; cpu++) {
+        if (host_mask & (1ULL << cpu)) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    if (int result = pthread_setaffinity_np(pth, sizeof(cpu_set), &cpu_set); result != 0) {
+        LOG_WARNING(Kernel_Pthread, "Failed to set host affinity {:#x}: {}", host_mask, result);
+    }
+#endif
+}
+
+/// Maps the guest priority of a started thread to the host scheduler. High priority threads are
+/// reniced, which needs CAP_SYS_NICE on Linux, and low priority ones use the batch class.
+static void ApplyHostPriority(ScePthread thread, pthread_t pth) {
+    if (!Config::mapThreadPrioritiesEnabled() || !thread->is_guest_created) {
+        return;
+    }
+    const int prio = thread->prio;
+#ifdef _WIN64
+    int host_priority = THREAD_PRIORITY_NORMAL;
+    if (prio <= HighPriorityThreshold) {
+        host_priority = THREAD_PRIORITY_ABOVE_NORMAL;
+    } else if (prio >= LowPriorityThreshold) {
+        host_priority = THREAD_PRIORITY_BELOW_NORMAL;
+    }
+    SetThreadPriority(pthread_gethandle(pth), host_priority);
+#elif defined(__linux__)
+    if (thread->host_tid == 0) {
+        // Applied by the thread itself once it starts.
+        return;
+    }
+    const sched_param param{};
+    const int policy = prio >= LowPriorityThreshold ? SCHED_BATCH : SCHED_OTHER;
+    pthread_setschedparam(pth, policy, &param);
+    const int nice = prio <= HighPriorityThreshold ? -5 : 0;
+    if (setpriority(PRIO_PROCESS, thread->host_tid, nice) != 0) {
+        static std::once_flag warned;
+        std::call_once(warned, [&] {
+            LOG_WARNING(Kernel_Pthread,
+                        "Unable to raise host priority of thread {}, high priority threads "
+                        "will run at normal priority",
+                        thread->name);
+        });
+    }
+#endif
+}
+
 void init_pthreads() {
     g_pthread_cxt = new PThreadCxt{};
     // default mutex init
@@ -58,6 +130,11 @@ void pthreadInitSelfMainThread() {
     scePthreadAttrInit(&g_pthread_self->attr);
     g_pthread_self->pth = pthread_self();
     g_pthread_self->name = name;
+    g_pthread_self->prio = g_pthread_self->attr->priority;
+    g_pthread_self->is_guest_created = false;
+#ifdef __linux__
+    g_pthread_self->host_tid = static_cast<s32>(syscall(SYS_gettid));
+#endif
 }
 
 int PS4_SYSV_ABI scePthreadAttrInit(ScePthreadAttr* attr) {
@@ -67,6 +144,8 @@ int PS4_SYSV_ABI scePthreadAttrInit(ScePthreadAttr* attr) {
 
     (*attr)->affinity = 0x7f;
     (*attr)->guard_size = 0x1000;
+    // Host code called by the guest needs more stack than the console default.
+    result = (result == 0 ? pthread_attr_setstacksize(&(*attr)->pth_attr, 2_MB) : result);
 
     SceKernelSchedParam param{};
     param.sched_priority = 700;
@@ -217,14 +296,7 @@ int PS4_SYSV_ABI scePthreadAttrGetschedparam(const ScePthreadAttr* attr,
     }
 
     int result = pthread_attr_getschedparam(&(*attr)->pth_attr, param);
-
-    if (param->sched_priority <= -2) {
-        param->sched_priority = 767;
-    } else if (param->sched_priority >= +2) {
-        param->sched_priority = 256;
-    } else {
-        param->sched_priority = 700;
-    }
+    param->sched_priority = (*attr)->priority;
 
     return result == 0 ? SCE_OK : SCE_KERNEL_ERROR_EINVAL;
 }
@@ -235,19 +307,9 @@ int PS4_SYSV_ABI scePthreadAttrSetschedparam(ScePthreadAttr* attr,
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    SceKernelSchedParam pparam{};
-    if (param->sched_priority <= 478) {
-        pparam.sched_priority = +2;
-    } else if (param->sched_priority >= 733) {
-        pparam.sched_priority = -2;
-    } else {
-        pparam.sched_priority = 0;
-    }
-
-    // We always use SCHED_OTHER for now, so don't call this for now.
-    // int result = pthread_attr_setschedparam(&(*attr)->pth_attr, &pparam);
-    int result = 0;
-    return result == 0 ? SCE_OK : SCE_KERNEL_ERROR_EINVAL;
+    // The host priority is set when the thread starts, see ApplyHostPriority.
+    (*attr)->priority = param->sched_priority;
+    return SCE_OK;
 }
 
 int PS4_SYSV_ABI scePthreadAttrGetschedpolicy(const ScePthreadAttr* attr, int* policy) {
@@ -394,6 +456,9 @@ int PS4_SYSV_ABI scePthreadSetaffinity(ScePthread thread, const /*SceKernelCpuma
     }
 
     auto result = scePthreadAttrSetaffinity(&thread->attr, mask);
+    if (result == SCE_OK && thread->is_guest_created && !thread->is_almost_done) {
+        ApplyHostAffinity(thread->pth, mask);
+    }
 
     return result;
 }
@@ -410,14 +475,96 @@ int PS4_SYSV_ABI scePthreadGetaffinity(ScePthread thread, /*SceKernelCpumask*/ u
     return result;
 }
 
-ScePthreadMutex* createMutex(ScePthreadMutex* addr) {
-    if (addr == nullptr || *addr != nullptr) {
-        return addr;
+uintptr_t GetOwnerToken() {
+    thread_local u8 token;
+    return reinterpret_cast<uintptr_t>(&token);
+}
+
+std::chrono::nanoseconds MicrosecondsToTimeout(u64 usec) {
+    using std::chrono::microseconds;
+    constexpr auto MaxUsec =
+        static_cast<u64>(std::chrono::duration_cast<microseconds>(Common::InfiniteTimeout).count());
+    if (usec >= MaxUsec) {
+        return Common::InfiniteTimeout;
+    }
+    return microseconds{static_cast<s64>(usec)};
+}
+
+std::chrono::nanoseconds TimeUntil(const OrbisKernelTimespec* abstime) {
+    using std::chrono::nanoseconds;
+    using std::chrono::seconds;
+    constexpr s64 MaxSeconds = std::chrono::duration_cast<seconds>(Common::InfiniteTimeout).count();
+    if (abstime->tv_sec >= MaxSeconds - 1) {
+        return Common::InfiniteTimeout;
+    }
+    const auto end = seconds{std::max<s64>(abstime->tv_sec, 0)} +
+                     nanoseconds{std::clamp<s64>(abstime->tv_nsec, 0, 999'999'999)};
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::max<nanoseconds>(end - now, nanoseconds::zero());
+}
+
+/// Locks a guest mutex, giving up after timeout. Returns EBUSY instead of ETIMEDOUT for trylocks.
+static int MutexLock(PthreadMutexInternal* mutex, std::chrono::nanoseconds timeout) {
+    const uintptr_t self = GetOwnerToken();
+    if (mutex->owner.load(std::memory_order_relaxed) == self) {
+        switch (mutex->type) {
+        case ORBIS_PTHREAD_MUTEX_RECURSIVE:
+            mutex->recursion++;
+            return SCE_OK;
+        case ORBIS_PTHREAD_MUTEX_ERRORCHECK:
+            return timeout.count() == 0 ? SCE_KERNEL_ERROR_EBUSY : SCE_KERNEL_ERROR_EDEADLK;
+        default:
+            // Normal mutexes deadlock, like they do on the console.
+            break;
+        }
+    }
+    if (!mutex->mutex.try_lock_for(timeout)) {
+        return timeout.count() == 0 ? SCE_KERNEL_ERROR_EBUSY : SCE_KERNEL_ERROR_ETIMEDOUT;
+    }
+    mutex->owner.store(self, std::memory_order_relaxed);
+    return SCE_OK;
+}
+
+static int MutexUnlock(PthreadMutexInternal* mutex) {
+    if (mutex->owner.load(std::memory_order_relaxed) != GetOwnerToken() &&
+        mutex->type != ORBIS_PTHREAD_MUTEX_NORMAL && mutex->type != ORBIS_PTHREAD_MUTEX_ADAPTIVE) {
+        return SCE_KERNEL_ERROR_EPERM;
+    }
+    if (mutex->recursion > 0) {
+        mutex->recursion--;
+        return SCE_OK;
+    }
+    mutex->owner.store(0, std::memory_order_relaxed);
+    mutex->mutex.unlock();
+    return SCE_OK;
+}
+
+/// Lock adapter that fully releases a guest mutex while waiting on a condition variable.
+class CondWaitLock {
+public:
+    explicit CondWaitLock(PthreadMutexInternal* mutex) : mutex{mutex} {}
+
+    void unlock() {
+        recursion = std::exchange(mutex->recursion, 0);
+        mutex->owner.store(0, std::memory_order_relaxed);
+        mutex->mutex.unlock();
+    }
+
+    void lock() {
+        mutex->mutex.lock();
+        mutex->owner.store(GetOwnerToken(), std::memory_order_relaxed);
+        mutex->recursion = recursion;
     }
-    const VAddr vaddr = reinterpret_cast<VAddr>(addr);
-    std::string name = fmt::format("mutex{:#x}", vaddr);
-    scePthreadMutexInit(addr, nullptr, name.c_str());
-    return addr;
+
+private:
+    PthreadMutexInternal* mutex;
+    u32 recursion{};
+};
+
+ScePthreadMutex* createMutex(ScePthreadMutex* addr) {
+    return CreateOnFirstUse(
+        addr, [](ScePthreadMutex* mutex) { scePthreadMutexInit(mutex, nullptr, nullptr); },
+        [](ScePthreadMutex* mutex) { scePthreadMutexDestroy(mutex); });
 }
 
 int PS4_SYSV_ABI scePthreadMutexInit(ScePthreadMutex* mutex, const ScePthreadMutexattr* mutex_attr,
@@ -443,25 +590,13 @@ int PS4_SYSV_ABI scePthreadMutexInit(ScePthreadMutex* mutex, const ScePthreadMut
     } else {
         (*mutex)->name = "nonameMutex";
     }
-
-    int result = pthread_mutex_init(&(*mutex)->pth_mutex, &(*attr)->pth_mutex_attr);
+    (*mutex)->type = (*attr)->type;
 
     if (name != nullptr) {
-        LOG_INFO(Kernel_Pthread, "name={}, result={}", name, result);
+        LOG_INFO(Kernel_Pthread, "name={}", name);
     }
 
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    case EINVAL:
-        return SCE_KERNEL_ERROR_EINVAL;
-    case ENOMEM:
-        return SCE_KERNEL_ERROR_ENOMEM;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return SCE_OK;
 }
 
 int PS4_SYSV_ABI scePthreadMutexDestroy(ScePthreadMutex* mutex) {
@@ -470,22 +605,18 @@ int PS4_SYSV_ABI scePthreadMutexDestroy(ScePthreadMutex* mutex) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_mutex_destroy(&(*mutex)->pth_mutex);
+    LOG_DEBUG(Kernel_Pthread, "name={}", (*mutex)->name);
 
-    LOG_DEBUG(Kernel_Pthread, "name={}, result={}", (*mutex)->name, result);
+    // A locked mutex is left alone, like pthread_mutex_destroy does.
+    if (!(*mutex)->mutex.try_lock()) {
+        return SCE_KERNEL_ERROR_EBUSY;
+    }
+    (*mutex)->mutex.unlock();
 
     delete *mutex;
     *mutex = nullptr;
 
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EBUSY:
-        return SCE_KERNEL_ERROR_EBUSY;
-    case EINVAL:
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return SCE_OK;
 }
 int PS4_SYSV_ABI scePthreadMutexattrInit(ScePthreadMutexattr* attr) {
     *attr = new PthreadMutexattrInternal{};
@@ -524,6 +655,7 @@ int PS4_SYSV_ABI scePthreadMutexattrSettype(ScePthreadMutexattr* attr, int type)
 
     int result = pthread_mutexattr_settype(&(*attr)->pth_mutex_attr, ptype);
     ASSERT(result == 0);
+    (*attr)->type = type;
 
     return SCE_OK;
 }
@@ -559,23 +691,11 @@ int PS4_SYSV_ABI scePthreadMutexLock(ScePthreadMutex* mutex) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_mutex_lock(&(*mutex)->pth_mutex);
-    if (result != 0) {
+    int result = MutexLock(*mutex, Common::InfiniteTimeout);
+    if (result != SCE_OK) {
         LOG_TRACE(Kernel_Pthread, "Locked name={}, result={}", (*mutex)->name, result);
     }
-
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    case EINVAL:
-        return SCE_KERNEL_ERROR_EINVAL;
-    case EDEADLK:
-        return SCE_KERNEL_ERROR_EDEADLK;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return result;
 }
 
 int PS4_SYSV_ABI scePthreadMutexUnlock(ScePthreadMutex* mutex) {
@@ -583,21 +703,11 @@ int PS4_SYSV_ABI scePthreadMutexUnlock(ScePthreadMutex* mutex) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_mutex_unlock(&(*mutex)->pth_mutex);
-    if (result != 0) {
+    int result = MutexUnlock(*mutex);
+    if (result != SCE_OK) {
         LOG_TRACE(Kernel_Pthread, "Unlocking name={}, result={}", (*mutex)->name, result);
     }
-
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EINVAL:
-        return SCE_KERNEL_ERROR_EINVAL;
-    case EPERM:
-        return SCE_KERNEL_ERROR_EPERM;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return result;
 }
 
 int PS4_SYSV_ABI scePthreadMutexattrDestroy(ScePthreadMutexattr* attr) {
@@ -617,18 +727,9 @@ int PS4_SYSV_ABI scePthreadMutexattrDestroy(ScePthreadMutexattr* attr) {
 }
 
 ScePthreadCond* createCond(ScePthreadCond* addr) {
-    if (addr == nullptr || *addr != nullptr) {
-        return addr;
-    }
-    static std::mutex mutex;
-    std::scoped_lock lk{mutex};
-    if (*addr != nullptr) {
-        return addr;
-    }
-    const VAddr vaddr = reinterpret_cast<VAddr>(addr);
-    std::string name = fmt::format("cond{:#x}", vaddr);
-    scePthreadCondInit(static_cast<ScePthreadCond*>(addr), nullptr, name.c_str());
-    return addr;
+    return CreateOnFirstUse(
+        addr, [](ScePthreadCond* cond) { scePthreadCondInit(cond, nullptr, nullptr); },
+        [](ScePthreadCond* cond) { scePthreadCondDestroy(cond); });
 }
 
 int PS4_SYSV_ABI scePthreadCondInit(ScePthreadCond* cond, const ScePthreadCondattr* attr,
@@ -649,24 +750,11 @@ int PS4_SYSV_ABI scePthreadCondInit(ScePthreadCond* cond, const ScePthreadCondat
         (*cond)->name = "nonameCond";
     }
 
-    int result = pthread_cond_init(&(*cond)->cond, &(*attr)->cond_attr);
-
     if (name != nullptr) {
-        LOG_TRACE(Kernel_Pthread, "name={}, result={}", (*cond)->name, result);
+        LOG_TRACE(Kernel_Pthread, "name={}", (*cond)->name);
     }
 
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    case EINVAL:
-        return SCE_KERNEL_ERROR_EINVAL;
-    case ENOMEM:
-        return SCE_KERNEL_ERROR_ENOMEM;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return SCE_OK;
 }
 
 int PS4_SYSV_ABI scePthreadCondattrInit(ScePthreadCondattr* attr) {
@@ -690,11 +778,21 @@ int PS4_SYSV_ABI scePthreadCondBroadcast(ScePthreadCond* cond) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_cond_broadcast(&(*cond)->cond);
+    (*cond)->cond.NotifyAll();
 
-    LOG_TRACE(Kernel_Pthread, "called name={}, result={}", (*cond)->name, result);
+    LOG_TRACE(Kernel_Pthread, "called name={}", (*cond)->name);
 
-    return (result == 0 ? SCE_OK : SCE_KERNEL_ERROR_EINVAL);
+    return SCE_OK;
+}
+
+/// Waits on a guest condition variable for at most timeout, releasing the guest mutex meanwhile.
+static int CondWait(PthreadCondInternal* cond, PthreadMutexInternal* mutex,
+                    std::chrono::nanoseconds timeout) {
+    if (mutex->owner.load(std::memory_order_relaxed) != GetOwnerToken()) {
+        return SCE_KERNEL_ERROR_EPERM;
+    }
+    CondWaitLock lock{mutex};
+    return cond->cond.WaitFor(lock, timeout) ? SCE_OK : SCE_KERNEL_ERROR_ETIMEDOUT;
 }
 
 int PS4_SYSV_ABI scePthreadCondTimedwait(ScePthreadCond* cond, ScePthreadMutex* mutex, u64 usec) {
@@ -705,46 +803,19 @@ int PS4_SYSV_ABI scePthreadCondTimedwait(ScePthreadCond* cond, ScePthreadMutex*
     if (mutex == nullptr || *mutex == nullptr) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
-    timespec time{};
-    time.tv_sec = usec / 1000000;
-    time.tv_nsec = ((usec % 1000000) * 1000);
-    int result = pthread_cond_timedwait(&(*cond)->cond, &(*mutex)->pth_mutex, &time);
-
-    // LOG_INFO(Kernel_Pthread, "scePthreadCondTimedwait, result={}", result);
-
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case ETIMEDOUT:
-        return SCE_KERNEL_ERROR_ETIMEDOUT;
-    case EINTR:
-        return SCE_KERNEL_ERROR_EINTR;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return CondWait(*cond, *mutex, MicrosecondsToTimeout(usec));
 }
 
 int PS4_SYSV_ABI scePthreadCondDestroy(ScePthreadCond* cond) {
     if (cond == nullptr) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
-    int result = pthread_cond_destroy(&(*cond)->cond);
-
-    LOG_DEBUG(Kernel_Pthread, "scePthreadCondDestroy, result={}", result);
+    LOG_DEBUG(Kernel_Pthread, "scePthreadCondDestroy");
 
     delete *cond;
     *cond = nullptr;
 
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EBUSY:
-        return SCE_KERNEL_ERROR_EBUSY;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return SCE_OK;
 }
 
 int PS4_SYSV_ABI posix_pthread_mutex_init(ScePthreadMutex* mutex, const ScePthreadMutexattr* attr) {
@@ -806,8 +877,15 @@ int PS4_SYSV_ABI posix_pthread_cond_wait(ScePthreadCond* cond, ScePthreadMutex*
 }
 
 int PS4_SYSV_ABI posix_pthread_cond_timedwait(ScePthreadCond* cond, ScePthreadMutex* mutex,
-                                              u64 usec) {
-    int result = scePthreadCondTimedwait(cond, mutex, usec);
+                                              const OrbisKernelTimespec* abstime) {
+    if (abstime == nullptr) {
+        return POSIX_EINVAL;
+    }
+    cond = createCond(cond);
+    if (cond == nullptr || mutex == nullptr || *mutex == nullptr) {
+        return POSIX_EINVAL;
+    }
+    int result = CondWait(*cond, *mutex, TimeUntil(abstime));
     if (result < 0) {
         int rt = result > SCE_KERNEL_ERROR_UNKNOWN && result <= SCE_KERNEL_ERROR_ESTOP
                      ? result + -SCE_KERNEL_ERROR_UNKNOWN
@@ -870,60 +948,14 @@ int PS4_SYSV_ABI posix_pthread_mutexattr_setprotocol(ScePthreadMutexattr* attr,
     return result;
 }
 
-#ifndef HAVE_PTHREAD_MUTEX_TIMEDLOCK
-static int pthread_mutex_timedlock(pthread_mutex_t* mutex, const struct timespec* abstime) {
-    int rc;
-    while ((rc = pthread_mutex_trylock(mutex)) == EBUSY) {
-        struct timespec curr_time;
-        clock_gettime(CLOCK_REALTIME, &curr_time);
-
-        s64 remaining_ns = 0;
-        remaining_ns +=
-            (static_cast<s64>(abstime->tv_sec) - static_cast<s64>(curr_time.tv_sec)) * 1000000000L;
-        remaining_ns += static_cast<s64>(abstime->tv_nsec) - static_cast<s64>(curr_time.tv_nsec);
-
-        if (remaining_ns <= 0) {
-            return ETIMEDOUT;
-        }
-
-        struct timespec sleep_time;
-        sleep_time.tv_sec = 0;
-        if (remaining_ns < 5000000L) {
-            sleep_time.tv_nsec = remaining_ns;
-        } else {
-            sleep_time.tv_nsec = 5000000;
-        }
-
-        nanosleep(&sleep_time, nullptr);
-    }
-
-    return rc;
-}
-#endif
-
 int PS4_SYSV_ABI scePthreadMutexTimedlock(ScePthreadMutex* mutex, u64 usec) {
     mutex = createMutex(mutex);
     if (mutex == nullptr) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    timespec time{};
-    time.tv_sec = usec / 1000000;
-    time.tv_nsec = ((usec % 1000000) * 1000);
-    int result = pthread_mutex_timedlock(&(*mutex)->pth_mutex, &time);
-
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case ETIMEDOUT:
-        return SCE_KERNEL_ERROR_ETIMEDOUT;
-    case EINTR:
-        return SCE_KERNEL_ERROR_EINTR;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    const int result = MutexLock(*mutex, MicrosecondsToTimeout(usec));
+    return result == SCE_KERNEL_ERROR_EBUSY ? SCE_KERNEL_ERROR_ETIMEDOUT : result;
 }
 
 static int pthread_copy_attributes(ScePthreadAttr* dst, const ScePthreadAttr* src) {
@@ -992,6 +1024,11 @@ static void* run_thread(void* arg) {
     auto* linker = Common::Singleton<Core::Linker>::Instance();
     void* ret = nullptr;
     g_pthread_self = thread;
+#ifdef __linux__
+    thread->host_tid = static_cast<s32>(syscall(SYS_gettid));
+#endif
+    ApplyHostAffinity(pthread_self(), thread->attr->affinity);
+    ApplyHostPriority(thread, pthread_self());
     pthread_cleanup_push(cleanup_thread, thread);
     thread->is_started = true;
     ret = linker->ExecuteGuest(thread->entry, thread->arg);
@@ -1031,9 +1068,16 @@ int PS4_SYSV_ABI scePthreadCreate(ScePthread* thread, const ScePthreadAttr* attr
     (*thread)->is_almost_done = false;
     (*thread)->is_detached = (*attr)->detached;
     (*thread)->is_started = false;
+    (*thread)->prio = (*thread)->attr->priority;
+    (*thread)->host_tid = 0;
+    (*thread)->is_guest_created = true;
 
-    pthread_attr_setstacksize(&(*attr)->pth_attr, 2_MB);
-    result = pthread_create(&(*thread)->pth, &(*attr)->pth_attr, run_thread, *thread);
+    // Honor larger guest stacks, but keep enough room for host code called by the guest.
+    auto* pth_attr = &(*thread)->attr->pth_attr;
+    size_t stack_size = 0;
+    pthread_attr_getstacksize(pth_attr, &stack_size);
+    pthread_attr_setstacksize(pth_attr, std::max<size_t>(stack_size, 2_MB));
+    result = pthread_create(&(*thread)->pth, pth_attr, run_thread, *thread);
 
     LOG_INFO(Kernel_Pthread, "thread create name = {}", (*thread)->name);
 
@@ -1135,18 +1179,8 @@ int PS4_SYSV_ABI scePthreadCondSignal(ScePthreadCond* cond) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_cond_signal(&(*cond)->cond);
-
-    // LOG_INFO(Kernel_Pthread, "scePthreadCondSignal, result={}", result);
-
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EBUSY:
-        return SCE_KERNEL_ERROR_EBUSY;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    (*cond)->cond.NotifyOne();
+    return SCE_OK;
 }
 
 int PS4_SYSV_ABI scePthreadCondWait(ScePthreadCond* cond, ScePthreadMutex* mutex) {
@@ -1157,20 +1191,11 @@ int PS4_SYSV_ABI scePthreadCondWait(ScePthreadCond* cond, ScePthreadMutex* mutex
     if (mutex == nullptr || *mutex == nullptr) {
         return SCE_KERNEL_ERROR_EINVAL;
     }
-    int result = pthread_cond_wait(&(*cond)->cond, &(*mutex)->pth_mutex);
+    int result = CondWait(*cond, *mutex, Common::InfiniteTimeout);
 
     LOG_DEBUG(Kernel_Pthread, "scePthreadCondWait, result={}", result);
 
-    switch (result) {
-    case 0:
-        return SCE_OK;
-    case EINTR:
-        return SCE_KERNEL_ERROR_EINTR;
-    case EAGAIN:
-        return SCE_KERNEL_ERROR_EAGAIN;
-    default:
-        return SCE_KERNEL_ERROR_EINVAL;
-    }
+    return result;
 }
 
 int PS4_SYSV_ABI scePthreadCondattrDestroy(ScePthreadCondattr* attr) {
@@ -1198,22 +1223,11 @@ int PS4_SYSV_ABI scePthreadMutexTrylock(ScePthreadMutex* mutex) {
         return ORBIS_KERNEL_ERROR_EINVAL;
     }
 
-    int result = pthread_mutex_trylock(&(*mutex)->pth_mutex);
-    if (result != 0) {
+    int result = MutexLock(*mutex, std::chrono::nanoseconds::zero());
+    if (result != ORBIS_OK) {
         LOG_TRACE(Kernel_Pthread, "name={}, result={}", (*mutex)->name, result);
     }
-
-    switch (result) {
-    case 0:
-        return ORBIS_OK;
-    case EAGAIN:
-        return ORBIS_KERNEL_ERROR_EAGAIN;
-    case EBUSY:
-        return ORBIS_KERNEL_ERROR_EBUSY;
-    case EINVAL:
-    default:
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
+    return result;
 }
 
 int PS4_SYSV_ABI scePthreadEqual(ScePthread thread1, ScePthread thread2) {
@@ -1476,8 +1490,10 @@ int PS4_SYSV_ABI scePthreadGetschedparam(ScePthread thread, int* policy,
 
 int PS4_SYSV_ABI scePthreadSetschedparam(ScePthread thread, int policy,
                                          const SceKernelSchedParam* param) {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called policy={}, sched_priority={}", policy,
-              param->sched_priority);
+    LOG_INFO(Kernel_Pthread, "called policy={}, sched_priority={}", policy,
+             param->sched_priority);
+    thread->prio = param->sched_priority;
+    ApplyHostPriority(thread, thread->pth);
     return ORBIS_OK;
 }
 
@@ -1507,6 +1523,7 @@ int PS4_SYSV_ABI scePthreadGetprio(ScePthread thread, int* prio) {
 }
 int PS4_SYSV_ABI scePthreadSetprio(ScePthread thread, int prio) {
     thread->prio = prio;
+    ApplyHostPriority(thread, thread->pth);
     return ORBIS_OK;
 }
 
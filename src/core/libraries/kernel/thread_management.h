@@ -4,6 +4,7 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <semaphore>
 #include <string>
@@ -11,6 +12,7 @@
 #include <pthread.h>
 #include <sched.h>
 
+#include "common/futex.h"
 #include "common/types.h"
 
 namespace Core::Loader {
@@ -18,6 +20,8 @@ class SymbolsResolver;
 }
 
 namespace Libraries::Kernel {
+struct OrbisKernelTimespec;
+
 constexpr int ORBIS_KERNEL_PRIO_FIFO_DEFAULT = 700;
 constexpr int ORBIS_KERNEL_PRIO_FIFO_HIGHEST = 256;
 constexpr int ORBIS_KERNEL_PRIO_FIFO_LOWEST = 767;
@@ -66,6 +70,10 @@ struct PthreadInternal {
     using Destructor = std::pair<OrbisPthreadKey, PthreadKeyDestructor>;
     std::vector<Destructor> key_destructors;
     int prio;
+    s32 host_tid; ///< Kernel id of the host thread once started, used to renice it on Linux
+    /// Set for threads created through scePthreadCreate. Guest affinity and priority are only
+    /// mapped onto those, as host threads spawned by the main thread would inherit them.
+    std::atomic_bool is_guest_created;
 };
 
 struct PthreadAttrInternal {
@@ -73,6 +81,7 @@ struct PthreadAttrInternal {
     u64 affinity;
     size_t guard_size;
     int policy;
+    int priority;
     bool detached;
     pthread_attr_t pth_attr;
 };
@@ -80,19 +89,23 @@ struct PthreadAttrInternal {
 struct PthreadMutexInternal {
     u8 reserved[256];
     std::string name;
-    pthread_mutex_t pth_mutex;
+    Common::FutexMutex mutex;
+    std::atomic<uintptr_t> owner; ///< Token of the thread holding the mutex, 0 if unlocked
+    u32 recursion;                ///< Locks taken by the owner of a recursive mutex past the first
+    int type;
 };
 
 struct PthreadMutexattrInternal {
     u8 reserved[64];
     pthread_mutexattr_t pth_mutex_attr;
     int pprotocol;
+    int type;
 };
 
 struct PthreadCondInternal {
     u8 reserved[256];
     std::string name;
-    pthread_cond_t cond;
+    Common::FutexCondvar cond;
 };
 
 struct PthreadCondAttrInternal {
@@ -108,7 +121,8 @@ struct PthreadRwLockAttrInternal {
 };
 
 struct PthreadRwInternal {
-    pthread_rwlock_t pth_rwlock;
+    Common::FutexSharedMutex lock;
+    std::atomic<uintptr_t> writer; ///< Owner token of the thread holding the write lock
     std::string name;
 };
 
@@ -167,6 +181,34 @@ private:
     OrbisPthreadRwlockattr m_default_Rwattr = nullptr;
 };
 
+/// Creates a statically initialized primitive on first use. Racing threads each create one and
+/// all but the first to publish theirs destroy it again, so that first uses never serialize.
+template <typename T, typename Init, typename Destroy>
+T* CreateOnFirstUse(T* addr, Init&& init, Destroy&& destroy) {
+    if (addr == nullptr || std::atomic_ref{*addr}.load(std::memory_order_acquire) != nullptr) {
+        return addr;
+    }
+    T object = nullptr;
+    init(&object);
+    T expected = nullptr;
+    if (!std::atomic_ref{*addr}.compare_exchange_strong(expected, object,
+                                                        std::memory_order_acq_rel)) {
+        destroy(&object);
+    }
+    return addr;
+}
+
+/// Returns a token identifying the calling thread, also valid on threads not created by the guest.
+uintptr_t GetOwnerToken();
+
+/// Converts a relative guest timeout in microseconds. Timeouts too long to be represented wait
+/// forever instead of overflowing into an immediate timeout.
+std::chrono::nanoseconds MicrosecondsToTimeout(u64 usec);
+
+/// Converts an absolute CLOCK_REALTIME deadline into the time left until it, with the same
+/// handling of deadlines too far away to be represented.
+std::chrono::nanoseconds TimeUntil(const OrbisKernelTimespec* abstime);
+
 void init_pthreads();
 void pthreadInitSelfMainThread();
 
@@ -191,6 +233,7 @@ int PS4_SYSV_ABI scePthreadSetprio(ScePthread thread, int prio);
  */
 int PS4_SYSV_ABI scePthreadMutexInit(ScePthreadMutex* mutex, const ScePthreadMutexattr* attr,
                                      const char* name);
+int PS4_SYSV_ABI scePthreadMutexDestroy(ScePthreadMutex* mutex);
 int PS4_SYSV_ABI scePthreadMutexattrInit(ScePthreadMutexattr* attr);
 int PS4_SYSV_ABI scePthreadMutexattrSettype(ScePthreadMutexattr* attr, int type);
 int PS4_SYSV_ABI scePthreadMutexattrSetprotocol(ScePthreadMutexattr* attr, int protocol);
@@ -201,6 +244,7 @@ int PS4_SYSV_ABI scePthreadMutexUnlock(ScePthreadMutex* mutex);
  */
 int PS4_SYSV_ABI scePthreadCondInit(ScePthreadCond* cond, const ScePthreadCondattr* attr,
                                     const char* name);
+int PS4_SYSV_ABI scePthreadCondDestroy(ScePthreadCond* cond);
 int PS4_SYSV_ABI scePthreadCondattrInit(ScePthreadCondattr* attr);
 int PS4_SYSV_ABI scePthreadCondBroadcast(ScePthreadCond* cond);
 int PS4_SYSV_ABI scePthreadCondWait(ScePthreadCond* cond, ScePthreadMutex* mutex);
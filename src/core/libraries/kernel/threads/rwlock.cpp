@@ -1,8 +1,12 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
+
+#include "common/futex.h"
 #include "common/logging/log.h"
 #include "core/libraries/error_codes.h"
+#include "core/libraries/kernel/time_management.h"
 #include "core/libraries/libs.h"
 #include "threads.h"
 
@@ -10,63 +14,90 @@ namespace Libraries::Kernel {
 
 extern PThreadCxt* g_pthread_cxt;
 
-int PS4_SYSV_ABI posix_pthread_rwlock_destroy(OrbisPthreadRwlock* rwlock) {
-    int result = pthread_rwlock_destroy(&(*rwlock)->pth_rwlock);
-    delete *rwlock;
-    *rwlock = nullptr;
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_destroy: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+namespace {
+
+using std::chrono::nanoseconds;
+
+enum class LockMode {
+    Read,
+    Write,
+};
+
+OrbisPthreadRwlock* createRwlock(OrbisPthreadRwlock* rwlock) {
+    return CreateOnFirstUse(
+        rwlock, [](OrbisPthreadRwlock* lock) { scePthreadRwlockInit(lock, nullptr, nullptr); },
+        [](OrbisPthreadRwlock* lock) { scePthreadRwlockDestroy(lock); });
 }
 
-int PS4_SYSV_ABI posix_pthread_rwlock_init(OrbisPthreadRwlock* rwlock,
-                                           const OrbisPthreadRwlockattr* attr, const char* name) {
-    *rwlock = new PthreadRwInternal{};
-    if (attr == nullptr || *attr == nullptr) {
-        attr = g_pthread_cxt->getDefaultRwattr();
+/// Locks the rwlock, giving up after timeout. Returns EBUSY if a zero timeout expired and
+/// ETIMEDOUT otherwise, or EDEADLK if the calling thread holds the write lock.
+int RwlockLock(OrbisPthreadRwlock* rwlock, LockMode mode, nanoseconds timeout) {
+    rwlock = createRwlock(rwlock);
+    if (rwlock == nullptr) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
     }
-    int result = pthread_rwlock_init(&(*rwlock)->pth_rwlock, &(*attr)->attr_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_init: error = {}", result);
+    auto& lock = (*rwlock)->lock;
+    if (lock.IsLocked() && (*rwlock)->writer.load(std::memory_order_relaxed) == GetOwnerToken()) {
+        return ORBIS_KERNEL_ERROR_EDEADLK;
+    }
+    const bool locked = mode == LockMode::Read ? lock.try_lock_shared_for(timeout)
+                                               : lock.try_lock_for(timeout);
+    if (!locked) {
+        return timeout == nanoseconds::zero() ? ORBIS_KERNEL_ERROR_EBUSY
+                                              : ORBIS_KERNEL_ERROR_ETIMEDOUT;
+    }
+    if (mode == LockMode::Write) {
+        (*rwlock)->writer.store(GetOwnerToken(), std::memory_order_relaxed);
     }
     return ORBIS_OK;
 }
 
-OrbisPthreadRwlock* createRwlock(OrbisPthreadRwlock* rwlock) {
-    if (rwlock == nullptr || *rwlock != nullptr) {
-        return rwlock;
+int RwlockUnlock(OrbisPthreadRwlock* rwlock) {
+    if (rwlock == nullptr || *rwlock == nullptr) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
     }
-    static std::mutex mutex;
-    std::scoped_lock lk{mutex};
-    if (*rwlock != nullptr) {
-        return rwlock;
+    auto& lock = (*rwlock)->lock;
+    if (lock.IsLocked()) {
+        // Only the writer may release a write lock. Readers are not tracked per thread.
+        if ((*rwlock)->writer.load(std::memory_order_relaxed) != GetOwnerToken()) {
+            return ORBIS_KERNEL_ERROR_EPERM;
+        }
+        (*rwlock)->writer.store(0, std::memory_order_relaxed);
+        lock.unlock();
+    } else if (lock.HasReaders()) {
+        lock.unlock_shared();
+    } else {
+        return ORBIS_KERNEL_ERROR_EPERM;
     }
-    const VAddr addr = std::bit_cast<VAddr>(rwlock);
-    const auto name = fmt::format("rwlock{:#x}", addr);
-    posix_pthread_rwlock_init(rwlock, nullptr, name.c_str());
-    return rwlock;
+    return ORBIS_OK;
+}
+
+/// POSIX functions return the plain errno value rather than the kernel error code.
+int ToPosix(int result) {
+    return result == ORBIS_OK ? 0 : result - ORBIS_KERNEL_ERROR_UNKNOWN;
+}
+
+} // Anonymous namespace
+
+int PS4_SYSV_ABI posix_pthread_rwlock_destroy(OrbisPthreadRwlock* rwlock) {
+    return ToPosix(scePthreadRwlockDestroy(rwlock));
+}
+
+int PS4_SYSV_ABI posix_pthread_rwlock_init(OrbisPthreadRwlock* rwlock,
+                                           const OrbisPthreadRwlockattr* attr, const char* name) {
+    return ToPosix(scePthreadRwlockInit(rwlock, attr, nullptr));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_rdlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    int result = pthread_rwlock_rdlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_rdlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return ToPosix(RwlockLock(rwlock, LockMode::Read, Common::InfiniteTimeout));
 }
 
-int PS4_SYSV_ABI posix_pthread_rwlock_reltimedrdlock_np() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI posix_pthread_rwlock_reltimedrdlock_np(OrbisPthreadRwlock* rwlock, u64 usec) {
+    return ToPosix(RwlockLock(rwlock, LockMode::Read, MicrosecondsToTimeout(usec)));
 }
 
-int PS4_SYSV_ABI posix_pthread_rwlock_reltimedwrlock_np() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI posix_pthread_rwlock_reltimedwrlock_np(OrbisPthreadRwlock* rwlock, u64 usec) {
+    return ToPosix(RwlockLock(rwlock, LockMode::Write, MicrosecondsToTimeout(usec)));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_setname_np() {
@@ -74,62 +105,36 @@ int PS4_SYSV_ABI posix_pthread_rwlock_setname_np() {
     return ORBIS_OK;
 }
 
-int PS4_SYSV_ABI posix_pthread_rwlock_timedrdlock() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI posix_pthread_rwlock_timedrdlock(OrbisPthreadRwlock* rwlock,
+                                                  const OrbisKernelTimespec* abstime) {
+    if (abstime == nullptr) {
+        return POSIX_EINVAL;
+    }
+    return ToPosix(RwlockLock(rwlock, LockMode::Read, TimeUntil(abstime)));
 }
 
-int PS4_SYSV_ABI posix_pthread_rwlock_timedwrlock() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI posix_pthread_rwlock_timedwrlock(OrbisPthreadRwlock* rwlock,
+                                                  const OrbisKernelTimespec* abstime) {
+    if (abstime == nullptr) {
+        return POSIX_EINVAL;
+    }
+    return ToPosix(RwlockLock(rwlock, LockMode::Write, TimeUntil(abstime)));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_tryrdlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    if (rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_tryrdlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_tryrdlock: error = {}", result);
-    }
-    return result;
+    return ToPosix(RwlockLock(rwlock, LockMode::Read, nanoseconds::zero()));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_trywrlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    if (rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_trywrlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_trywrlock: error = {}", result);
-    }
-    return result;
+    return ToPosix(RwlockLock(rwlock, LockMode::Write, nanoseconds::zero()));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_unlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    if (rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_unlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_unlock: error = {}", result);
-    }
-    return result;
+    return ToPosix(RwlockUnlock(rwlock));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlock_wrlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    if (rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_wrlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "posix_pthread_rwlock_wrlock: error = {}", result);
-    }
-    return result;
+    return ToPosix(RwlockLock(rwlock, LockMode::Write, Common::InfiniteTimeout));
 }
 
 int PS4_SYSV_ABI posix_pthread_rwlockattr_destroy(OrbisPthreadRwlockattr* attr) {
@@ -213,103 +218,56 @@ int PS4_SYSV_ABI scePthreadRwlockattrSettype() {
 }
 
 int PS4_SYSV_ABI scePthreadRwlockDestroy(OrbisPthreadRwlock* rwlock) {
-    int result = pthread_rwlock_destroy(&(*rwlock)->pth_rwlock);
+    if (rwlock == nullptr || *rwlock == nullptr) {
+        return ORBIS_KERNEL_ERROR_EINVAL;
+    }
+    auto& lock = (*rwlock)->lock;
+    if (lock.IsLocked() || lock.HasReaders()) {
+        return ORBIS_KERNEL_ERROR_EBUSY;
+    }
     delete *rwlock;
     *rwlock = nullptr;
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockDestroy: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return ORBIS_OK;
 }
 
 int PS4_SYSV_ABI scePthreadRwlockInit(OrbisPthreadRwlock* rwlock,
                                       const OrbisPthreadRwlockattr* attr, const char* name) {
-    *rwlock = new PthreadRwInternal{};
-    if (rwlock == nullptr || *rwlock == nullptr) {
+    if (rwlock == nullptr) {
         return ORBIS_KERNEL_ERROR_EINVAL;
     }
-
-    if (attr == nullptr || *attr == nullptr) {
-        attr = g_pthread_cxt->getDefaultRwattr();
-    }
+    *rwlock = new PthreadRwInternal{};
     if (name != nullptr) {
         (*rwlock)->name = name;
     }
-    int result = pthread_rwlock_init(&(*rwlock)->pth_rwlock, &(*attr)->attr_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockInit: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
     return ORBIS_OK;
 }
 
 int PS4_SYSV_ABI scePthreadRwlockRdlock(OrbisPthreadRwlock* rwlock) {
-    if (rwlock == nullptr || *rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_rdlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockRdlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return RwlockLock(rwlock, LockMode::Read, Common::InfiniteTimeout);
 }
 
-int PS4_SYSV_ABI scePthreadRwlockTimedrdlock() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI scePthreadRwlockTimedrdlock(OrbisPthreadRwlock* rwlock, u64 usec) {
+    return RwlockLock(rwlock, LockMode::Read, MicrosecondsToTimeout(usec));
 }
 
-int PS4_SYSV_ABI scePthreadRwlockTimedwrlock() {
-    LOG_ERROR(Kernel_Pthread, "(STUBBED) called");
-    return ORBIS_OK;
+int PS4_SYSV_ABI scePthreadRwlockTimedwrlock(OrbisPthreadRwlock* rwlock, u64 usec) {
+    return RwlockLock(rwlock, LockMode::Write, MicrosecondsToTimeout(usec));
 }
 
 int PS4_SYSV_ABI scePthreadRwlockTryrdlock(OrbisPthreadRwlock* rwlock) {
-    if (rwlock == nullptr || *rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_tryrdlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockTryrdlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return RwlockLock(rwlock, LockMode::Read, nanoseconds::zero());
 }
 
 int PS4_SYSV_ABI scePthreadRwlockTrywrlock(OrbisPthreadRwlock* rwlock) {
-    if (rwlock == nullptr || *rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_trywrlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockTrywrlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return RwlockLock(rwlock, LockMode::Write, nanoseconds::zero());
 }
 
 int PS4_SYSV_ABI scePthreadRwlockUnlock(OrbisPthreadRwlock* rwlock) {
-    if (rwlock == nullptr || *rwlock == nullptr) {
-        return ORBIS_KERNEL_ERROR_EINVAL;
-    }
-    int result = pthread_rwlock_unlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockUnlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return RwlockUnlock(rwlock);
 }
 
 int PS4_SYSV_ABI scePthreadRwlockWrlock(OrbisPthreadRwlock* rwlock) {
-    rwlock = createRwlock(rwlock);
-    int result = pthread_rwlock_wrlock(&(*rwlock)->pth_rwlock);
-    if (result != 0) {
-        LOG_ERROR(Kernel_Pthread, "scePthreadRwlockWrlock: error = {}", result);
-        result += ORBIS_KERNEL_ERROR_UNKNOWN;
-    }
-    return result;
+    return RwlockLock(rwlock, LockMode::Write, Common::InfiniteTimeout);
 }
 
 void RwlockSymbolsRegister(Core::Loader::SymbolsResolver* sym) {
@@ -1,12 +1,14 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
-#include <condition_variable>
+#include <algorithm>
+#include <chrono>
 #include <list>
 #include <mutex>
 #include <pthread.h>
 
 #include "common/assert.h"
+#include "common/futex.h"
 #include "common/logging/log.h"
 #include "core/libraries/error_codes.h"
 #include "core/libraries/libs.h"
@@ -40,7 +42,8 @@ public:
         WaitingThread waiter{need_count, is_fifo};
         const auto it = AddWaiter(&waiter);
 
-        // Perform the wait.
+        // Perform the wait. A waiter that was signaled or canceled has already been removed
+        // from the list, even if its timeout expired at the same time.
         const s32 result = waiter.Wait(lk, timeout);
         if (result == SCE_KERNEL_ERROR_ETIMEDOUT) {
             wait_list.erase(it);
@@ -64,7 +67,8 @@ public:
             }
             it = wait_list.erase(it);
             token_count -= waiter->need_count;
-            waiter->cv.notify_one();
+            waiter->was_signaled = true;
+            waiter->cv.NotifyOne();
         }
 
         return true;
@@ -77,7 +81,7 @@ public:
         }
         for (auto* waiter : wait_list) {
             waiter->was_cancled = true;
-            waiter->cv.notify_one();
+            waiter->cv.NotifyOne();
         }
         wait_list.clear();
         token_count = set_count < 0 ? init_count : set_count;
@@ -86,9 +90,10 @@ public:
 
 public:
     struct WaitingThread {
-        std::condition_variable cv;
+        Common::FutexCondvar cv;
         u32 priority;
         s32 need_count;
+        bool was_signaled{};
         bool was_deleted{};
         bool was_cancled{};
 
@@ -103,37 +108,37 @@ public:
             priority = param.sched_priority;
         }
 
-        int GetResult(bool timed_out) {
-            if (timed_out) {
-                return SCE_KERNEL_ERROR_ETIMEDOUT;
-            }
+        bool WasWoken() const {
+            return was_signaled || was_deleted || was_cancled;
+        }
+
+        int GetResult() const {
             if (was_deleted) {
                 return SCE_KERNEL_ERROR_EACCES;
             }
             if (was_cancled) {
                 return SCE_KERNEL_ERROR_ECANCELED;
             }
+            if (!was_signaled) {
+                return SCE_KERNEL_ERROR_ETIMEDOUT;
+            }
             return SCE_OK;
         }
 
-        int Wait(std::unique_lock<std::mutex>& lk, u32* timeout) {
+        int Wait(std::unique_lock<Common::FutexMutex>& lk, u32* timeout) {
             if (!timeout) {
                 // Wait indefinitely until we are woken up.
-                cv.wait(lk);
-                return GetResult(false);
+                cv.Wait(lk, [this] { return WasWoken(); });
+                return GetResult();
             }
             // Wait until timeout runs out, recording how much remaining time there was.
-            const auto start = std::chrono::high_resolution_clock::now();
-            const auto status = cv.wait_for(lk, std::chrono::microseconds(*timeout));
-            const auto end = std::chrono::high_resolution_clock::now();
+            const auto start = std::chrono::steady_clock::now();
+            cv.WaitFor(lk, std::chrono::microseconds(*timeout), [this] { return WasWoken(); });
+            const auto end = std::chrono::steady_clock::now();
             const auto time =
                 std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-            if (status == std::cv_status::timeout) {
-                *timeout = 0;
-            } else {
-                *timeout -= time;
-            }
-            return GetResult(status == std::cv_status::timeout);
+            *timeout = WasWoken() ? *timeout - std::min<u32>(*timeout, time) : 0;
+            return GetResult();
         }
     };
 
@@ -150,14 +155,13 @@ public:
         while (it != wait_list.end() && (*it)->priority > waiter->priority) {
             it++;
         }
-        wait_list.insert(it, waiter);
-        return it;
+        return wait_list.insert(it, waiter);
     }
 
     WaitList wait_list;
     std::string name;
     std::atomic<s32> token_count;
-    std::mutex mutex;
+    Common::FutexMutex mutex;
     s32 max_count;
     s32 init_count;
     bool is_fifo;
@@ -12,6 +12,9 @@ class SymbolsResolver;
 namespace Libraries::Kernel {
 
 int PS4_SYSV_ABI scePthreadRwlockattrInit(OrbisPthreadRwlockattr* attr);
+int PS4_SYSV_ABI scePthreadRwlockInit(OrbisPthreadRwlock* rwlock,
+                                      const OrbisPthreadRwlockattr* attr, const char* name);
+int PS4_SYSV_ABI scePthreadRwlockDestroy(OrbisPthreadRwlock* rwlock);
 
 void SemaphoreSymbolsRegister(Core::Loader::SymbolsResolver* sym);
 void RwlockSymbolsRegister(Core::Loader::SymbolsResolver* sym);
@@ -139,7 +139,7 @@ SaveDialogState::SaveDialogState(const OrbisSaveDataDialogParam& param) {
             auto buf = (u8*)new_item->iconBuf;
             icon = RefCountedTexture::DecodePngTexture({buf, buf + new_item->iconSize});
         } else {
-            const auto& src_icon = g_mnt->GetHostPath("/app0/sce_sys/save_data.png");
+            const auto& src_icon = g_mnt->GetHostFile("/app0/sce_sys/save_data.png");
             if (std::filesystem::exists(src_icon)) {
                 icon = RefCountedTexture::DecodePngFile(src_icon);
             }
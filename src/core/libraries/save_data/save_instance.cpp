@@ -155,7 +155,7 @@ void SaveInstance::SetupAndMount(bool read_only, bool copy_icon, bool ignore_cor
     if (!exists) {
         CreateFiles();
         if (copy_icon) {
-            const auto& src_icon = g_mnt->GetHostPath("/app0/sce_sys/save_data.png");
+            const auto& src_icon = g_mnt->GetHostFile("/app0/sce_sys/save_data.png");
             if (fs::exists(src_icon)) {
                 fs::copy_file(src_icon, GetIconPath());
             }
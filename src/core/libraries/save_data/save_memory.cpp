@@ -188,7 +188,7 @@ size_t CreateSaveMemory(size_t memory_size) {
 
 void SetIcon(void* buf, size_t buf_size) {
     if (buf == nullptr) {
-        const auto& src_icon = g_mnt->GetHostPath("/app0/sce_sys/save_data.png");
+        const auto& src_icon = g_mnt->GetHostFile("/app0/sce_sys/save_data.png");
         if (fs::exists(src_icon)) {
             if (fs::exists(g_icon_path)) {
                 fs::remove(g_icon_path);
@@ -8,6 +8,7 @@
 #include "common/config.h"
 #include "common/debug.h"
 #include "common/thread.h"
+#include "core/cpu_topology.h"
 #include "core/libraries/error_codes.h"
 #include "core/libraries/kernel/time_management.h"
 #include "core/libraries/videoout/driver.h"
@@ -261,6 +262,7 @@ void VideoOutDriver::PresentThread(std::stop_token token) {
     const auto vblank_period = VblankPeriod / Config::vblankDiv();
 
     Common::SetCurrentThreadName("PresentThread");
+    Core::PinServiceThread();
     Common::SetCurrentThreadRealtime(vblank_period);
 
     Common::AccurateTimer timer{vblank_period};
@@ -1,11 +1,14 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
+#include <chrono>
 #include "common/alignment.h"
 #include "common/arch.h"
 #include "common/assert.h"
 #include "common/config.h"
 #include "common/logging/log.h"
+#include "common/metrics.h"
 #include "common/path_util.h"
 #include "common/string_util.h"
 #include "common/thread.h"
@@ -69,9 +72,17 @@ void Linker::Execute() {
     }
 
     // Relocate all modules
+    const auto& num_relocations = Common::Metrics::GetCounter("linker.relocations");
+    const u64 relocations_before = num_relocations.Value();
+    const auto relocate_start = std::chrono::steady_clock::now();
     for (const auto& m : m_modules) {
         Relocate(m.get());
     }
+    const auto relocate_time = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                             relocate_start);
+    const u64 relocations = num_relocations.Value() - relocations_before;
+    LOG_INFO(Core_Linker, "Applied {} relocations in {:.2f} ms ({:.0f} per second)", relocations,
+             relocate_time.count() * 1000.0, relocations / relocate_time.count());
 
     // Configure used flexible memory size.
     if (const auto* proc_param = GetProcParam()) {
@@ -144,7 +155,9 @@ Module* Linker::FindByAddress(VAddr address) {
 }
 
 void Linker::Relocate(Module* module) {
+    static auto& num_relocations = Common::Metrics::GetCounter("linker.relocations");
     module->ForEachRelocation([&](elf_relocation* rel, u32 i, bool isJmpRel) {
+        num_relocations.Add();
         const u32 bit_idx =
             (isJmpRel ? module->dynamic_info.relocation_table_size / sizeof(elf_relocation) : 0) +
             i;
@@ -249,33 +262,42 @@ const Module* Linker::FindExportedModule(const ModuleInfo& module, const Library
 
 bool Linker::Resolve(const std::string& name, Loader::SymbolType sym_type, Module* m,
                      Loader::SymbolRecord* return_info) {
-    const auto ids = Common::SplitString(name, '#');
-    if (ids.size() != 3) {
+    static auto& num_lookups = Common::Metrics::GetCounter("linker.symbol_lookups");
+    num_lookups.Add();
+
+    // Imported names are formatted as nid#library#module.
+    const std::string_view view{name};
+    const size_t library_pos = view.find('#');
+    const size_t module_pos = view.find('#', library_pos + 1);
+    if (library_pos == std::string_view::npos || module_pos == std::string_view::npos ||
+        view.find('#', module_pos + 1) != std::string_view::npos) {
         return_info->virtual_address = 0;
         return_info->name = name;
         LOG_ERROR(Core_Linker, "Not Resolved {}", name);
         return false;
     }
 
-    const LibraryInfo* library = m->FindLibrary(ids[1]);
-    const ModuleInfo* module = m->FindModule(ids[2]);
+    const LibraryInfo* library =
+        m->FindLibrary(view.substr(library_pos + 1, module_pos - library_pos - 1));
+    const ModuleInfo* module = m->FindModule(view.substr(module_pos + 1));
     ASSERT_MSG(library && module, "Unable to find library and module");
 
-    Loader::SymbolResolver sr{};
-    sr.name = ids.at(0);
-    sr.library = library->name;
-    sr.library_version = library->version;
-    sr.module = module->name;
-    sr.module_version_major = module->version_major;
-    sr.module_version_minor = module->version_minor;
-    sr.type = sym_type;
-
-    const auto* record = m_hle_symbols.FindSymbol(sr);
+    const Loader::SymbolKey key{
+        .nid = view.substr(0, library_pos),
+        .library = library->name,
+        .library_version = library->version,
+        .module = module->name,
+        .module_version_major = module->version_major,
+        .module_version_minor = module->version_minor,
+        .type = sym_type,
+    };
+
+    const auto* record = m_hle_symbols.FindSymbol(key);
     if (!record) {
         // Check if it an export function
         const auto* p = FindExportedModule(*module, *library);
         if (p && p->export_sym.GetSize() > 0) {
-            record = p->export_sym.FindSymbol(sr);
+            record = p->export_sym.FindSymbol(key);
         }
     }
     if (record) {
@@ -283,53 +305,101 @@ bool Linker::Resolve(const std::string& name, Loader::SymbolType sym_type, Modul
         return true;
     }
 
-    const auto aeronid = AeroLib::FindByNid(sr.name.c_str());
+    const std::string nid{key.nid};
+    const auto aeronid = AeroLib::FindByNid(nid.c_str());
     if (aeronid) {
         return_info->name = aeronid->name;
         return_info->virtual_address = AeroLib::GetStub(aeronid->nid);
     } else {
-        return_info->virtual_address = AeroLib::GetStub(sr.name.c_str());
+        return_info->virtual_address = AeroLib::GetStub(nid.c_str());
         return_info->name = "Unknown !!!";
     }
-    LOG_ERROR(Core_Linker, "Linker: Stub resolved {} as {} (lib: {}, mod: {})", sr.name,
+    LOG_ERROR(Core_Linker, "Linker: Stub resolved {} as {} (lib: {}, mod: {})", nid,
               return_info->name, library->name, module->name);
     return false;
 }
 
 void* Linker::TlsGetAddr(u64 module_index, u64 offset) {
+    // Threads only ever touch their own DTV, the lock is needed only when it has to grow or a
+    // module's block has to be allocated.
+    const DtvEntry* dtv_table = GetTcbBase()->tcb_dtv;
+    if (dtv_table[0].counter == dtv_generation_counter.load(std::memory_order_acquire) &&
+        module_index <= dtv_table[1].counter) [[likely]] {
+        if (u8* addr = dtv_table[module_index + 1].pointer) [[likely]] {
+            return addr + offset;
+        }
+    }
+    return TlsGetAddrSlow(module_index, offset);
+}
+
+void* Linker::TlsGetAddrSlow(u64 module_index, u64 offset) {
+    static auto& num_slow_calls = Common::Metrics::GetCounter("linker.tls_slow_path");
+    num_slow_calls.Add();
+
     std::scoped_lock lk{mutex};
 
-    DtvEntry* dtv_table = GetTcbBase()->tcb_dtv;
-    if (dtv_table[0].counter != dtv_generation_counter) {
-        // Generation counter changed, a dynamic module was either loaded or unloaded.
-        const u32 old_num_dtvs = dtv_table[1].counter;
-        ASSERT_MSG(max_tls_index > old_num_dtvs, "Module unloading unsupported");
-        // Module was loaded, increase DTV table size.
-        DtvEntry* new_dtv_table = new DtvEntry[max_tls_index + 2];
+    Tcb* tcb = GetTcbBase();
+    DtvEntry* dtv_table = tcb->tcb_dtv;
+    // The generation counter is advanced after a module is loaded, so compare the DTV size
+    // against the loaded modules rather than trusting the counter alone.
+    const u32 generation = dtv_generation_counter.load(std::memory_order_acquire);
+    const u32 old_num_dtvs = dtv_table[1].counter;
+    if (max_tls_index > old_num_dtvs) {
+        // A dynamic module was loaded, increase DTV table size.
+        DtvEntry* new_dtv_table = new DtvEntry[max_tls_index + 2]{};
         std::memcpy(new_dtv_table + 2, dtv_table + 2, old_num_dtvs * sizeof(DtvEntry));
-        new_dtv_table[0].counter = dtv_generation_counter;
         new_dtv_table[1].counter = max_tls_index;
         delete[] dtv_table;
 
         // Update TCB pointer.
-        GetTcbBase()->tcb_dtv = new_dtv_table;
+        tcb->tcb_dtv = new_dtv_table;
         dtv_table = new_dtv_table;
     }
+    dtv_table[0].counter = generation;
+
+    if (!dtv_table[module_index + 1].pointer) {
+        AllocateDynamicTls(dtv_table);
+    }
+    return dtv_table[module_index + 1].pointer + offset;
+}
 
-    u8* addr = dtv_table[module_index + 1].pointer;
-    if (!addr) {
-        // Module was just loaded by above code. Allocate TLS block for it.
-        Module* module = m_modules[module_index - 1].get();
+void Linker::AllocateDynamicTls(DtvEntry* dtv_table) {
+    // Allocate the blocks of every module the thread is missing at once, so that loading
+    // several modules costs a thread a single trip through the slow path.
+    const u32 num_dtvs = dtv_table[1].counter;
+    const auto is_missing = [&](const Module& module) {
+        const u32 modid = module.tls.modid;
+        return modid != 0 && modid <= num_dtvs && !dtv_table[modid + 1].pointer;
+    };
+    // Modules without a TLS image still get a distinct zeroed block, so that their DTV entry
+    // is never left null and the lookup takes the fast path next time.
+    static constexpr size_t BlockAlign = 16;
+    const auto block_size = [](const Module& module) {
+        return std::max<size_t>(Common::AlignUp(module.tls.image_size, BlockAlign), BlockAlign);
+    };
+    size_t total_size = 0;
+    for (const auto& module : m_modules) {
+        if (is_missing(*module)) {
+            total_size += block_size(*module);
+        }
+    }
+    if (total_size == 0) {
+        return;
+    }
+
+    // TODO: Determine if Windows will crash from this
+    u8* dest = reinterpret_cast<u8*>(heap_api->heap_malloc(total_size));
+    for (const auto& module : m_modules) {
+        if (!is_missing(*module)) {
+            continue;
+        }
         const u32 init_image_size = module->tls.init_image_size;
-        // TODO: Determine if Windows will crash from this
-        u8* dest = reinterpret_cast<u8*>(heap_api->heap_malloc(module->tls.image_size));
         const u8* src = reinterpret_cast<const u8*>(module->tls.image_virtual_addr);
         std::memcpy(dest, src, init_image_size);
         std::memset(dest + init_image_size, 0, module->tls.image_size - init_image_size);
-        dtv_table[module_index + 1].pointer = dest;
-        addr = dest;
+        dtv_table[module->tls.modid + 1].pointer = dest;
+        dest += block_size(*module);
     }
-    return addr + offset;
 }
 
 thread_local std::once_flag init_tls_flag;
@@ -386,7 +456,7 @@ void Linker::InitTlsForThread(bool is_primary) {
     // Initialize allocated memory and allocate DTV table.
     const u32 num_dtvs = max_tls_index;
     std::memset(addr_out, 0, total_tls_size);
-    DtvEntry* dtv_table = new DtvEntry[num_dtvs + 2];
+    DtvEntry* dtv_table = new DtvEntry[num_dtvs + 2]{};
 
     // Initialize thread control block
     u8* addr = reinterpret_cast<u8*>(addr_out);
@@ -395,7 +465,7 @@ void Linker::InitTlsForThread(bool is_primary) {
     tcb->tcb_dtv = dtv_table;
 
     // Dtv[0] is the generation counter. libkernel puts their number into dtv[1] (why?)
-    dtv_table[0].counter = dtv_generation_counter;
+    dtv_table[0].counter = dtv_generation_counter.load(std::memory_order_acquire);
     dtv_table[1].counter = num_dtvs;
 
     // Copy init images to TLS thread blocks and map them to DTV slots.
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include "core/module.h"
@@ -11,6 +12,7 @@
 namespace Core {
 
 struct DynamicModuleInfo;
+union DtvEntry;
 class Linker;
 class MemoryManager;
 
@@ -94,7 +96,7 @@ public:
     }
 
     void AdvanceGenerationCounter() noexcept {
-        dtv_generation_counter++;
+        dtv_generation_counter.fetch_add(1, std::memory_order_release);
     }
 
     void* TlsGetAddr(u64 module_index, u64 offset);
@@ -119,10 +121,12 @@ private:
     const Module* FindExportedModule(const ModuleInfo& m, const LibraryInfo& l);
     void EnsureThreadInitialized(bool is_primary = false);
     void InitTlsForThread(bool is_primary);
+    void* TlsGetAddrSlow(u64 module_index, u64 offset);
+    void AllocateDynamicTls(DtvEntry* dtv_table);
 
     MemoryManager* memory;
     std::mutex mutex;
-    u32 dtv_generation_counter{1};
+    std::atomic<u32> dtv_generation_counter{1};
     size_t static_tls_size{};
     u32 max_tls_index{};
     u32 num_static_modules{};
@@ -11,24 +11,44 @@
 namespace Core::Loader {
 
 void SymbolsResolver::AddSymbol(const SymbolResolver& s, u64 virtual_addr) {
+    const SymbolKey key{
+        .nid = Intern(s.name),
+        .library = Intern(s.library),
+        .library_version = s.library_version,
+        .module = Intern(s.module),
+        .module_version_major = s.module_version_major,
+        .module_version_minor = s.module_version_minor,
+        .type = s.type,
+    };
+    // Lookups used to return the first symbol added with a name, keep doing so.
+    m_index.try_emplace(key, static_cast<u32>(m_symbols.size()));
     m_symbols.emplace_back(GenerateName(s), s.nidName, virtual_addr);
 }
 
+std::string_view SymbolsResolver::Intern(std::string_view str) {
+    return *m_strings.emplace(str).first;
+}
+
 std::string SymbolsResolver::GenerateName(const SymbolResolver& s) {
     return fmt::format("{}#{}#{}#{}#{}#{}#{}", s.name, s.library, s.library_version, s.module,
                        s.module_version_major, s.module_version_minor, SymbolTypeToS(s.type));
 }
 
 const SymbolRecord* SymbolsResolver::FindSymbol(const SymbolResolver& s) const {
-    const std::string name = GenerateName(s);
-    for (u32 i = 0; i < m_symbols.size(); i++) {
-        if (m_symbols[i].name == name) {
-            return &m_symbols[i];
-        }
-    }
+    return FindSymbol(SymbolKey{
+        .nid = s.name,
+        .library = s.library,
+        .library_version = s.library_version,
+        .module = s.module,
+        .module_version_major = s.module_version_major,
+        .module_version_minor = s.module_version_minor,
+        .type = s.type,
+    });
+}
 
-    // LOG_INFO(Core_Linker, "Unresolved! {}", name);
-    return nullptr;
+const SymbolRecord* SymbolsResolver::FindSymbol(const SymbolKey& key) const {
+    const auto it = m_index.find(key);
+    return it != m_index.end() ? &m_symbols[it->second] : nullptr;
 }
 
 void SymbolsResolver::DebugDump(const std::filesystem::path& file_name) {
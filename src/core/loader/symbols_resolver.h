@@ -6,7 +6,10 @@
 #include <filesystem>
 #include <span>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
+#include <tsl/robin_map.h>
 #include "common/types.h"
 
 namespace Core::Loader {
@@ -36,13 +39,46 @@ struct SymbolResolver {
     SymbolType type;
 };
 
+/// Identifies a symbol without owning its strings, so that lookups don't allocate.
+struct SymbolKey {
+    std::string_view nid;
+    std::string_view library;
+    u16 library_version;
+    std::string_view module;
+    u8 module_version_major;
+    u8 module_version_minor;
+    SymbolType type;
+
+    bool operator==(const SymbolKey&) const = default;
+};
+
+struct SymbolKeyHash {
+    size_t operator()(const SymbolKey& key) const noexcept {
+        constexpr std::hash<std::string_view> hash;
+        size_t seed = hash(key.nid);
+        const auto combine = [&seed](size_t value) {
+            seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        };
+        combine(hash(key.library));
+        combine(hash(key.module));
+        combine(key.library_version | key.module_version_major << 16 |
+                key.module_version_minor << 24 | size_t(key.type) << 32);
+        return seed;
+    }
+};
+
 class SymbolsResolver {
 public:
     SymbolsResolver() = default;
     virtual ~SymbolsResolver() = default;
 
+    // The index views strings owned by the resolver.
+    SymbolsResolver(const SymbolsResolver&) = delete;
+    SymbolsResolver& operator=(const SymbolsResolver&) = delete;
+
     void AddSymbol(const SymbolResolver& s, u64 virtual_addr);
     const SymbolRecord* FindSymbol(const SymbolResolver& s) const;
+    const SymbolRecord* FindSymbol(const SymbolKey& key) const;
 
     void DebugDump(const std::filesystem::path& file_name);
 
@@ -71,8 +107,16 @@ public:
         }
     }
 
+private:
+    /// Returns a view of a copy of str that lives as long as the resolver.
+    std::string_view Intern(std::string_view str);
+
 private:
     std::vector<SymbolRecord> m_symbols;
+    std::unordered_set<std::string> m_strings; ///< Node based, so views of it stay valid
+    tsl::robin_map<SymbolKey, u32, SymbolKeyHash, std::equal_to<SymbolKey>,
+                   std::allocator<std::pair<SymbolKey, u32>>, true>
+        m_index; ///< Index of every symbol in m_symbols, keys viewing m_strings
 };
 
 } // namespace Core::Loader
@@ -12,17 +12,20 @@
 #endif
 #include "common/assert.h"
 #include "common/elf_info.h"
+#include "common/metrics.h"
 #include "common/ntapi.h"
 #include "common/path_util.h"
 #include "common/polyfill_thread.h"
 #include "common/scm_rev.h"
 #include "common/singleton.h"
 #include "common/version.h"
+#include "core/cpu_topology.h"
 #include "core/file_format/playgo_chunk.h"
 #include "core/file_format/psf.h"
 #include "core/file_format/splash.h"
 #include "core/file_format/trp.h"
 #include "core/file_sys/fs.h"
+#include "core/file_sys/pkg_image.h"
 #include "core/libraries/disc_map/disc_map.h"
 #include "core/libraries/kernel/thread_management.h"
 #include "core/libraries/libc_internal/libc_internal.h"
@@ -59,9 +62,18 @@ Emulator::Emulator() {
     LOG_INFO(Loader, "Description {}", Common::g_scm_desc);
 
     LOG_INFO(Config, "General isNeo: {}", Config::isNeoMode());
+    LOG_INFO(Config, "General dmemHugePages: {}", Config::dmemHugePagesEnabled());
+    LOG_INFO(Config, "General dmemPrefault: {}", Config::dmemPrefaultEnabled());
+    LOG_INFO(Config, "General pinThreads: {}", Config::pinThreadsEnabled());
+    LOG_INFO(Config, "General guestCpus: {}", Config::getGuestCpus());
+    LOG_INFO(Config, "General serviceCpus: {}", Config::getServiceCpus());
+    LOG_INFO(Config, "General mapThreadPriorities: {}", Config::mapThreadPrioritiesEnabled());
     LOG_INFO(Config, "GPU isNullGpu: {}", Config::nullGpu());
     LOG_INFO(Config, "GPU shouldDumpShaders: {}", Config::dumpShaders());
     LOG_INFO(Config, "GPU shouldDumpPM4: {}", Config::dumpPM4());
+    LOG_INFO(Config, "GPU capturePM4: {}", Config::capturePM4());
+    LOG_INFO(Config, "GPU shaderCache: {}", Config::shaderCacheEnabled());
+    LOG_INFO(Config, "GPU asyncPipelineCompilation: {}", Config::asyncPipelineCompilation());
     LOG_INFO(Config, "GPU vblankDivider: {}", Config::vblankDiv());
     LOG_INFO(Config, "Vulkan gpuId: {}", Config::getGpuId());
     LOG_INFO(Config, "Vulkan vkValidation: {}", Config::vkValidationEnabled());
@@ -70,6 +82,8 @@ Emulator::Emulator() {
     LOG_INFO(Config, "Vulkan rdocEnable: {}", Config::isRdocEnabled());
     LOG_INFO(Config, "Vulkan rdocMarkersEnable: {}", Config::vkMarkersEnabled());
     LOG_INFO(Config, "Vulkan crashDiagnostics: {}", Config::vkCrashDiagnosticEnabled());
+    LOG_INFO(Config, "Debug metricsDump: {}", Config::getMetricsDump());
+    LOG_INFO(Config, "Debug metricsDumpPerFrame: {}", Config::metricsDumpPerFrame());
 
     // Defer until after logging is initialized.
     memory = Core::Memory::Instance();
@@ -85,12 +99,25 @@ Emulator::~Emulator() {
     Config::save(config_dir / "config.toml");
 }
 
-void Emulator::Run(const std::filesystem::path& file) {
-    // Applications expect to be run from /app0 so mount the file's parent path as app0.
+void Emulator::Run(const std::filesystem::path& path) {
     auto* mnt = Common::Singleton<Core::FileSys::MntPoints>::Instance();
-    mnt->Mount(file.parent_path(), "/app0");
-    // Certain games may use /hostapp as well such as CUSA001100
-    mnt->Mount(file.parent_path(), "/hostapp");
+    std::filesystem::path file = path;
+    std::shared_ptr<Core::FileSys::PkgImage> pkg;
+    if (path.extension() == ".pkg") {
+        // Run the package in place, only its executables and sce_sys entries are unpacked.
+        pkg = std::make_shared<Core::FileSys::PkgImage>();
+        if (!pkg->Open(path)) {
+            return;
+        }
+        file = pkg->GetSysDir() / "eboot.bin";
+        mnt->Mount(pkg, "/app0");
+        mnt->Mount(pkg, "/hostapp");
+    } else {
+        // Applications expect to be run from /app0 so mount the file's parent path as app0.
+        mnt->Mount(file.parent_path(), "/app0");
+        // Certain games may use /hostapp as well such as CUSA001100
+        mnt->Mount(file.parent_path(), "/hostapp");
+    }
 
     auto& game_info = Common::ElfInfo::Instance();
 
@@ -192,6 +219,7 @@ void Emulator::Run(const std::filesystem::path& file) {
     VideoCore::SetOutputDir(mount_captures_dir.generic_string(), id);
 
     // Initialize kernel and library facilities.
+    Core::InitCpuTopology();
     Libraries::Kernel::init_pthreads();
     Libraries::InitHLELibs(&linker->GetHLESymbols());
 
@@ -218,6 +246,11 @@ void Emulator::Run(const std::filesystem::path& file) {
         window->waitEvent();
     }
 
+    if (pkg) {
+        pkg->LogStats();
+    }
+    Common::Singleton<Core::FileSys::MntPoints>::Instance()->LogPathStats();
+    Common::Metrics::Dump();
     std::exit(0);
 }
 
@@ -25,7 +25,7 @@ public:
     Emulator();
     ~Emulator();
 
-    void Run(const std::filesystem::path& file);
+    void Run(const std::filesystem::path& path);
 
 private:
     void LoadSystemModules(const std::filesystem::path& file);
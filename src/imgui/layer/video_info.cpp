@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include "common/config.h"
+#include "common/metrics.h"
 #include "common/types.h"
 #include "imgui_internal.h"
 #include "video_info.h"
@@ -40,6 +41,19 @@ static void DrawAdvanced() {
 
     Text("Frame time: %.3f ms (%.1f FPS)", io.DeltaTime * 1000.0f, io.Framerate);
 
+    SeparatorText("Metrics");
+    for (const auto& counter : Common::Metrics::GetCounters()) {
+        Text("%s: %llu per frame (%llu total)", counter.name.c_str(),
+             static_cast<unsigned long long>(counter.frame_delta),
+             static_cast<unsigned long long>(counter.value));
+    }
+    for (const auto& histogram : Common::Metrics::GetHistograms()) {
+        Text("%s: %llu per frame (p50 %llu, p99 %llu)", histogram.name.c_str(),
+             static_cast<unsigned long long>(histogram.frame_count),
+             static_cast<unsigned long long>(histogram.p50),
+             static_cast<unsigned long long>(histogram.p99));
+    }
+
     SeparatorText("Frame graph");
     const float full_width = GetContentRegionAvail().x;
     { // Frame graph - inspired by
@@ -1,18 +1,68 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
 #include <fmt/core.h>
 #include "common/memory_patcher.h"
+#include "core/file_format/pkg.h"
 #include "emulator.h"
+#include "video_core/amdgpu/pm4_capture.h"
+
+static int ExtractPkg(const std::filesystem::path& pkg_path,
+                      const std::filesystem::path& install_dir) {
+    PKG pkg;
+    if (!pkg.Open(pkg_path)) {
+        fmt::print("Unable to open package {}\n", pkg_path.string());
+        return -1;
+    }
+    const auto extract_path = install_dir / pkg.GetTitleID();
+    std::string failreason;
+    if (!pkg.Extract(pkg_path, extract_path, failreason)) {
+        fmt::print("Unable to extract package: {}\n", failreason);
+        return -1;
+    }
+    const auto print_progress = [](const PKG::ExtractProgress& progress) {
+        fmt::print("\r{}/{} files, {:.1f}/{:.1f} MiB, {:.1f} MiB/s", progress.files_written,
+                   progress.num_files, progress.bytes_written / double(1_MB),
+                   progress.total_bytes / double(1_MB),
+                   progress.bytes_written / double(1_MB) / std::max(progress.seconds, 1e-3));
+        std::fflush(stdout);
+    };
+    if (!pkg.ExtractAllFiles(std::thread::hardware_concurrency(), print_progress)) {
+        fmt::print("\nExtraction failed\n");
+        return -1;
+    }
+    fmt::print("\nExtracted to {}\n", extract_path.string());
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     if (argc == 1) {
-        fmt::print("Usage: {} <elf or eboot.bin path>\n", argv[0]);
+        fmt::print("Usage: {} <elf, eboot.bin or pkg path>\n", argv[0]);
+        fmt::print("       {} --replay-pm4 <capture path> [loops]\n", argv[0]);
+        fmt::print("       {} --extract-pkg <pkg path> <install dir>\n", argv[0]);
         return -1;
     }
+    if (std::string_view{argv[1]} == "--replay-pm4") {
+        if (argc < 3) {
+            fmt::print("No capture specified\n");
+            return -1;
+        }
+        const u32 num_loops = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 1;
+        return AmdGpu::ReplayPm4Capture(argv[2], num_loops) ? 0 : -1;
+    }
+    if (std::string_view{argv[1]} == "--extract-pkg") {
+        if (argc < 4) {
+            fmt::print("No package or install directory specified\n");
+            return -1;
+        }
+        return ExtractPkg(argv[2], argv[3]);
+    }
     // check if eboot file exists
     if (!std::filesystem::exists(argv[1])) {
-        fmt::print("Eboot.bin file not found\n");
+        fmt::print("Eboot.bin or pkg file not found\n");
         return -1;
     }
 
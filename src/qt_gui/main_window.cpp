@@ -759,21 +759,17 @@ void MainWindow::InstallDragDropPkg(std::filesystem::path file, int pkgNum, int
             int nfiles = pkg.GetNumberOfFiles();
 
             if (nfiles > 0) {
-                QVector<int> indices;
-                for (int i = 0; i < nfiles; i++) {
-                    indices.append(i);
-                }
-
                 QProgressDialog dialog;
                 dialog.setWindowTitle(tr("PKG Extraction"));
                 dialog.setWindowModality(Qt::WindowModal);
                 QString extractmsg = QString(tr("Extracting PKG %1/%2")).arg(pkgNum).arg(nPkg);
                 dialog.setLabelText(extractmsg);
-                dialog.setAutoClose(true);
+                dialog.setAutoClose(false);
+                dialog.setAutoReset(false);
                 dialog.setRange(0, nfiles);
 
-                QFutureWatcher<void> futureWatcher;
-                connect(&futureWatcher, &QFutureWatcher<void>::finished, this, [=, this]() {
+                QFutureWatcher<bool> futureWatcher;
+                connect(&futureWatcher, &QFutureWatcher<bool>::finished, this, [=, this]() {
                     if (pkgNum == nPkg) {
                         QString path = QString::fromStdString(Config::getGameInstallDir());
                         QMessageBox extractMsgBox(this);
@@ -792,12 +788,29 @@ void MainWindow::InstallDragDropPkg(std::filesystem::path file, int pkgNum, int
                         extractMsgBox.exec();
                     }
                 });
-                connect(&dialog, &QProgressDialog::canceled, [&]() { futureWatcher.cancel(); });
-                connect(&futureWatcher, &QFutureWatcher<void>::progressValueChanged, &dialog,
-                        &QProgressDialog::setValue);
-                futureWatcher.setFuture(
-                    QtConcurrent::map(indices, [&](int index) { pkg.ExtractFiles(index); }));
+                connect(&futureWatcher, &QFutureWatcher<bool>::finished, &dialog,
+                        &QProgressDialog::accept);
+
+                std::stop_source stop_source;
+                connect(&dialog, &QProgressDialog::canceled,
+                        [&]() { stop_source.request_stop(); });
+                const auto on_progress = [&](const PKG::ExtractProgress& progress) {
+                    const double speed = progress.bytes_written / double(1_MB) /
+                                         std::max(progress.seconds, 1e-3);
+                    QMetaObject::invokeMethod(&dialog, [&dialog, extractmsg, progress, speed] {
+                        dialog.setMaximum(progress.num_files);
+                        dialog.setValue(progress.files_written);
+                        dialog.setLabelText(extractmsg + "\n" +
+                                            QString(tr("%1 MB/s")).arg(speed, 0, 'f', 1));
+                    });
+                };
+                futureWatcher.setFuture(QtConcurrent::run([&] {
+                    return pkg.ExtractAllFiles(std::thread::hardware_concurrency(), on_progress,
+                                               stop_source.get_token());
+                }));
                 dialog.exec();
+                // The extraction references locals of this function, let it wind down.
+                futureWatcher.waitForFinished();
             }
         }
     } else {
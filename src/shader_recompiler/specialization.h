@@ -47,39 +47,47 @@ struct StageSpecialization {
     boost::container::small_vector<TextureBufferSpecialization, 8> tex_buffers;
     boost::container::small_vector<ImageSpecialization, 16> images;
     Backend::Bindings start{};
+    u64 fingerprint{};
 
     explicit StageSpecialization(const Shader::Info& info_, RuntimeInfo runtime_info_,
                                  Backend::Bindings start_)
-        : info{&info_}, runtime_info{runtime_info_}, start{start_} {
+        : info{&info_}, runtime_info{runtime_info_}, start{start_},
+          fingerprint{HashRuntimeInfo(runtime_info, start)} {
         u32 binding{};
-        ForEachSharp(binding, buffers, info->buffers,
-                     [](auto& spec, const auto& desc, AmdGpu::Buffer sharp) {
-                         spec.stride = sharp.GetStride();
-                         spec.is_storage = desc.IsStorage(sharp);
-                     });
-        ForEachSharp(binding, tex_buffers, info->texture_buffers,
-                     [](auto& spec, const auto& desc, AmdGpu::Buffer sharp) {
-                         spec.is_integer = AmdGpu::IsInteger(sharp.GetNumberFmt());
-                     });
-        ForEachSharp(binding, images, info->images,
-                     [](auto& spec, const auto& desc, AmdGpu::Image sharp) {
-                         spec.type = sharp.IsPartialCubemap() ? AmdGpu::ImageType::Color2DArray
-                                                              : sharp.GetType();
-                         spec.is_integer = AmdGpu::IsInteger(sharp.GetNumberFmt());
-                     });
+        ForEachSharp(binding, buffers, info->buffers);
+        ForEachSharp(binding, tex_buffers, info->texture_buffers);
+        ForEachSharp(binding, images, info->images);
     }
 
-    void ForEachSharp(u32& binding, auto& spec_list, auto& desc_list, auto&& func) {
-        for (const auto& desc : desc_list) {
-            auto& spec = spec_list.emplace_back();
-            const auto sharp = desc.GetSharp(*info);
-            if (!sharp) {
-                binding++;
-                continue;
+    /**
+     * Computes the fingerprint a specialization would have for the given state without
+     * building it. Specializations that compare equal usually share a fingerprint, with the
+     * exception of resources that are unbound now but were bound when a permutation was made.
+     */
+    static u64 Fingerprint(const Shader::Info& info, const RuntimeInfo& runtime_info,
+                           Backend::Bindings start) {
+        u64 hash = HashRuntimeInfo(runtime_info, start);
+        const auto hash_sharps = [&](const auto& desc_list) {
+            for (const auto& desc : desc_list) {
+                const auto sharp = desc.GetSharp(info);
+                hash = HashCombine(hash, sharp ? Pack(MakeSpec(desc, sharp)) : NullResource);
             }
-            bitset.set(binding++);
-            func(spec, desc, sharp);
+        };
+        hash_sharps(info.buffers);
+        hash_sharps(info.texture_buffers);
+        hash_sharps(info.images);
+        return hash;
+    }
+
+    /// Equivalent to comparing against a specialization built from the given state and the
+    /// current sharps of the program, without building it.
+    bool Matches(const RuntimeInfo& runtime_info_, Backend::Bindings start_) const {
+        if (start != start_ || runtime_info != runtime_info_) {
+            return false;
         }
+        return MatchesSharps(buffers, info->buffers) &&
+               MatchesSharps(tex_buffers, info->texture_buffers) &&
+               MatchesSharps(images, info->images);
     }
 
     bool operator==(const StageSpecialization& other) const {
@@ -107,6 +115,97 @@ struct StageSpecialization {
         }
         return true;
     }
+
+private:
+    static constexpr u64 NullResource = ~0ULL;
+
+    static constexpr u64 HashCombine(u64 seed, u64 value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+
+    static BufferSpecialization MakeSpec(const BufferResource& desc, AmdGpu::Buffer sharp) {
+        BufferSpecialization spec{};
+        spec.stride = sharp.GetStride();
+        spec.is_storage = desc.IsStorage(sharp);
+        return spec;
+    }
+
+    static TextureBufferSpecialization MakeSpec(const TextureBufferResource&,
+                                                AmdGpu::Buffer sharp) {
+        return {.is_integer = AmdGpu::IsInteger(sharp.GetNumberFmt())};
+    }
+
+    static ImageSpecialization MakeSpec(const ImageResource&, AmdGpu::Image sharp) {
+        return {
+            .type = sharp.IsPartialCubemap() ? AmdGpu::ImageType::Color2DArray : sharp.GetType(),
+            .is_integer = AmdGpu::IsInteger(sharp.GetNumberFmt()),
+        };
+    }
+
+    static u64 Pack(const BufferSpecialization& spec) {
+        return spec.stride | (u64(spec.is_storage) << 14);
+    }
+
+    static u64 Pack(const TextureBufferSpecialization& spec) {
+        return spec.is_integer;
+    }
+
+    static u64 Pack(const ImageSpecialization& spec) {
+        return (u64(spec.type) << 1) | spec.is_integer;
+    }
+
+    /// Hashes the per-stage runtime state and bindings. The fingerprint only narrows down the
+    /// candidate permutations, Matches and operator== still decide whether one can be used.
+    static u64 HashRuntimeInfo(const RuntimeInfo& info, Backend::Bindings start) {
+        u64 hash = HashCombine(start.unified, (u64(start.buffer) << 32) | start.user_data);
+        switch (info.stage) {
+        case Stage::Fragment:
+            for (const auto swizzle : info.fs_info.mrt_swizzles) {
+                hash = HashCombine(hash, u64(swizzle));
+            }
+            for (const auto& input : info.fs_info.inputs) {
+                hash = HashCombine(hash, input.param_index | (u64(input.is_default) << 8) |
+                                             (u64(input.is_flat) << 9) |
+                                             (u64(input.default_value) << 16));
+            }
+            return HashCombine(hash, info.fs_info.inputs.size());
+        case Stage::Vertex:
+            return HashCombine(hash, info.vs_info.emulate_depth_negative_one_to_one);
+        case Stage::Compute:
+            for (u32 i = 0; i < 3; i++) {
+                hash = HashCombine(hash, info.cs_info.workgroup_size[i]);
+                hash = HashCombine(hash, info.cs_info.tgid_enable[i]);
+            }
+            return hash;
+        default:
+            return hash;
+        }
+    }
+
+    void ForEachSharp(u32& binding, auto& spec_list, const auto& desc_list) {
+        for (const auto& desc : desc_list) {
+            auto& spec = spec_list.emplace_back();
+            const auto sharp = desc.GetSharp(*info);
+            if (!sharp) {
+                binding++;
+                fingerprint = HashCombine(fingerprint, NullResource);
+                continue;
+            }
+            bitset.set(binding++);
+            spec = MakeSpec(desc, sharp);
+            fingerprint = HashCombine(fingerprint, Pack(spec));
+        }
+    }
+
+    bool MatchesSharps(const auto& spec_list, const auto& desc_list) const {
+        for (u32 i = 0; i < spec_list.size(); i++) {
+            const auto sharp = desc_list[i].GetSharp(*info);
+            if (sharp && spec_list[i] != MakeSpec(desc_list[i], sharp)) {
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 } // namespace Shader
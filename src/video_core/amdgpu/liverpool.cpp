@@ -1,13 +1,20 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <bit>
+#include <chrono>
+
 #include "common/assert.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/elf_info.h"
+#include "common/path_util.h"
 #include "common/polyfill_thread.h"
 #include "common/thread.h"
+#include "core/cpu_topology.h"
 #include "core/libraries/videoout/driver.h"
 #include "video_core/amdgpu/liverpool.h"
+#include "video_core/amdgpu/pm4_capture.h"
 #include "video_core/amdgpu/pm4_cmds.h"
 #include "video_core/renderdoc.h"
 #include "video_core/renderer_vulkan/vk_rasterizer.h"
@@ -34,7 +41,41 @@ static std::span<const u32> NextPacket(std::span<const u32> span, size_t offset)
     return span.subspan(offset);
 }
 
+/// Accumulates the time spent processing a packet when replay statistics are gathered.
+class PacketTimer {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    explicit PacketTimer(Pm4Stats* stats_, PM4ItOpcode opcode_) : stats{stats_}, opcode{opcode_} {
+        if (stats) {
+            start = Clock::now();
+        }
+    }
+
+    ~PacketTimer() {
+        if (stats) {
+            const auto index = static_cast<u8>(opcode);
+            const auto elapsed = Clock::now() - start;
+            ++stats->num_packets[index];
+            stats->time_ns[index] +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+    }
+
+private:
+    Pm4Stats* stats;
+    PM4ItOpcode opcode;
+    Clock::time_point start{};
+};
+
 Liverpool::Liverpool() {
+    if (Config::capturePM4()) {
+        const auto serial = Common::ElfInfo::Instance().GameSerial();
+        const auto path = Common::FS::GetUserPath(Common::FS::PathType::PM4Dir) /
+                          fmt::format("{}.pm4", serial.empty() ? "capture" : serial);
+        capture = std::make_unique<Pm4CaptureWriter>(path);
+        capture->RecordRegisters(regs.reg_array);
+    }
     process_thread = std::jthread{std::bind_front(&Liverpool::Process, this)};
 }
 
@@ -45,21 +86,27 @@ Liverpool::~Liverpool() {
 
 void Liverpool::Process(std::stop_token stoken) {
     Common::SetCurrentThreadName("GPU_CommandProcessor");
+    Core::PinServiceThread();
 
-    while (!stoken.stop_requested()) {
-        {
+    // Announce the sleep before checking for work one last time. A producer either sees the flag
+    // and wakes us up, or pushed early enough for the check to see its submission.
+    const auto sleep_until = [&](auto&& pred) {
+        processor_sleeping.store(true);
+        if (!pred()) {
             std::unique_lock lk{submit_mutex};
-            Common::CondvarWait(submit_cv, lk, stoken,
-                                [this] { return num_commands || num_submits || submit_done; });
+            Common::CondvarWait(submit_cv, lk, stoken, pred);
         }
+        processor_sleeping.store(false);
+    };
+
+    while (!stoken.stop_requested()) {
+        sleep_until([this] { return num_commands || ready_queues.load() != 0 || submit_done; });
         if (stoken.stop_requested()) {
             break;
         }
 
         VideoCore::StartCapture();
 
-        int qid = -1;
-
         while (num_submits || num_commands) {
 
             // Process incoming commands with high priority
@@ -77,29 +124,58 @@ void Liverpool::Process(std::stop_token stoken) {
                 --num_commands;
             }
 
-            qid = (qid + 1) % NumTotalQueues;
+            // Visit every queue that may have work once, in index order.
+            for (u64 pending = ready_queues.load(); pending != 0 && !num_commands;
+                 pending &= pending - 1) {
+                const u32 qid = std::countr_zero(pending);
+                const u64 queue_bit = 1ULL << qid;
+                auto& queue = mapped_queues[qid];
+
+                Submission* submit = queue.submits.Front();
+                if (!submit) {
+                    // A producer may have pushed after the check, so look again once the bit is
+                    // cleared to avoid losing its submission.
+                    ready_queues.fetch_and(~queue_bit);
+                    if (!queue.submits.Empty()) {
+                        ready_queues.fetch_or(queue_bit);
+                    }
+                    continue;
+                }
 
-            auto& queue = mapped_queues[qid];
+                if (submit->submit_time != std::chrono::steady_clock::time_point{}) {
+                    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - submit->submit_time);
+                    submit->submit_time = {};
+                    TracyPlot("GPU submit latency (us)", latency.count() / 1000.0);
+                    if (replay_stats) {
+                        replay_stats->submit_latency_ns += latency.count();
+                    }
+                }
 
-            Task::Handle task{};
-            {
-                std::scoped_lock lock{queue.m_access};
-                if (queue.submits.empty()) {
-                    continue;
+                if (capture) {
+                    capture->BeginSubmission(submit->capture_index);
                 }
-                task = queue.submits.front();
-            }
-            task.resume();
+                const auto task = submit->handle;
+                task.resume();
 
-            if (task.done()) {
-                task.destroy();
+                if (task.done()) {
+                    task.destroy();
+                    queue.submits.Pop();
 
-                std::scoped_lock lock{queue.m_access};
-                queue.submits.pop();
+                    if (--num_submits == 0) {
+                        std::scoped_lock lock{submit_mutex};
+                        idle_cv.notify_all();
+                    }
+                }
+            }
 
-                --num_submits;
-                std::scoped_lock lock2{submit_mutex};
-                submit_cv.notify_all();
+            if (num_submits && !num_commands && ready_queues.load() == 0) {
+                // A submission was counted but isn't pushed to its queue yet, sleep until it is
+                // instead of spinning.
+                sleep_until([this] { return num_commands || ready_queues.load() != 0; });
+                if (stoken.stop_requested()) {
+                    break;
+                }
             }
         }
 
@@ -142,6 +218,9 @@ Liverpool::Task Liverpool::ProcessCeUpdate(std::span<const u32> ccb) {
         }
         case PM4ItOpcode::DumpConstRam: {
             const auto* dump_const = reinterpret_cast<const PM4DumpConstRam*>(header);
+            if (capture) {
+                capture->RecordMemory(dump_const->Address<void*>(), dump_const->Size());
+            }
             memcpy(dump_const->Address<void*>(),
                    cblock.constants_heap.data() + dump_const->Offset(), dump_const->Size());
             break;
@@ -203,6 +282,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
         case 3:
             const u32 count = header->type3.NumWords();
             const PM4ItOpcode opcode = header->type3.opcode;
+            const PacketTimer timer{replay_stats, opcode};
             switch (opcode) {
             case PM4ItOpcode::Nop: {
                 const auto* nop = reinterpret_cast<const PM4CmdNop*>(header);
@@ -242,6 +322,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
             }
             case PM4ItOpcode::ClearState: {
                 regs.SetDefaults();
+                dirty_state |= DirtyState::All;
                 break;
             }
             case PM4ItOpcode::SetConfigReg: {
@@ -257,6 +338,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 const auto* payload = reinterpret_cast<const u32*>(header + 2);
 
                 std::memcpy(&regs.reg_array[reg_addr], payload, (count - 1) * sizeof(u32));
+                dirty_state |= DirtyState::All;
 
                 // In the case of HW, render target memory has alignment as color block operates on
                 // tiles. There is no information of actual resource extents stored in CB context
@@ -334,6 +416,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 const auto* set_data = reinterpret_cast<const PM4CmdSetData*>(header);
                 std::memcpy(&regs.reg_array[UconfigRegWordOffset + set_data->reg_offset],
                             header + 2, (count - 1) * sizeof(u32));
+                dirty_state |= DirtyState::PipelineKey;
                 break;
             }
             case PM4ItOpcode::IndexType: {
@@ -350,7 +433,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 regs.draw_initiator = draw_index->draw_initiator;
                 if (rasterizer) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(fmt::format("dcb:{}:DrawIndex2", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DrawIndex2", cmd_address);
                     rasterizer->Draw(true);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -364,8 +447,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 regs.draw_initiator = draw_index_off->draw_initiator;
                 if (rasterizer) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(
-                        fmt::format("dcb:{}:DrawIndexOffset2", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DrawIndexOffset2", cmd_address);
                     rasterizer->Draw(true, draw_index_off->index_offset);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -377,7 +459,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 regs.draw_initiator = draw_index->draw_initiator;
                 if (rasterizer) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(fmt::format("dcb:{}:DrawIndexAuto", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DrawIndexAuto", cmd_address);
                     rasterizer->Draw(false);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -390,7 +472,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 const auto size = sizeof(PM4CmdDrawIndirect::DrawInstancedArgs);
                 if (rasterizer) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(fmt::format("dcb:{}:DrawIndirect", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DrawIndirect", cmd_address);
                     rasterizer->DrawIndirect(false, ib_address, offset, size);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -404,8 +486,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 const auto size = sizeof(PM4CmdDrawIndexIndirect::DrawIndexInstancedArgs);
                 if (rasterizer) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(
-                        fmt::format("dcb:{}:DrawIndexIndirect", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DrawIndexIndirect", cmd_address);
                     rasterizer->DrawIndirect(true, ib_address, offset, size);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -419,7 +500,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 regs.cs_program.dispatch_initiator = dispatch_direct->dispatch_initiator;
                 if (rasterizer && (regs.cs_program.dispatch_initiator & 1)) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(fmt::format("dcb:{}:Dispatch", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:Dispatch", cmd_address);
                     rasterizer->DispatchDirect();
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -433,8 +514,7 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 const auto size = sizeof(PM4CmdDispatchIndirect::GroupDimensions);
                 if (rasterizer && (regs.cs_program.dispatch_initiator & 1)) {
                     const auto cmd_address = reinterpret_cast<const void*>(header);
-                    rasterizer->ScopeMarkerBegin(
-                        fmt::format("dcb:{}:DispatchIndirect", cmd_address));
+                    rasterizer->ScopeMarkerBegin("dcb:{}:DispatchIndirect", cmd_address);
                     rasterizer->DispatchIndirect(ib_address, offset, size);
                     rasterizer->ScopeMarkerEnd();
                 }
@@ -468,6 +548,9 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
             }
             case PM4ItOpcode::EventWriteEos: {
                 const auto* event_eos = reinterpret_cast<const PM4CmdEventWriteEos*>(header);
+                if (capture) {
+                    capture->RecordMemory(event_eos->Address(), sizeof(u32));
+                }
                 event_eos->SignalFence();
                 if (event_eos->command == PM4CmdEventWriteEos::Command::GdsStore) {
                     ASSERT(event_eos->size == 1);
@@ -481,12 +564,16 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
             }
             case PM4ItOpcode::EventWriteEop: {
                 const auto* event_eop = reinterpret_cast<const PM4CmdEventWriteEop*>(header);
+                if (capture && event_eop->data_sel != DataSelect::None) {
+                    capture->RecordMemory(event_eop->Address<u64>(), sizeof(u64));
+                }
                 event_eop->SignalFence();
                 break;
             }
             case PM4ItOpcode::DmaData: {
                 const auto* dma_data = reinterpret_cast<const PM4DmaData*>(header);
-                if (dma_data->src_sel == DmaDataSrc::Data && dma_data->dst_sel == DmaDataDst::Gds) {
+                if (rasterizer && dma_data->src_sel == DmaDataSrc::Data &&
+                    dma_data->dst_sel == DmaDataDst::Gds) {
                     rasterizer->InlineDataToGds(dma_data->dst_addr_lo, dma_data->data);
                 }
                 break;
@@ -496,6 +583,9 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 ASSERT(write_data->dst_sel.Value() == 2 || write_data->dst_sel.Value() == 5);
                 const u32 data_size = (header->type3.count.Value() - 2) * 4;
                 u64* address = write_data->Address<u64*>();
+                if (capture) {
+                    capture->RecordMemory(address, data_size);
+                }
                 if (!write_data->wr_one_addr.Value()) {
                     std::memcpy(address, write_data->data, data_size);
                 } else {
@@ -515,6 +605,13 @@ Liverpool::Task Liverpool::ProcessGraphics(std::span<const u32> dcb, std::span<c
                 // there are no other submits to yield to we can sleep the thread
                 // instead and allow other tasks to run.
                 const u64* wait_addr = wait_reg_mem->Address<u64*>();
+                if (capture) {
+                    capture->RecordMemory(wait_addr, sizeof(u64));
+                }
+                if (replay_stats) {
+                    // Nothing is going to signal the label during replay.
+                    break;
+                }
                 if (vo_port->IsVoLabel(wait_addr) && num_submits == 1) {
                     vo_port->WaitVoLabel([&] { return wait_reg_mem->Test(); });
                 }
@@ -575,6 +672,7 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
 
         const u32 count = header->type3.NumWords();
         const PM4ItOpcode opcode = header->type3.opcode;
+        const PacketTimer timer{replay_stats, opcode};
         const auto* it_body = reinterpret_cast<const u32*>(header) + 1;
         switch (opcode) {
         case PM4ItOpcode::Nop: {
@@ -583,6 +681,10 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
         }
         case PM4ItOpcode::IndirectBuffer: {
             const auto* indirect_buffer = reinterpret_cast<const PM4CmdIndirectBuffer*>(header);
+            if (capture) {
+                capture->RecordMemory(indirect_buffer->Address<const u32>(),
+                                      indirect_buffer->ib_size * sizeof(u32));
+            }
             auto task = ProcessCompute(
                 {indirect_buffer->Address<const u32>(), indirect_buffer->ib_size}, vqid);
             while (!task.handle.done()) {
@@ -611,7 +713,7 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
             regs.cs_program.dispatch_initiator = dispatch_direct->dispatch_initiator;
             if (rasterizer && (regs.cs_program.dispatch_initiator & 1)) {
                 const auto cmd_address = reinterpret_cast<const void*>(header);
-                rasterizer->ScopeMarkerBegin(fmt::format("acb[{}]:{}:Dispatch", vqid, cmd_address));
+                rasterizer->ScopeMarkerBegin("acb[{}]:{}:Dispatch", vqid, cmd_address);
                 rasterizer->DispatchDirect();
                 rasterizer->ScopeMarkerEnd();
             }
@@ -621,6 +723,9 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
             const auto* write_data = reinterpret_cast<const PM4CmdWriteData*>(header);
             ASSERT(write_data->dst_sel.Value() == 2 || write_data->dst_sel.Value() == 5);
             const u32 data_size = (header->type3.count.Value() - 2) * 4;
+            if (capture) {
+                capture->RecordMemory(write_data->Address<void*>(), data_size);
+            }
             if (!write_data->wr_one_addr.Value()) {
                 std::memcpy(write_data->Address<void*>(), write_data->data, data_size);
             } else {
@@ -631,6 +736,12 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
         case PM4ItOpcode::WaitRegMem: {
             const auto* wait_reg_mem = reinterpret_cast<const PM4CmdWaitRegMem*>(header);
             ASSERT(wait_reg_mem->engine.Value() == PM4CmdWaitRegMem::Engine::Me);
+            if (capture) {
+                capture->RecordMemory(wait_reg_mem->Address(), sizeof(u64));
+            }
+            if (replay_stats) {
+                break;
+            }
             while (!wait_reg_mem->Test()) {
                 mapped_queues[vqid].cs_state = regs.cs_program;
                 TracyFiberLeave;
@@ -642,6 +753,9 @@ Liverpool::Task Liverpool::ProcessCompute(std::span<const u32> acb, int vqid) {
         }
         case PM4ItOpcode::ReleaseMem: {
             const auto* release_mem = reinterpret_cast<const PM4CmdReleaseMem*>(header);
+            if (capture && release_mem->data_sel != DataSelect::None) {
+                capture->RecordMemory(release_mem->Address<u64>(), sizeof(u64));
+            }
             release_mem->SignalFence(Platform::InterruptId::Compute0RelMem); // <---
             break;
         }
@@ -693,36 +807,44 @@ std::pair<std::span<const u32>, std::span<const u32>> Liverpool::CopyCmdBuffers(
 }
 
 void Liverpool::SubmitGfx(std::span<const u32> dcb, std::span<const u32> ccb) {
-    auto& queue = mapped_queues[GfxQueueId];
-
     if (Config::copyGPUCmdBuffers()) {
         std::tie(dcb, ccb) = CopyCmdBuffers(dcb, ccb);
     }
+    const u32 capture_index = capture ? capture->RecordGraphics(dcb, ccb) : 0;
 
     auto task = ProcessGraphics(dcb, ccb);
-    {
-        std::scoped_lock lock{queue.m_access};
-        queue.submits.emplace(task.handle);
-    }
-
-    std::scoped_lock lk{submit_mutex};
-    ++num_submits;
-    submit_cv.notify_one();
+    PushSubmission(GfxQueueId, task.handle, capture_index);
 }
 
 void Liverpool::SubmitAsc(u32 vqid, std::span<const u32> acb) {
     ASSERT_MSG(vqid >= 0 && vqid < NumTotalQueues, "Invalid virtual ASC queue index");
-    auto& queue = mapped_queues[vqid];
+    const u32 capture_index = capture ? capture->RecordCompute(vqid, acb) : 0;
 
     const auto& task = ProcessCompute(acb, vqid);
-    {
-        std::scoped_lock lock{queue.m_access};
-        queue.submits.emplace(task.handle);
+    PushSubmission(vqid, task.handle, capture_index);
+}
+
+void Liverpool::PushSubmission(u32 qid, Task::Handle handle, u32 capture_index) {
+    // Count the submission first so that the command processor can never observe it before
+    // the counter was incremented.
+    const u32 pending = ++num_submits;
+
+    mapped_queues[qid].submits.Push(handle, capture_index);
+    ready_queues.fetch_or(1ULL << qid);
+
+    TracyPlot("GPU pending submits", static_cast<s64>(pending));
+    if (replay_stats) {
+        ++replay_stats->num_submits;
+        replay_stats->max_pending_submits =
+            std::max<u64>(replay_stats->max_pending_submits, pending);
     }
 
-    std::scoped_lock lk{submit_mutex};
-    ++num_submits;
-    submit_cv.notify_one();
+    // Only the first submission after the command processor went to sleep wakes it up, the
+    // following ones of a burst find the flag cleared.
+    if (processor_sleeping.exchange(false)) {
+        std::scoped_lock lk{submit_mutex};
+        submit_cv.notify_one();
+    }
 }
 
 } // namespace AmdGpu
@@ -4,9 +4,12 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <coroutine>
 #include <exception>
+#include <memory>
 #include <mutex>
 #include <span>
 #include <thread>
@@ -15,6 +18,7 @@
 
 #include "common/assert.h"
 #include "common/bit_field.h"
+#include "common/enum.h"
 #include "common/polyfill_thread.h"
 #include "common/types.h"
 #include "common/unique_function.h"
@@ -32,6 +36,18 @@ struct VideoOutPort;
 
 namespace AmdGpu {
 
+class Pm4CaptureWriter;
+struct Pm4Stats;
+
+/// Host state derived from the register file that has to be recomputed after register writes.
+enum class DirtyState : u32 {
+    None = 0,
+    PipelineKey = 1 << 0,  ///< Fixed function part of the graphics pipeline key
+    DynamicState = 1 << 1, ///< Viewports, scissors and other dynamic draw state
+    All = PipelineKey | DynamicState,
+};
+DECLARE_ENUM_FLAG_OPERATORS(DirtyState)
+
 #define GFX6_3D_REG_INDEX(field_name) (offsetof(AmdGpu::Liverpool::Regs, field_name) / sizeof(u32))
 
 #define CONCAT2(x, y) DO_CONCAT2(x, y)
@@ -1043,6 +1059,7 @@ struct Liverpool {
     };
 
     Regs regs{};
+    DirtyState dirty_state{DirtyState::All};
 
     // See for a comment in context reg parsing code
     union CbDbExtent {
@@ -1076,7 +1093,7 @@ public:
 
     void WaitGpuIdle() noexcept {
         std::unique_lock lk{submit_mutex};
-        submit_cv.wait(lk, [this] { return num_submits == 0; });
+        idle_cv.wait(lk, [this] { return num_submits == 0; });
     }
 
     bool IsGpuIdle() const {
@@ -1091,6 +1108,12 @@ public:
         rasterizer = rasterizer_;
     }
 
+    /// Switches the command processor to headless replay of a capture. Waits on guest memory
+    /// are considered satisfied and per packet statistics are accumulated into stats.
+    void SetReplayStats(Pm4Stats* stats) {
+        replay_stats = stats;
+    }
+
     void SendCommand(Common::UniqueFunction<void>&& func) {
         std::scoped_lock lk{submit_mutex};
         command_queue.emplace(std::move(func));
@@ -1148,18 +1171,103 @@ private:
 
     void Process(std::stop_token stoken);
 
+    struct Submission {
+        Task::Handle handle;
+        /// Time of submission, cleared once the command processor starts executing it.
+        std::chrono::steady_clock::time_point submit_time;
+        u32 capture_index; ///< Index of the submission in the PM4 capture, if one is recorded
+    };
+
+    /**
+     * Ring of pending submissions of a queue. Producers claim entries with a compare-exchange
+     * and the command processor consumes them, neither side takes a lock. Every entry carries a
+     * sequence number telling whether it is free for the producer of a given position or ready
+     * for the consumer.
+     */
+    class SubmissionRing {
+        static constexpr u32 Capacity = 1024;
+
+        struct Entry {
+            std::atomic<u32> sequence;
+            Submission submission;
+        };
+
+    public:
+        SubmissionRing() : entries{std::make_unique<Entry[]>(Capacity)} {
+            for (u32 i = 0; i < Capacity; i++) {
+                entries[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        /// Appends a submission, waiting for the command processor if the ring is full.
+        void Push(Task::Handle handle, u32 capture_index) {
+            u32 write = write_index.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& entry = entries[write % Capacity];
+                const u32 sequence = entry.sequence.load(std::memory_order_acquire);
+                const s32 diff = static_cast<s32>(sequence - write);
+                if (diff == 0) {
+                    if (write_index.compare_exchange_weak(write, write + 1,
+                                                          std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    // The entry still holds the submission from a lap ago.
+                    entry.sequence.wait(sequence, std::memory_order_acquire);
+                    write = write_index.load(std::memory_order_relaxed);
+                } else {
+                    write = write_index.load(std::memory_order_relaxed);
+                }
+            }
+            auto& entry = entries[write % Capacity];
+            entry.submission = {handle, std::chrono::steady_clock::now(), capture_index};
+            entry.sequence.store(write + 1, std::memory_order_release);
+        }
+
+        /// Returns the oldest pending submission or nullptr. Only called by the consumer.
+        [[nodiscard]] Submission* Front() {
+            auto& entry = entries[read_index % Capacity];
+            if (entry.sequence.load(std::memory_order_acquire) != read_index + 1) {
+                return nullptr;
+            }
+            return &entry.submission;
+        }
+
+        /// Releases the oldest pending submission. Only called by the consumer.
+        void Pop() {
+            auto& entry = entries[read_index % Capacity];
+            entry.sequence.store(read_index + Capacity, std::memory_order_release);
+            entry.sequence.notify_all();
+            ++read_index;
+        }
+
+        /// Only called by the consumer.
+        [[nodiscard]] bool Empty() const {
+            return entries[read_index % Capacity].sequence.load(std::memory_order_acquire) !=
+                   read_index + 1;
+        }
+
+    private:
+        std::unique_ptr<Entry[]> entries;
+        u32 read_index{};
+        alignas(64) std::atomic<u32> write_index{};
+    };
+
     struct GpuQueue {
         std::mutex m_access{};
         std::atomic<u32> dcb_buffer_offset;
         std::atomic<u32> ccb_buffer_offset;
         std::vector<u32> dcb_buffer;
         std::vector<u32> ccb_buffer;
-        std::queue<Task::Handle> submits{};
+        SubmissionRing submits{};
         ComputeProgram cs_state{};
         VAddr indirect_args_addr{};
     };
     std::array<GpuQueue, NumTotalQueues> mapped_queues{};
 
+    /// Enqueues a task on a queue and wakes up the command processor if it sleeps.
+    void PushSubmission(u32 qid, Task::Handle handle, u32 capture_index);
+
     struct ConstantEngine {
         void Reset() {
             ce_count = 0;
@@ -1180,12 +1288,19 @@ private:
 
     Vulkan::Rasterizer* rasterizer{};
     Libraries::VideoOut::VideoOutPort* vo_port{};
+    std::unique_ptr<Pm4CaptureWriter> capture;
+    Pm4Stats* replay_stats{};
     std::jthread process_thread{};
     std::atomic<u32> num_submits{};
+    std::atomic<u64> ready_queues{}; ///< Bitmask of queues that may have pending submissions
     std::atomic<u32> num_commands{};
     std::atomic<bool> submit_done{};
+    /// Set while the command processor is about to sleep or sleeps on submit_cv, so that only
+    /// the first submission pushed meanwhile has to wake it up.
+    std::atomic<bool> processor_sleeping{};
     std::mutex submit_mutex;
-    std::condition_variable_any submit_cv;
+    std::condition_variable_any submit_cv; ///< Wakes up the command processor
+    std::condition_variable idle_cv;       ///< Signaled once every submission was executed
     std::queue<Common::UniqueFunction<void>> command_queue{};
 };
 
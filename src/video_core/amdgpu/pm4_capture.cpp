@@ -0,0 +1,317 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <unordered_set>
+#include <fmt/core.h>
+#include <magic_enum.hpp>
+#include <xxhash.h>
+
+#include "common/alignment.h"
+#include "common/assert.h"
+#include "common/div_ceil.h"
+#include "common/logging/log.h"
+#include "core/address_space.h"
+#include "video_core/amdgpu/liverpool.h"
+#include "video_core/amdgpu/pm4_capture.h"
+#include "video_core/amdgpu/pm4_opcodes.h"
+
+namespace AmdGpu {
+
+namespace {
+
+constexpr u32 CaptureMagic = 0x43344D50; // PM4C
+constexpr u32 CaptureVersion = 2;
+
+enum class ChunkType : u32 {
+    Registers,
+    Memory,
+    Graphics,
+    Compute,
+};
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+};
+
+struct ChunkHeader {
+    ChunkType type;
+    /// Number of DCB dwords for graphics, queue index for compute and index of the executing
+    /// submission for memory.
+    u32 arg;
+    u64 size; ///< Size of the payload, which is padded to 8 bytes in the file
+};
+static_assert(sizeof(ChunkHeader) == 16);
+
+} // Anonymous namespace
+
+Pm4CaptureWriter::Pm4CaptureWriter(const std::filesystem::path& path)
+    : file{path, Common::FS::FileAccessMode::Write} {
+    if (!file.IsOpen()) {
+        LOG_ERROR(Render_Vulkan, "Failed to create PM4 capture {}", path.string());
+        return;
+    }
+    file.WriteObject(FileHeader{CaptureMagic, CaptureVersion});
+    LOG_INFO(Render_Vulkan, "Capturing PM4 submissions to {}", path.string());
+}
+
+Pm4CaptureWriter::~Pm4CaptureWriter() = default;
+
+void Pm4CaptureWriter::RecordRegisters(std::span<const u32> regs) {
+    std::scoped_lock lock{mutex};
+    WriteChunk(static_cast<u32>(ChunkType::Registers), 0, std::as_bytes(regs), {});
+}
+
+u32 Pm4CaptureWriter::RecordGraphics(std::span<const u32> dcb, std::span<const u32> ccb) {
+    std::scoped_lock lock{mutex};
+    WriteChunk(static_cast<u32>(ChunkType::Graphics), static_cast<u32>(dcb.size()),
+               std::as_bytes(dcb), std::as_bytes(ccb));
+    return num_submissions++;
+}
+
+u32 Pm4CaptureWriter::RecordCompute(u32 vqid, std::span<const u32> acb) {
+    std::scoped_lock lock{mutex};
+    WriteChunk(static_cast<u32>(ChunkType::Compute), vqid, std::as_bytes(acb), {});
+    return num_submissions++;
+}
+
+void Pm4CaptureWriter::BeginSubmission(u32 index) {
+    std::scoped_lock lock{mutex};
+    current_submission = index;
+}
+
+void Pm4CaptureWriter::RecordMemory(const void* address, size_t size) {
+    const auto addr = reinterpret_cast<VAddr>(address);
+    if (addr == 0 || size == 0) {
+        return;
+    }
+    std::scoped_lock lock{mutex};
+    auto [it, is_new] = recorded_ranges.try_emplace(addr, RecordedRange{});
+    // Keep storing the largest size seen, the range was accessible with it before.
+    size = std::max(size, it->second.size);
+    const u64 hash = XXH3_64bits(address, size);
+    if (!is_new && it->second.size == size && it->second.hash == hash) {
+        return;
+    }
+    it.value() = {size, hash};
+    const u64 addr64 = addr;
+    WriteChunk(static_cast<u32>(ChunkType::Memory), current_submission,
+               std::as_bytes(std::span{&addr64, 1}),
+               std::span{static_cast<const std::byte*>(address), size});
+}
+
+void Pm4CaptureWriter::WriteChunk(u32 type, u32 arg, std::span<const std::byte> first,
+                                  std::span<const std::byte> second) {
+    if (!file.IsOpen()) {
+        return;
+    }
+    const u64 size = first.size() + second.size();
+    file.WriteObject(ChunkHeader{static_cast<ChunkType>(type), arg, size});
+    file.WriteSpan(first);
+    file.WriteSpan(second);
+    static constexpr std::array<std::byte, 8> Padding{};
+    file.WriteSpan(std::span{Padding}.first(Common::AlignUp(size, 8) - size));
+}
+
+namespace {
+
+struct Submission {
+    ChunkType type;
+    u32 vqid;
+    std::span<const u32> dcb;
+    std::span<const u32> ccb;
+};
+
+struct MemoryRange {
+    VAddr address;
+    std::span<const u8> data;
+    u32 submission; ///< Submission that was executing when the range was recorded
+};
+
+void Restore(const MemoryRange& range) {
+    std::memcpy(reinterpret_cast<void*>(range.address), range.data.data(), range.data.size());
+}
+
+bool IsDrawOpcode(PM4ItOpcode opcode) {
+    switch (opcode) {
+    case PM4ItOpcode::DrawIndex2:
+    case PM4ItOpcode::DrawIndexOffset2:
+    case PM4ItOpcode::DrawIndexAuto:
+    case PM4ItOpcode::DrawIndirect:
+    case PM4ItOpcode::DrawIndexIndirect:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsDispatchOpcode(PM4ItOpcode opcode) {
+    return opcode == PM4ItOpcode::DispatchDirect || opcode == PM4ItOpcode::DispatchIndirect;
+}
+
+} // Anonymous namespace
+
+bool ReplayPm4Capture(const std::filesystem::path& path, u32 num_loops) {
+    const Common::FS::IOFile file{path, Common::FS::FileAccessMode::Read};
+    if (!file.IsOpen()) {
+        fmt::print("Unable to open capture {}\n", path.string());
+        return false;
+    }
+
+    // Keep the contents 8 byte aligned so that command buffers can be referenced in place.
+    std::vector<u64> contents(Common::DivCeil(file.GetSize(), sizeof(u64)));
+    file.ReadRaw<u8>(contents.data(), file.GetSize());
+    const auto bytes = std::as_bytes(std::span{contents}).first(file.GetSize());
+
+    FileHeader header{};
+    if (bytes.size() < sizeof(header)) {
+        fmt::print("Capture {} is truncated\n", path.string());
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != CaptureMagic || header.version != CaptureVersion) {
+        fmt::print("Capture {} has an unsupported format\n", path.string());
+        return false;
+    }
+
+    std::span<const u32> registers;
+    std::vector<MemoryRange> memory;
+    std::vector<Submission> submissions;
+    for (size_t offset = sizeof(FileHeader); offset + sizeof(ChunkHeader) <= bytes.size();) {
+        ChunkHeader chunk;
+        std::memcpy(&chunk, bytes.data() + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (offset + chunk.size > bytes.size()) {
+            // Capture was interrupted while writing this chunk.
+            break;
+        }
+        const auto* payload = reinterpret_cast<const u8*>(bytes.data() + offset);
+        const auto dwords = std::span{reinterpret_cast<const u32*>(payload), chunk.size / 4};
+        switch (chunk.type) {
+        case ChunkType::Registers:
+            registers = dwords;
+            break;
+        case ChunkType::Memory: {
+            u64 address;
+            std::memcpy(&address, payload, sizeof(address));
+            memory.push_back(
+                {address, std::span{payload + sizeof(address), chunk.size - sizeof(address)},
+                 chunk.arg});
+            break;
+        }
+        case ChunkType::Graphics:
+            submissions.push_back(
+                {chunk.type, 0U, dwords.first(chunk.arg), dwords.subspan(chunk.arg)});
+            break;
+        case ChunkType::Compute:
+            submissions.push_back({chunk.type, chunk.arg, dwords, {}});
+            break;
+        default:
+            fmt::print("Skipping unknown chunk type {}\n", static_cast<u32>(chunk.type));
+            break;
+        }
+        offset += Common::AlignUp(chunk.size, 8);
+    }
+    if (registers.size() != Liverpool::NumRegs) {
+        fmt::print("Capture {} has no register state\n", path.string());
+        return false;
+    }
+
+    // Recreate the guest memory referenced by the command buffers at its original location.
+    static constexpr size_t PageSize = 16_KB;
+    std::vector<std::pair<VAddr, VAddr>> pages;
+    for (const auto& range : memory) {
+        pages.emplace_back(Common::AlignDown(range.address, PageSize),
+                           Common::AlignUp(range.address + range.data.size(), PageSize));
+    }
+    std::ranges::sort(pages);
+    Core::AddressSpace address_space;
+    for (size_t i = 0; i < pages.size();) {
+        auto [start, end] = pages[i];
+        for (++i; i < pages.size() && pages[i].first <= end; ++i) {
+            end = std::max(end, pages[i].second);
+        }
+        address_space.Map(start, end - start);
+    }
+
+    // The first record of every range is its initial contents. Later records hold changed
+    // contents and are applied before the submission that saw them.
+    std::vector<MemoryRange> initial;
+    std::vector<std::vector<MemoryRange>> updates(submissions.size());
+    std::unordered_set<VAddr> seen;
+    for (const auto& range : memory) {
+        if (seen.insert(range.address).second) {
+            initial.push_back(range);
+        } else if (range.submission < updates.size()) {
+            updates[range.submission].push_back(range);
+        }
+    }
+
+    Pm4Stats stats{};
+    auto liverpool = std::make_unique<Liverpool>();
+    liverpool->SetReplayStats(&stats);
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    for (u32 loop = 0; loop < num_loops; loop++) {
+        std::memcpy(liverpool->regs.reg_array.data(), registers.data(), registers.size_bytes());
+        liverpool->dirty_state = DirtyState::All;
+        std::ranges::for_each(initial, Restore);
+        for (size_t i = 0; i < submissions.size(); i++) {
+            const auto& submission = submissions[i];
+            if (!updates[i].empty()) {
+                // Earlier submissions may still read the old contents.
+                liverpool->WaitGpuIdle();
+                std::ranges::for_each(updates[i], Restore);
+            }
+            if (submission.type == ChunkType::Graphics) {
+                liverpool->SubmitGfx(submission.dcb, submission.ccb);
+            } else {
+                liverpool->SubmitAsc(submission.vqid, submission.dcb);
+            }
+        }
+        liverpool->WaitGpuIdle();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const u64 num_packets =
+        std::accumulate(stats.num_packets.begin(), stats.num_packets.end(), 0ULL);
+    u64 num_draws{};
+    u64 num_dispatches{};
+    for (u32 i = 0; i < stats.num_packets.size(); i++) {
+        const auto opcode = static_cast<PM4ItOpcode>(i);
+        num_draws += IsDrawOpcode(opcode) ? stats.num_packets[i] : 0;
+        num_dispatches += IsDispatchOpcode(opcode) ? stats.num_packets[i] : 0;
+    }
+
+    fmt::print("Replayed {} submissions {} times in {:.3f} s\n", submissions.size(), num_loops,
+               seconds);
+    fmt::print("{} packets ({:.0f}/s), {} draws ({:.0f}/s), {} dispatches ({:.0f}/s)\n",
+               num_packets, num_packets / seconds, num_draws, num_draws / seconds,
+               num_dispatches, num_dispatches / seconds);
+    fmt::print("{:.1f} us average submit latency, {} pending submits at most\n",
+               stats.submit_latency_ns / 1000.0 / std::max<u64>(stats.num_submits, 1),
+               stats.max_pending_submits);
+
+    std::vector<u32> opcodes(stats.num_packets.size());
+    std::iota(opcodes.begin(), opcodes.end(), 0U);
+    std::ranges::sort(opcodes, std::greater{}, [&](u32 i) { return stats.time_ns[i]; });
+    fmt::print("{:<24} {:>12} {:>12} {:>10}\n", "Opcode", "Packets", "Time (us)", "ns/packet");
+    for (const u32 i : opcodes) {
+        if (stats.num_packets[i] == 0) {
+            continue;
+        }
+        auto name = magic_enum::enum_name(static_cast<PM4ItOpcode>(i));
+        fmt::print("{:<24} {:>12} {:>12.1f} {:>10.1f}\n",
+                   name.empty() ? fmt::format("{:#04x}", i) : std::string{name},
+                   stats.num_packets[i], stats.time_ns[i] / 1000.0,
+                   double(stats.time_ns[i]) / stats.num_packets[i]);
+    }
+    return true;
+}
+
+} // namespace AmdGpu
@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <array>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <tsl/robin_map.h>
+
+#include "common/io_file.h"
+#include "common/types.h"
+
+namespace AmdGpu {
+
+/// Per opcode packet statistics gathered by the command processor in replay mode.
+struct Pm4Stats {
+    std::array<u64, 256> num_packets{};
+    std::array<u64, 256> time_ns{};
+    u64 num_submits{};
+    u64 max_pending_submits{};
+    u64 submit_latency_ns{}; ///< Total time between submission and start of execution
+};
+
+/**
+ * Records the command buffers submitted to the GPU, the register state they start from and the
+ * guest memory accessed by the command processor, so that command processing can be replayed
+ * and benchmarked without the title that produced them.
+ */
+class Pm4CaptureWriter {
+public:
+    explicit Pm4CaptureWriter(const std::filesystem::path& path);
+    ~Pm4CaptureWriter();
+
+    /// Records the register state that the following submissions start from.
+    void RecordRegisters(std::span<const u32> regs);
+
+    /// Records a submission and returns its index in the capture.
+    u32 RecordGraphics(std::span<const u32> dcb, std::span<const u32> ccb);
+    u32 RecordCompute(u32 vqid, std::span<const u32> acb);
+
+    /// Attributes the following memory records to the submission the command processor resumes.
+    void BeginSubmission(u32 index);
+
+    /// Records a guest memory range read or written by the command processor. A range is stored
+    /// the first time it is seen and again whenever its contents changed since, so that buffers
+    /// reused across submissions replay with the data each submission saw.
+    void RecordMemory(const void* address, size_t size);
+
+private:
+    void WriteChunk(u32 type, u32 arg, std::span<const std::byte> first,
+                    std::span<const std::byte> second);
+
+private:
+    struct RecordedRange {
+        size_t size;
+        u64 hash; ///< Hash of the contents last stored
+    };
+
+    std::mutex mutex;
+    Common::FS::IOFile file;
+    tsl::robin_map<VAddr, RecordedRange> recorded_ranges;
+    u32 num_submissions{};
+    u32 current_submission{};
+};
+
+/// Feeds a capture through a headless command processor num_loops times and prints packet
+/// throughput along with the time spent on every opcode. Returns false if the capture could
+/// not be loaded.
+bool ReplayPm4Capture(const std::filesystem::path& path, u32 num_loops);
+
+} // namespace AmdGpu
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include "common/alignment.h"
+#include "common/metrics.h"
 #include "common/scope_exit.h"
 #include "shader_recompiler/info.h"
 #include "video_core/amdgpu/liverpool.h"
@@ -522,6 +523,10 @@ void BufferCache::SynchronizeBuffer(Buffer& buffer, VAddr device_addr, u32 size,
     if (total_size_bytes == 0) {
         return;
     }
+    static auto& num_uploads = Common::Metrics::GetCounter("buffer_cache.uploads");
+    static auto& upload_bytes = Common::Metrics::GetCounter("buffer_cache.upload_bytes");
+    num_uploads.Add();
+    upload_bytes.Add(total_size_bytes);
     vk::Buffer src_buffer = staging_buffer.Handle();
     if (total_size_bytes < StagingBufferSize) {
         const auto [staging, offset] = staging_buffer.Map(total_size_bytes);
@@ -3,9 +3,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
 #include <type_traits>
 #include <utility>
-#include <vector>
 
 #include "common/object_pool.h"
 #include "common/types.h"
@@ -26,39 +30,55 @@ class MultiLevelPageTable final {
     using L1Page = std::array<Entry, NumEntriesPerL1Page>;
 
 public:
-    explicit MultiLevelPageTable() : first_level_map{1ULL << FirstLevelBits, nullptr} {}
+    explicit MultiLevelPageTable()
+        : first_level_map{std::make_unique<std::atomic<L1Page*>[]>(1ULL << FirstLevelBits)} {}
 
     ~MultiLevelPageTable() noexcept = default;
 
+    /// Returns the entry of a page or nullptr if its block was never allocated. May be called
+    /// concurrently with the functions that allocate blocks.
     [[nodiscard]] Entry* find(size_t page) {
         const size_t l1_page = page >> SecondLevelBits;
         const size_t l2_page = page & (NumEntriesPerL1Page - 1);
-        if (!first_level_map[l1_page]) {
+        L1Page* block = first_level_map[l1_page].load(std::memory_order_acquire);
+        if (!block) {
             return nullptr;
         }
-        return &(*first_level_map[l1_page])[l2_page];
+        return &(*block)[l2_page];
     }
 
-    [[nodiscard]] const Entry& operator[](size_t page) const {
+    [[nodiscard]] Entry& operator[](size_t page) {
         const size_t l1_page = page >> SecondLevelBits;
         const size_t l2_page = page & (NumEntriesPerL1Page - 1);
-        if (!first_level_map[l1_page]) {
-            first_level_map[l1_page] = page_alloc.Create();
-        }
-        return (*first_level_map[l1_page])[l2_page];
+        return GetBlock(l1_page)[l2_page];
     }
 
-    [[nodiscard]] Entry& operator[](size_t page) {
-        const size_t l1_page = page >> SecondLevelBits;
-        const size_t l2_page = page & (NumEntriesPerL1Page - 1);
-        if (!first_level_map[l1_page]) {
-            first_level_map[l1_page] = page_alloc.Create();
+    /// Calls func with the entries of the pages in [page_begin, page_end), one span per second
+    /// level block, allocating missing blocks.
+    template <typename Func>
+    void ForEachBlock(size_t page_begin, size_t page_end, Func&& func) {
+        while (page_begin < page_end) {
+            const size_t l1_page = page_begin >> SecondLevelBits;
+            const size_t l2_page = page_begin & (NumEntriesPerL1Page - 1);
+            const size_t count = std::min(NumEntriesPerL1Page - l2_page, page_end - page_begin);
+            func(std::span{GetBlock(l1_page)}.subspan(l2_page, count));
+            page_begin += count;
         }
-        return (*first_level_map[l1_page])[l2_page];
     }
 
 private:
-    std::vector<L1Page*> first_level_map{};
+    L1Page& GetBlock(size_t l1_page) {
+        auto& slot = first_level_map[l1_page];
+        L1Page* block = slot.load(std::memory_order_relaxed);
+        if (!block) {
+            // Publish the block only once it is constructed, for lookups through find.
+            block = page_alloc.Create();
+            slot.store(block, std::memory_order_release);
+        }
+        return *block;
+    }
+
+    std::unique_ptr<std::atomic<L1Page*>[]> first_level_map;
     Common::ObjectPool<L1Page> page_alloc;
 };
 
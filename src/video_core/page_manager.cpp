@@ -2,10 +2,11 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include <thread>
-#include <boost/icl/interval_set.hpp>
 #include "common/alignment.h"
 #include "common/assert.h"
+#include "common/div_ceil.h"
 #include "common/error.h"
+#include "common/metrics.h"
 #include "common/signal_context.h"
 #include "core/signals.h"
 #include "video_core/page_manager.h"
@@ -25,12 +26,10 @@
 
 namespace VideoCore {
 
-constexpr size_t PAGESIZE = 4_KB;
-constexpr size_t PAGEBITS = 12;
-
 #if ENABLE_USERFAULTFD
 struct PageManager::Impl {
-    Impl(Vulkan::Rasterizer* rasterizer_) : rasterizer{rasterizer_} {
+    Impl(PageManager* manager_, Vulkan::Rasterizer* rasterizer_)
+        : rasterizer{rasterizer_}, num_faults{&Common::Metrics::GetCounter("page_manager.faults")} {
         uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
         ASSERT_MSG(uffd != -1, "{}", Common::GetLastErrorMsg());
 
@@ -115,17 +114,21 @@ struct PageManager::Impl {
             const VAddr addr = msg.arg.pagefault.address;
             const VAddr addr_page = Common::AlignDown(addr, PAGESIZE);
             rasterizer->InvalidateMemory(addr_page, PAGESIZE);
+            num_faults->Add();
         }
     }
 
     Vulkan::Rasterizer* rasterizer;
+    Common::Metrics::Counter* num_faults;
     std::jthread ufd_thread;
     int uffd;
 };
 #else
 struct PageManager::Impl {
-    Impl(Vulkan::Rasterizer* rasterizer_) {
+    Impl(PageManager* manager_, Vulkan::Rasterizer* rasterizer_) {
+        manager = manager_;
         rasterizer = rasterizer_;
+        num_faults = &Common::Metrics::GetCounter("page_manager.faults");
 
         // Should be called first.
         constexpr auto priority = std::numeric_limits<u32>::min();
@@ -133,13 +136,9 @@ struct PageManager::Impl {
                                                                   priority);
     }
 
-    void OnMap(VAddr address, size_t size) {
-        owned_ranges += boost::icl::interval<VAddr>::right_open(address, address + size);
-    }
+    void OnMap(VAddr address, size_t size) {}
 
-    void OnUnmap(VAddr address, size_t size) {
-        owned_ranges -= boost::icl::interval<VAddr>::right_open(address, address + size);
-    }
+    void OnUnmap(VAddr address, size_t size) {}
 
     void Protect(VAddr address, size_t size, bool allow_write) {
 #ifdef _WIN32
@@ -156,64 +155,86 @@ struct PageManager::Impl {
     static bool GuestFaultSignalHandler(void* context, void* fault_address) {
         const auto addr = reinterpret_cast<VAddr>(fault_address);
         const bool is_write = Common::IsWriteError(context);
-        if (is_write && owned_ranges.find(addr) != owned_ranges.end()) {
+        if (is_write && manager->IsGpuMapped(addr)) {
             const VAddr addr_aligned = Common::AlignDown(addr, PAGESIZE);
             rasterizer->InvalidateMemory(addr_aligned, PAGESIZE);
+            num_faults->Add();
             return true;
         }
         return false;
     }
 
+    inline static PageManager* manager;
     inline static Vulkan::Rasterizer* rasterizer;
-    inline static boost::icl::interval_set<VAddr> owned_ranges;
+    inline static Common::Metrics::Counter* num_faults;
 };
 #endif
 
 PageManager::PageManager(Vulkan::Rasterizer* rasterizer_)
-    : impl{std::make_unique<Impl>(rasterizer_)}, rasterizer{rasterizer_} {}
+    : impl{std::make_unique<Impl>(this, rasterizer_)}, rasterizer{rasterizer_} {}
 
 PageManager::~PageManager() = default;
 
 void PageManager::OnGpuMap(VAddr address, size_t size) {
+    SetGpuMapped(address, size, true);
     impl->OnMap(address, size);
 }
 
 void PageManager::OnGpuUnmap(VAddr address, size_t size) {
     impl->OnUnmap(address, size);
+    SetGpuMapped(address, size, false);
 }
 
-void PageManager::UpdatePagesCachedCount(VAddr addr, u64 size, s32 delta) {
-    static constexpr u64 PageShift = 12;
-
+void PageManager::SetGpuMapped(VAddr address, size_t size, bool is_mapped) {
     std::scoped_lock lk{mutex};
-    const u64 num_pages = ((addr + size - 1) >> PageShift) - (addr >> PageShift) + 1;
-    const u64 page_start = addr >> PageShift;
-    const u64 page_end = page_start + num_pages;
-
-    const auto pages_interval =
-        decltype(cached_pages)::interval_type::right_open(page_start, page_end);
-    if (delta > 0) {
-        cached_pages.add({pages_interval, delta});
+    const u64 page_end = Common::DivCeil(address + size, PAGESIZE);
+    cached_pages.ForEachBlock(address >> PAGEBITS, page_end, [is_mapped](auto states) {
+        for (auto& state : states) {
+            state.is_gpu_mapped.store(is_mapped, std::memory_order_relaxed);
+        }
+    });
+}
+
+bool PageManager::IsGpuMapped(VAddr addr) {
+    if (addr >> Traits::AddressSpaceBits) {
+        return false;
     }
+    // Blocks of the table are published atomically when memory gets mapped, so the lookup does
+    // not need to take the mutex.
+    const PageState* state = cached_pages.find(addr >> PAGEBITS);
+    return state && state->is_gpu_mapped.load(std::memory_order_relaxed);
+}
 
-    const auto& range = cached_pages.equal_range(pages_interval);
-    for (const auto& [range, count] : boost::make_iterator_range(range)) {
-        const auto interval = range & pages_interval;
-        const VAddr interval_start_addr = boost::icl::first(interval) << PageShift;
-        const VAddr interval_end_addr = boost::icl::last_next(interval) << PageShift;
-        const u32 interval_size = interval_end_addr - interval_start_addr;
-        if (delta > 0 && count == delta) {
-            impl->Protect(interval_start_addr, interval_size, false);
-        } else if (delta < 0 && count == -delta) {
-            impl->Protect(interval_start_addr, interval_size, true);
-        } else {
-            ASSERT(count >= 0);
+void PageManager::UpdatePagesCachedCount(VAddr addr, u64 size, s32 delta) {
+    const u64 page_start = addr >> PAGEBITS;
+    const u64 page_end = ((addr + size - 1) >> PAGEBITS) + 1;
+
+    // Pages that start or stop being watched are gathered into runs of adjacent pages, so that
+    // every run only requires a single protection change.
+    u64 run_start = page_start;
+    u64 run_end = page_start;
+    const auto flush_run = [&] {
+        if (run_start != run_end) {
+            impl->Protect(run_start << PAGEBITS, (run_end - run_start) << PAGEBITS, delta < 0);
         }
-    }
+    };
 
-    if (delta < 0) {
-        cached_pages.add({pages_interval, delta});
+    std::scoped_lock lk{mutex};
+    for (u64 page = page_start; page != page_end; ++page) {
+        s32& num_watchers = cached_pages[page].num_watchers;
+        num_watchers += delta;
+        ASSERT(num_watchers >= 0);
+        const bool changed = delta > 0 ? num_watchers == delta : num_watchers == 0;
+        if (!changed) {
+            continue;
+        }
+        if (page != run_end) {
+            flush_run();
+            run_start = page;
+        }
+        run_end = page + 1;
     }
+    flush_run();
 }
 
 } // namespace VideoCore
@@ -3,10 +3,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <mutex>
-#include <boost/icl/interval_map.hpp>
 #include "common/types.h"
+#include "video_core/multi_level_page_table.h"
 
 namespace Vulkan {
 class Rasterizer;
@@ -14,7 +15,25 @@ class Rasterizer;
 
 namespace VideoCore {
 
+constexpr size_t PAGESIZE = 4_KB;
+constexpr size_t PAGEBITS = 12;
+
 class PageManager {
+    struct PageState {
+        /// Number of cached surfaces overlapping the page, guarded by the mutex.
+        s32 num_watchers{};
+        /// Whether the page is mapped gpu memory. Read by the fault handler without locking.
+        std::atomic_bool is_gpu_mapped{};
+    };
+
+    struct Traits {
+        using Entry = PageState;
+        static constexpr size_t AddressSpaceBits = 40;
+        static constexpr size_t FirstLevelBits = 16;
+        static constexpr size_t PageBits = PAGEBITS;
+    };
+    using PageTable = MultiLevelPageTable<Traits>;
+
 public:
     explicit PageManager(Vulkan::Rasterizer* rasterizer);
     ~PageManager();
@@ -28,12 +47,18 @@ public:
     /// Increase/decrease the number of surface in pages touching the specified region
     void UpdatePagesCachedCount(VAddr addr, u64 size, s32 delta);
 
+private:
+    /// Returns true if the address belongs to mapped gpu memory. Never allocates.
+    bool IsGpuMapped(VAddr addr);
+
+    void SetGpuMapped(VAddr address, size_t size, bool is_mapped);
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl;
     Vulkan::Rasterizer* rasterizer;
     std::mutex mutex;
-    boost::icl::interval_map<VAddr, s32> cached_pages;
+    PageTable cached_pages;
 };
 
 } // namespace VideoCore
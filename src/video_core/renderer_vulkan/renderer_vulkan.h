@@ -74,6 +74,10 @@ public:
                }) != vo_buffers_addr.end();
     }
 
+    [[nodiscard]] Rasterizer& GetRasterizer() noexcept {
+        return *rasterizer;
+    }
+
     bool ShowSplash(Frame* frame = nullptr);
     void Present(Frame* frame);
     void RecreateFrame(Frame* frame, u32 width, u32 height);
@@ -15,15 +15,9 @@ namespace Vulkan {
 ComputePipeline::ComputePipeline(const Instance& instance_, Scheduler& scheduler_,
                                  DescriptorHeap& desc_heap_, vk::PipelineCache pipeline_cache,
                                  u64 compute_key_, const Shader::Info& info_,
-                                 vk::ShaderModule module)
+                                 vk::ShaderModule module, Common::ThreadWorker* worker)
     : Pipeline{instance_, scheduler_, desc_heap_, pipeline_cache}, compute_key{compute_key_},
       info{&info_} {
-    const vk::PipelineShaderStageCreateInfo shader_ci = {
-        .stage = vk::ShaderStageFlagBits::eCompute,
-        .module = module,
-        .pName = "main",
-    };
-
     u32 binding{};
     boost::container::small_vector<vk::DescriptorSetLayoutBinding, 32> bindings;
     for (const auto& buffer : info->buffers) {
@@ -89,16 +83,29 @@ ComputePipeline::ComputePipeline(const Instance& instance_, Scheduler& scheduler
     };
     pipeline_layout = instance.GetDevice().createPipelineLayoutUnique(layout_info);
 
-    const vk::ComputePipelineCreateInfo compute_pipeline_ci = {
-        .stage = shader_ci,
-        .layout = *pipeline_layout,
+    auto build = [this, pipeline_cache, module] {
+        const vk::PipelineShaderStageCreateInfo shader_ci = {
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = module,
+            .pName = "main",
+        };
+        const vk::ComputePipelineCreateInfo compute_pipeline_ci = {
+            .stage = shader_ci,
+            .layout = *pipeline_layout,
+        };
+        auto result =
+            instance.GetDevice().createComputePipelineUnique(pipeline_cache, compute_pipeline_ci);
+        if (result.result == vk::Result::eSuccess) {
+            pipeline = std::move(result.value);
+        } else {
+            UNREACHABLE_MSG("Compute pipeline creation failed!");
+        }
+        is_built.store(true, std::memory_order_release);
     };
-    auto result =
-        instance.GetDevice().createComputePipelineUnique(pipeline_cache, compute_pipeline_ci);
-    if (result.result == vk::Result::eSuccess) {
-        pipeline = std::move(result.value);
+    if (worker) {
+        worker->QueueWork(std::move(build));
     } else {
-        UNREACHABLE_MSG("Graphics pipeline creation failed!");
+        build();
     }
 }
 
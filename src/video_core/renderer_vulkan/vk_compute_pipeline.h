@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "common/thread_worker.h"
 #include "video_core/renderer_vulkan/vk_common.h"
 #include "video_core/renderer_vulkan/vk_pipeline_common.h"
 
@@ -21,7 +22,7 @@ class ComputePipeline : public Pipeline {
 public:
     ComputePipeline(const Instance& instance, Scheduler& scheduler, DescriptorHeap& desc_heap,
                     vk::PipelineCache pipeline_cache, u64 compute_key, const Shader::Info& info,
-                    vk::ShaderModule module);
+                    vk::ShaderModule module, Common::ThreadWorker* worker = nullptr);
     ~ComputePipeline();
 
     bool BindResources(VideoCore::BufferCache& buffer_cache,
@@ -20,9 +20,9 @@ GraphicsPipeline::GraphicsPipeline(const Instance& instance_, Scheduler& schedul
                                    DescriptorHeap& desc_heap_, const GraphicsPipelineKey& key_,
                                    vk::PipelineCache pipeline_cache,
                                    std::span<const Shader::Info*, MaxShaderStages> infos,
-                                   std::span<const vk::ShaderModule> modules)
+                                   std::span<const vk::ShaderModule> modules,
+                                   Common::ThreadWorker* worker)
     : Pipeline{instance_, scheduler_, desc_heap_, pipeline_cache}, key{key_} {
-    const vk::Device device = instance.GetDevice();
     std::ranges::copy(infos, stages.begin());
     BuildDescSetLayout();
 
@@ -67,6 +67,27 @@ GraphicsPipeline::GraphicsPipeline(const Instance& instance_, Scheduler& schedul
         });
     }
 
+    // Resource layout and vertex inputs depend on the currently bound sharps, so they are
+    // gathered above. The rest only depends on the key and can be built on a worker thread.
+    auto build = [this, pipeline_cache, vertex_bindings, vertex_attributes,
+                  shader_modules = std::vector(modules.begin(), modules.end())] {
+        Build(pipeline_cache, shader_modules, vertex_bindings, vertex_attributes);
+        is_built.store(true, std::memory_order_release);
+    };
+    if (worker) {
+        worker->QueueWork(std::move(build));
+    } else {
+        build();
+    }
+}
+
+GraphicsPipeline::~GraphicsPipeline() = default;
+
+void GraphicsPipeline::Build(
+    vk::PipelineCache pipeline_cache, std::span<const vk::ShaderModule> modules,
+    std::span<const vk::VertexInputBindingDescription> vertex_bindings,
+    std::span<const vk::VertexInputAttributeDescription> vertex_attributes) {
+    const vk::Device device = instance.GetDevice();
     const vk::PipelineVertexInputStateCreateInfo vertex_input_info = {
         .vertexBindingDescriptionCount = static_cast<u32>(vertex_bindings.size()),
         .pVertexBindingDescriptions = vertex_bindings.data(),
@@ -182,7 +203,7 @@ GraphicsPipeline::GraphicsPipeline(const Instance& instance_, Scheduler& schedul
     auto stage = u32(Shader::Stage::Vertex);
     boost::container::static_vector<vk::PipelineShaderStageCreateInfo, MaxShaderStages>
         shader_stages;
-    if (infos[stage]) {
+    if (stages[stage]) {
         shader_stages.emplace_back(vk::PipelineShaderStageCreateInfo{
             .stage = vk::ShaderStageFlagBits::eVertex,
             .module = modules[stage],
@@ -190,7 +211,7 @@ GraphicsPipeline::GraphicsPipeline(const Instance& instance_, Scheduler& schedul
         });
     }
     stage = u32(Shader::Stage::Fragment);
-    if (infos[stage]) {
+    if (stages[stage]) {
         shader_stages.emplace_back(vk::PipelineShaderStageCreateInfo{
             .stage = vk::ShaderStageFlagBits::eFragment,
             .module = modules[stage],
@@ -289,8 +310,6 @@ GraphicsPipeline::GraphicsPipeline(const Instance& instance_, Scheduler& schedul
     }
 }
 
-GraphicsPipeline::~GraphicsPipeline() = default;
-
 void GraphicsPipeline::BuildDescSetLayout() {
     boost::container::small_vector<vk::DescriptorSetLayoutBinding, 32> bindings;
     u32 binding{};
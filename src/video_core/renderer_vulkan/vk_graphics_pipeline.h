@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include <xxhash.h>
+#include "common/thread_worker.h"
 #include "common/types.h"
 #include "video_core/renderer_vulkan/liverpool_to_vk.h"
 #include "video_core/renderer_vulkan/vk_common.h"
@@ -56,7 +57,8 @@ public:
     GraphicsPipeline(const Instance& instance, Scheduler& scheduler, DescriptorHeap& desc_heap,
                      const GraphicsPipelineKey& key, vk::PipelineCache pipeline_cache,
                      std::span<const Shader::Info*, MaxShaderStages> stages,
-                     std::span<const vk::ShaderModule> modules);
+                     std::span<const vk::ShaderModule> modules,
+                     Common::ThreadWorker* worker = nullptr);
     ~GraphicsPipeline();
 
     void BindResources(const Liverpool::Regs& regs, VideoCore::BufferCache& buffer_cache,
@@ -85,6 +87,9 @@ public:
 
 private:
     void BuildDescSetLayout();
+    void Build(vk::PipelineCache pipeline_cache, std::span<const vk::ShaderModule> modules,
+               std::span<const vk::VertexInputBindingDescription> vertex_bindings,
+               std::span<const vk::VertexInputAttributeDescription> vertex_attributes);
 
 private:
     std::array<const Shader::Info*, MaxShaderStages> stages{};
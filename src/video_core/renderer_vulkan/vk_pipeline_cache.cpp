@@ -1,10 +1,13 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
 #include <ranges>
+#include <thread>
 
 #include "common/config.h"
 #include "common/io_file.h"
+#include "common/metrics.h"
 #include "common/path_util.h"
 #include "shader_recompiler/backend/spirv/emit_spirv.h"
 #include "shader_recompiler/info.h"
@@ -95,7 +98,7 @@ Shader::RuntimeInfo PipelineCache::BuildRuntimeInfo(Shader::Stage stage) {
     case Shader::Stage::Fragment: {
         info.num_user_data = regs.ps_program.settings.num_user_regs;
         info.num_allocated_vgprs = regs.ps_program.settings.num_vgprs * 4;
-        std::ranges::transform(graphics_key.mrt_swizzles, info.fs_info.mrt_swizzles.begin(),
+        std::ranges::transform(fs_mrt_swizzles, info.fs_info.mrt_swizzles.begin(),
                                [](Liverpool::ColorBuffer::SwapMode mode) {
                                    return static_cast<Shader::MrtSwizzle>(mode);
                                });
@@ -130,16 +133,30 @@ Shader::RuntimeInfo PipelineCache::BuildRuntimeInfo(Shader::Stage stage) {
 PipelineCache::PipelineCache(const Instance& instance_, Scheduler& scheduler_,
                              AmdGpu::Liverpool* liverpool_)
     : instance{instance_}, scheduler{scheduler_}, liverpool{liverpool_},
-      desc_heap{instance, scheduler.GetMasterSemaphore(), DescriptorHeapSizes} {
+      desc_heap{instance, scheduler.GetMasterSemaphore(), DescriptorHeapSizes},
+      shader_cache{instance} {
     profile = Shader::Profile{
         .supported_spirv = instance.ApiVersion() >= VK_API_VERSION_1_3 ? 0x00010600U : 0x00010500U,
         .subgroup_size = instance.SubgroupSize(),
         .support_explicit_workgroup_layout = true,
     };
-    pipeline_cache = instance.GetDevice().createPipelineCacheUnique({});
+    if (Config::asyncPipelineCompilation()) {
+        const size_t num_workers = std::max(std::thread::hardware_concurrency() / 4, 1U);
+        shader_workers = std::make_unique<ShaderWorker>(num_workers, "ShaderWorker",
+                                                        [] { return Shader::Pools{}; });
+        pipeline_workers = std::make_unique<Common::ThreadWorker>(num_workers, "PipelineWorker");
+    }
+    shader_cache.Load(profile);
+    const auto pipeline_data = shader_cache.LoadPipelineData();
+    pipeline_cache = instance.GetDevice().createPipelineCacheUnique({
+        .initialDataSize = pipeline_data.size(),
+        .pInitialData = pipeline_data.data(),
+    });
 }
 
-PipelineCache::~PipelineCache() = default;
+PipelineCache::~PipelineCache() {
+    shader_cache.SavePipelineData(*pipeline_cache);
+}
 
 const GraphicsPipeline* PipelineCache::GetGraphicsPipeline() {
     const auto& regs = liverpool->regs;
@@ -162,27 +179,40 @@ const GraphicsPipeline* PipelineCache::GetGraphicsPipeline() {
         LOG_TRACE(Render_Vulkan, "Primitive type 'None' skipped");
         return nullptr;
     }
+    ProcessCompletedWork();
     if (!RefreshGraphicsKey()) {
         return nullptr;
     }
-    const auto [it, is_new] = graphics_pipelines.try_emplace(graphics_key);
-    if (is_new) {
-        it.value() = graphics_pipeline_pool.Create(instance, scheduler, desc_heap, graphics_key,
-                                                   *pipeline_cache, infos, modules);
+    if (!current_graphics_pipeline) {
+        const auto [it, is_new] = graphics_pipelines.try_emplace(graphics_key);
+        if (is_new) {
+            static auto& num_pipelines = Common::Metrics::GetCounter("gpu.pipeline_compiles");
+            num_pipelines.Add();
+            it.value() = graphics_pipeline_pool.Create(instance, scheduler, desc_heap,
+                                                       graphics_key, *pipeline_cache, infos,
+                                                       modules, pipeline_workers.get());
+        }
+        current_graphics_pipeline = it->second;
     }
-    return it->second;
+    const GraphicsPipeline* pipeline = current_graphics_pipeline;
+    return pipeline->IsBuilt() ? pipeline : nullptr;
 }
 
 const ComputePipeline* PipelineCache::GetComputePipeline() {
+    ProcessCompletedWork();
     if (!RefreshComputeKey()) {
         return nullptr;
     }
     const auto [it, is_new] = compute_pipelines.try_emplace(compute_key);
     if (is_new) {
+        static auto& num_pipelines = Common::Metrics::GetCounter("gpu.pipeline_compiles");
+        num_pipelines.Add();
         it.value() = compute_pipeline_pool.Create(instance, scheduler, desc_heap, *pipeline_cache,
-                                                  compute_key, *infos[0], modules[0]);
+                                                  compute_key, *infos[0], modules[0],
+                                                  pipeline_workers.get());
     }
-    return it->second;
+    const ComputePipeline* pipeline = it->second;
+    return pipeline->IsBuilt() ? pipeline : nullptr;
 }
 
 bool ShouldSkipShader(u64 shader_hash, const char* shader_type) {
@@ -195,7 +225,22 @@ bool ShouldSkipShader(u64 shader_hash, const char* shader_type) {
 }
 
 bool PipelineCache::RefreshGraphicsKey() {
+    auto& dirty_state = liverpool->dirty_state;
+    if (False(dirty_state & AmdGpu::DirtyState::PipelineKey)) {
+        // None of the registers the fixed function state is derived from were written since the
+        // key was built, so the key only changes if a different shader permutation is needed.
+        const auto prev_stage_hashes = graphics_key.stage_hashes;
+        if (!RefreshGraphicsStages()) {
+            dirty_state |= AmdGpu::DirtyState::PipelineKey;
+            return false;
+        }
+        if (graphics_key.stage_hashes == prev_stage_hashes) {
+            return true;
+        }
+    }
+
     std::memset(&graphics_key, 0, sizeof(GraphicsPipelineKey));
+    current_graphics_pipeline = nullptr;
 
     auto& regs = liverpool->regs;
     auto& key = graphics_key;
@@ -263,6 +308,41 @@ bool PipelineCache::RefreshGraphicsKey() {
 
         ++remapped_cb;
     }
+    // Kept aside as the second pass below modifies the swizzles of the key.
+    fs_mrt_swizzles = key.mrt_swizzles;
+
+    if (!RefreshGraphicsStages()) {
+        return false;
+    }
+
+    const auto* fs_info = infos[u32(Shader::Stage::Fragment)];
+    key.mrt_mask = fs_info ? fs_info->mrt_mask : 0u;
+
+    // Second pass to fill remain CB pipeline key data
+    for (auto cb = 0u, remapped_cb = 0u; cb < Liverpool::NumColorBuffers; ++cb) {
+        auto const& col_buf = regs.color_buffers[cb];
+        if (skip_cb_binding || !col_buf || !regs.color_target_mask.GetMask(cb) ||
+            (key.mrt_mask & (1u << cb)) == 0) {
+            key.color_formats[cb] = vk::Format::eUndefined;
+            key.mrt_swizzles[cb] = Liverpool::ColorBuffer::SwapMode::Standard;
+            continue;
+        }
+
+        key.blend_controls[remapped_cb] = regs.blend_control[cb];
+        key.blend_controls[remapped_cb].enable.Assign(key.blend_controls[remapped_cb].enable &&
+                                                      !col_buf.info.blend_bypass);
+        key.write_masks[remapped_cb] = vk::ColorComponentFlags{regs.color_target_mask.GetMask(cb)};
+        key.cb_shader_mask.SetMask(remapped_cb, regs.color_shader_mask.GetMask(cb));
+
+        ++remapped_cb;
+    }
+    dirty_state &= ~AmdGpu::DirtyState::PipelineKey;
+    return true;
+}
+
+bool PipelineCache::RefreshGraphicsStages() {
+    const auto& regs = liverpool->regs;
+    auto& key = graphics_key;
 
     Shader::Backend::Bindings binding{};
     for (u32 i = 0; i < MaxShaderStages; i++) {
@@ -305,29 +385,12 @@ bool PipelineCache::RefreshGraphicsKey() {
         }
 
         std::tie(infos[i], modules[i], key.stage_hashes[i]) = GetProgram(stage, params, binding);
-    }
-
-    const auto* fs_info = infos[u32(Shader::Stage::Fragment)];
-    key.mrt_mask = fs_info ? fs_info->mrt_mask : 0u;
-
-    // Second pass to fill remain CB pipeline key data
-    for (auto cb = 0u, remapped_cb = 0u; cb < Liverpool::NumColorBuffers; ++cb) {
-        auto const& col_buf = regs.color_buffers[cb];
-        if (skip_cb_binding || !col_buf || !regs.color_target_mask.GetMask(cb) ||
-            (key.mrt_mask & (1u << cb)) == 0) {
-            key.color_formats[cb] = vk::Format::eUndefined;
-            key.mrt_swizzles[cb] = Liverpool::ColorBuffer::SwapMode::Standard;
-            continue;
+        if (!modules[i]) {
+            // Still being compiled in the background.
+            return false;
         }
-
-        key.blend_controls[remapped_cb] = regs.blend_control[cb];
-        key.blend_controls[remapped_cb].enable.Assign(key.blend_controls[remapped_cb].enable &&
-                                                      !col_buf.info.blend_bypass);
-        key.write_masks[remapped_cb] = vk::ColorComponentFlags{regs.color_target_mask.GetMask(cb)};
-        key.cb_shader_mask.SetMask(remapped_cb, regs.color_shader_mask.GetMask(cb));
-
-        ++remapped_cb;
     }
+
     return true;
 }
 
@@ -340,25 +403,101 @@ bool PipelineCache::RefreshComputeKey() {
     }
     std::tie(infos[0], modules[0], compute_key) =
         GetProgram(Shader::Stage::Compute, cs_params, binding);
-    return true;
+    return static_cast<bool>(modules[0]);
 }
 
-vk::ShaderModule PipelineCache::CompileModule(Shader::Info& info,
-                                              const Shader::RuntimeInfo& runtime_info,
-                                              std::span<const u32> code, size_t perm_idx,
-                                              Shader::Backend::Bindings& binding) {
+std::vector<u32> PipelineCache::TranslateModule(Shader::Pools& pools, Shader::Info& info,
+                                                const Shader::RuntimeInfo& runtime_info,
+                                                std::span<const u32> code, size_t perm_idx,
+                                                Shader::Backend::Bindings& binding) {
     LOG_INFO(Render_Vulkan, "Compiling {} shader {:#x} {}", info.stage, info.pgm_hash,
              perm_idx != 0 ? "(permutation)" : "");
     if (Config::dumpShaders()) {
         DumpShader(code, info.pgm_hash, info.stage, perm_idx, "bin");
     }
 
+    static auto& num_compiles = Common::Metrics::GetCounter("gpu.shader_compiles");
+    static auto& compile_time = Common::Metrics::GetHistogram("gpu.shader_compile_us");
+    const auto start = std::chrono::steady_clock::now();
+
     const auto ir_program = Shader::TranslateProgram(code, pools, info, runtime_info, profile);
-    const auto spv = Shader::Backend::SPIRV::EmitSPIRV(profile, runtime_info, ir_program, binding);
+    auto spv = Shader::Backend::SPIRV::EmitSPIRV(profile, runtime_info, ir_program, binding);
+
+    num_compiles.Add();
+    compile_time.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
     if (Config::dumpShaders()) {
         DumpShader(spv, info.pgm_hash, info.stage, perm_idx, "spv");
     }
+    return spv;
+}
+
+vk::ShaderModule PipelineCache::CompileModule(Shader::Info& info,
+                                              const Shader::RuntimeInfo& runtime_info,
+                                              std::span<const u32> code, size_t perm_idx,
+                                              Shader::Backend::Bindings& binding) {
+    const auto start = binding;
+    const auto spv = TranslateModule(pools, info, runtime_info, code, perm_idx, binding);
+    shader_cache.Store(info, Shader::StageSpecialization(info, runtime_info, start), spv);
+    return CreateModule(info, spv, perm_idx);
+}
+
+void PipelineCache::CompileModuleAsync(Program* program, const Shader::RuntimeInfo& runtime_info,
+                                       Shader::ShaderParams params, size_t perm_idx,
+                                       Shader::Backend::Bindings start) {
+    // Translation reads sharps through the user data registers, which are likely overwritten
+    // by the time the job runs, so the worker operates on a snapshot of them.
+    std::array<u32, Shader::ShaderParams::NumShaderUserData> user_data;
+    std::ranges::copy(params.user_data, user_data.begin());
+    const auto stage = program->info.stage;
+
+    shader_workers->QueueWork([this, program, stage, runtime_info, params, perm_idx, start,
+                               user_data](Shader::Pools* worker_pools) mutable {
+        params.user_data = user_data;
+        auto info = Shader::Info(stage, params);
+        auto binding = start;
+        auto spv = TranslateModule(*worker_pools, info, runtime_info, params.code, perm_idx,
+                                   binding);
+        const auto module = CreateModule(info, spv, perm_idx);
+        auto spec = Shader::StageSpecialization(info, runtime_info, start);
+
+        std::scoped_lock lock{completion_mutex};
+        completed_work.emplace_back([this, program, perm_idx, module, info = std::move(info),
+                                     spec = std::move(spec), spv = std::move(spv)]() mutable {
+            spec.info = &info;
+            shader_cache.Store(info, spec, spv);
+            if (perm_idx != 0) {
+                program->modules[perm_idx].module = module;
+                return;
+            }
+            // Adopt the translated resource information, but keep reading the live registers.
+            const auto live_user_data = program->info.user_data;
+            program->info = std::move(info);
+            program->info.user_data = live_user_data;
+            spec.info = &program->info;
+            program->AddPermut(module, std::move(spec));
+            program->is_compiling = false;
+        });
+    });
+}
+
+void PipelineCache::ProcessCompletedWork() {
+    if (!shader_workers) {
+        return;
+    }
+    std::vector<Common::UniqueFunction<void>> work;
+    {
+        std::scoped_lock lock{completion_mutex};
+        work.swap(completed_work);
+    }
+    for (auto& func : work) {
+        func();
+    }
+}
 
+vk::ShaderModule PipelineCache::CreateModule(const Shader::Info& info, std::span<const u32> spv,
+                                             size_t perm_idx) {
     const auto module = CompileSPV(spv, instance.GetDevice());
     const auto name = fmt::format("{}_{:#x}_{}", info.stage, info.pgm_hash, perm_idx);
     Vulkan::SetObjectName(instance.GetDevice(), module, name);
@@ -371,29 +510,50 @@ std::tuple<const Shader::Info*, vk::ShaderModule, u64> PipelineCache::GetProgram
     auto [it_pgm, new_program] = program_cache.try_emplace(params.hash);
     if (new_program) {
         Program* program = program_pool.Create(stage, params);
+        it_pgm.value() = program;
         auto start = binding;
-        const auto module = CompileModule(program->info, runtime_info, params.code, 0, binding);
+        vk::ShaderModule module{};
+        if (const auto spv = shader_cache.FindProgram(program->info, runtime_info, start);
+            !spv.empty()) {
+            program->info.AddBindings(binding);
+            module = CreateModule(program->info, spv, 0);
+        } else if (shader_workers) {
+            program->is_compiling = true;
+            CompileModuleAsync(program, runtime_info, params, 0, start);
+            return std::make_tuple(&program->info, module, HashCombine(params.hash, 0));
+        } else {
+            module = CompileModule(program->info, runtime_info, params.code, 0, binding);
+        }
         const auto spec = Shader::StageSpecialization(program->info, runtime_info, start);
         program->AddPermut(module, std::move(spec));
-        it_pgm.value() = program;
         return std::make_tuple(&program->info, module, HashCombine(params.hash, 0));
     }
 
     Program* program = it_pgm->second;
+    if (program->is_compiling) {
+        // Resource layout is unknown until the first permutation is translated.
+        return std::make_tuple(&program->info, vk::ShaderModule{}, HashCombine(params.hash, 0));
+    }
     const auto& info = program->info;
-    const auto spec = Shader::StageSpecialization(info, runtime_info, binding);
-    size_t perm_idx = program->modules.size();
+    static auto& num_lookups = Common::Metrics::GetCounter("gpu.permutation_lookups");
+    num_lookups.Add();
+    size_t perm_idx = program->FindPermut(runtime_info, binding);
     vk::ShaderModule module{};
 
-    const auto it = std::ranges::find(program->modules, spec, &Program::Module::spec);
-    if (it == program->modules.end()) {
-        auto new_info = Shader::Info(stage, params);
-        module = CompileModule(new_info, runtime_info, params.code, perm_idx, binding);
+    if (perm_idx == program->modules.size()) {
+        auto spec = Shader::StageSpecialization(info, runtime_info, binding);
+        if (const auto spv = shader_cache.FindPermutation(spec, binding); !spv.empty()) {
+            module = CreateModule(info, spv, perm_idx);
+        } else if (shader_workers) {
+            CompileModuleAsync(program, runtime_info, params, perm_idx, binding);
+        } else {
+            auto new_info = Shader::Info(stage, params);
+            module = CompileModule(new_info, runtime_info, params.code, perm_idx, binding);
+        }
         program->AddPermut(module, std::move(spec));
     } else {
         info.AddBindings(binding);
-        module = it->module;
-        perm_idx = std::distance(program->modules.begin(), it);
+        module = program->modules[perm_idx].module;
     }
     return std::make_tuple(&info, module, HashCombine(params.hash, perm_idx));
 }
@@ -3,13 +3,16 @@
 
 #pragma once
 
+#include <mutex>
 #include <tsl/robin_map.h>
+#include "common/thread_worker.h"
 #include "shader_recompiler/profile.h"
 #include "shader_recompiler/recompiler.h"
 #include "shader_recompiler/specialization.h"
 #include "video_core/renderer_vulkan/vk_compute_pipeline.h"
 #include "video_core/renderer_vulkan/vk_graphics_pipeline.h"
 #include "video_core/renderer_vulkan/vk_resource_pool.h"
+#include "video_core/renderer_vulkan/vk_shader_cache.h"
 
 namespace Shader {
 struct Info;
@@ -19,7 +22,6 @@ namespace Vulkan {
 
 class Instance;
 class Scheduler;
-class ShaderCache;
 
 struct Program {
     struct Module {
@@ -29,12 +31,34 @@ struct Program {
 
     Shader::Info info;
     boost::container::small_vector<Module, 8> modules;
+    tsl::robin_map<u64, size_t> permutations; ///< Specialization fingerprint to module index
+    bool is_compiling{};
 
     explicit Program(Shader::Stage stage, Shader::ShaderParams params) : info{stage, params} {}
 
     void AddPermut(vk::ShaderModule module, const Shader::StageSpecialization&& spec) {
+        permutations.try_emplace(spec.fingerprint, modules.size());
         modules.emplace_back(module, std::move(spec));
     }
+
+    /// Returns the index of the permutation matching the given state, or modules.size().
+    size_t FindPermut(const Shader::RuntimeInfo& runtime_info, Shader::Backend::Bindings start) {
+        const u64 fingerprint = Shader::StageSpecialization::Fingerprint(info, runtime_info, start);
+        if (const auto it = permutations.find(fingerprint); it != permutations.end()) {
+            if (modules[it->second].spec.Matches(runtime_info, start)) {
+                return it->second;
+            }
+        }
+        // Permutations made while more resources were bound also accept this state, remember
+        // the fingerprint so that the next lookup does not need to scan.
+        for (size_t i = 0; i < modules.size(); i++) {
+            if (modules[i].spec.Matches(runtime_info, start)) {
+                permutations.try_emplace(fingerprint, i);
+                return i;
+            }
+        }
+        return modules.size();
+    }
 };
 
 class PipelineCache {
@@ -54,13 +78,24 @@ public:
 
 private:
     bool RefreshGraphicsKey();
+    bool RefreshGraphicsStages();
     bool RefreshComputeKey();
 
     void DumpShader(std::span<const u32> code, u64 hash, Shader::Stage stage, size_t perm_idx,
                     std::string_view ext);
+    std::vector<u32> TranslateModule(Shader::Pools& pools, Shader::Info& info,
+                                     const Shader::RuntimeInfo& runtime_info,
+                                     std::span<const u32> code, size_t perm_idx,
+                                     Shader::Backend::Bindings& binding);
+    void CompileModuleAsync(Program* program, const Shader::RuntimeInfo& runtime_info,
+                            Shader::ShaderParams params, size_t perm_idx,
+                            Shader::Backend::Bindings start);
+    void ProcessCompletedWork();
     vk::ShaderModule CompileModule(Shader::Info& info, const Shader::RuntimeInfo& runtime_info,
                                    std::span<const u32> code, size_t perm_idx,
                                    Shader::Backend::Bindings& binding);
+    vk::ShaderModule CreateModule(const Shader::Info& info, std::span<const u32> spv,
+                                  size_t perm_idx);
     Shader::RuntimeInfo BuildRuntimeInfo(Shader::Stage stage);
 
 private:
@@ -68,6 +103,7 @@ private:
     Scheduler& scheduler;
     AmdGpu::Liverpool* liverpool;
     DescriptorHeap desc_heap;
+    ShaderCache shader_cache;
     vk::UniquePipelineCache pipeline_cache;
     vk::UniquePipelineLayout pipeline_layout;
     Shader::Profile profile{};
@@ -81,7 +117,15 @@ private:
     std::array<const Shader::Info*, MaxShaderStages> infos{};
     std::array<vk::ShaderModule, MaxShaderStages> modules{};
     GraphicsPipelineKey graphics_key{};
+    GraphicsPipeline* current_graphics_pipeline{};
+    decltype(GraphicsPipelineKey::mrt_swizzles) fs_mrt_swizzles{};
     u64 compute_key{};
+    std::mutex completion_mutex;
+    std::vector<Common::UniqueFunction<void>> completed_work;
+    // Declared last so that the workers are joined before anything they reference is destroyed.
+    using ShaderWorker = Common::StatefulThreadWorker<Shader::Pools>;
+    std::unique_ptr<ShaderWorker> shader_workers;
+    std::unique_ptr<Common::ThreadWorker> pipeline_workers;
 };
 
 } // namespace Vulkan
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "shader_recompiler/backend/bindings.h"
 #include "shader_recompiler/info.h"
 #include "video_core/renderer_vulkan/vk_common.h"
@@ -32,6 +34,11 @@ public:
         return *pipeline_layout;
     }
 
+    /// Returns true when the pipeline object has been created and can be bound.
+    bool IsBuilt() const noexcept {
+        return is_built.load(std::memory_order_acquire);
+    }
+
     using DescriptorWrites = boost::container::small_vector<vk::WriteDescriptorSet, 16>;
     void BindTextures(VideoCore::TextureCache& texture_cache, const Shader::Info& stage,
                       Shader::Backend::Bindings& binding, DescriptorWrites& set_writes) const;
@@ -43,6 +50,7 @@ protected:
     vk::UniquePipeline pipeline;
     vk::UniquePipelineLayout pipeline_layout;
     vk::UniqueDescriptorSetLayout desc_layout;
+    std::atomic_bool is_built{};
     static boost::container::static_vector<vk::DescriptorImageInfo, 32> image_infos;
 };
 
@@ -3,6 +3,7 @@
 
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/metrics.h"
 #include "core/memory.h"
 #include "video_core/amdgpu/liverpool.h"
 #include "video_core/renderer_vulkan/vk_instance.h"
@@ -25,6 +26,8 @@ Rasterizer::Rasterizer(const Instance& instance_, Scheduler& scheduler_,
     }
     memory->SetRasterizer(this);
     wfi_event = instance.GetDevice().createEventUnique({});
+    markers_enabled = !Config::nullGpu() &&
+                      (Config::vkMarkersEnabled() || instance.HasDebuggingToolAttached());
 }
 
 Rasterizer::~Rasterizer() = default;
@@ -44,6 +47,8 @@ void Rasterizer::CpSync() {
 
 void Rasterizer::Draw(bool is_indexed, u32 index_offset) {
     RENDERER_TRACE;
+    static auto& num_draws = Common::Metrics::GetCounter("gpu.draws");
+    num_draws.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     const auto& regs = liverpool->regs;
@@ -81,6 +86,8 @@ void Rasterizer::Draw(bool is_indexed, u32 index_offset) {
 
 void Rasterizer::DrawIndirect(bool is_indexed, VAddr address, u32 offset, u32 size) {
     RENDERER_TRACE;
+    static auto& num_draws = Common::Metrics::GetCounter("gpu.draws");
+    num_draws.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     const auto& regs = liverpool->regs;
@@ -120,6 +127,8 @@ void Rasterizer::DrawIndirect(bool is_indexed, VAddr address, u32 offset, u32 si
 
 void Rasterizer::DispatchDirect() {
     RENDERER_TRACE;
+    static auto& num_dispatches = Common::Metrics::GetCounter("gpu.dispatches");
+    num_dispatches.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     const auto& cs_program = liverpool->regs.cs_program;
@@ -144,6 +153,8 @@ void Rasterizer::DispatchDirect() {
 
 void Rasterizer::DispatchIndirect(VAddr address, u32 offset, u32 size) {
     RENDERER_TRACE;
+    static auto& num_dispatches = Common::Metrics::GetCounter("gpu.dispatches");
+    num_dispatches.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     const auto& cs_program = liverpool->regs.cs_program;
@@ -289,6 +300,18 @@ void Rasterizer::UnmapMemory(VAddr addr, u64 size) {
 }
 
 void Rasterizer::UpdateDynamicState(const GraphicsPipeline& pipeline) {
+    // Dynamic state persists within a command buffer, so it only has to be recorded again when
+    // context registers were written, the pipeline changed or a new command buffer was started.
+    auto& dirty_state = liverpool->dirty_state;
+    const u64 tick = scheduler.CurrentTick();
+    if (False(dirty_state & AmdGpu::DirtyState::DynamicState) &&
+        &pipeline == dynamic_state_pipeline && tick == dynamic_state_tick) {
+        return;
+    }
+    dirty_state &= ~AmdGpu::DirtyState::DynamicState;
+    dynamic_state_pipeline = &pipeline;
+    dynamic_state_tick = tick;
+
     UpdateViewportScissorState();
 
     auto& regs = liverpool->regs;
@@ -384,9 +407,11 @@ void Rasterizer::UpdateDepthStencilState() {
 }
 
 void Rasterizer::ScopeMarkerBegin(const std::string_view& str) {
-    if (Config::nullGpu() || !Config::vkMarkersEnabled()) {
+    if (!markers_enabled) {
         return;
     }
+    static auto& num_markers = Common::Metrics::GetCounter("gpu.debug_markers");
+    num_markers.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     cmdbuf.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT{
@@ -395,7 +420,7 @@ void Rasterizer::ScopeMarkerBegin(const std::string_view& str) {
 }
 
 void Rasterizer::ScopeMarkerEnd() {
-    if (Config::nullGpu() || !Config::vkMarkersEnabled()) {
+    if (!markers_enabled) {
         return;
     }
 
@@ -404,9 +429,11 @@ void Rasterizer::ScopeMarkerEnd() {
 }
 
 void Rasterizer::ScopedMarkerInsert(const std::string_view& str) {
-    if (Config::nullGpu() || !Config::vkMarkersEnabled()) {
+    if (!markers_enabled) {
         return;
     }
+    static auto& num_markers = Common::Metrics::GetCounter("gpu.debug_markers");
+    num_markers.Add();
 
     const auto cmdbuf = scheduler.CommandBuffer();
     cmdbuf.insertDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT{
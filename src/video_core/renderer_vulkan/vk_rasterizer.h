@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include <array>
+#include <fmt/format.h>
+
 #include "video_core/buffer_cache/buffer_cache.h"
 #include "video_core/page_manager.h"
 #include "video_core/renderer_vulkan/vk_pipeline_cache.h"
@@ -41,6 +44,24 @@ public:
     void ScopeMarkerEnd();
     void ScopedMarkerInsert(const std::string_view& str);
 
+    /// Formats a marker label on the stack. Does nothing unless markers are consumed.
+    template <typename... Args>
+    void ScopeMarkerBegin(fmt::format_string<Args...> format, Args&&... args) {
+        if (!markers_enabled) {
+            return;
+        }
+        std::array<char, 128> label;
+        const auto result =
+            fmt::format_to_n(label.data(), label.size() - 1, format, std::forward<Args>(args)...);
+        *result.out = '\0';
+        ScopeMarkerBegin(std::string_view{label.data(), result.out});
+    }
+
+    /// Returns true when debug markers are recorded into command buffers.
+    [[nodiscard]] bool IsMarkersEnabled() const noexcept {
+        return markers_enabled;
+    }
+
     void InlineDataToGds(u32 gds_offset, u32 value);
     u32 ReadDataFromGds(u32 gsd_offset);
     void InvalidateMemory(VAddr addr, u64 size);
@@ -68,6 +89,9 @@ private:
     Core::MemoryManager* memory;
     PipelineCache pipeline_cache;
     vk::UniqueEvent wfi_event;
+    const GraphicsPipeline* dynamic_state_pipeline{};
+    u64 dynamic_state_tick{};
+    bool markers_enabled{};
 };
 
 } // namespace Vulkan
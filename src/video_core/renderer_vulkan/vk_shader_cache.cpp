@@ -0,0 +1,443 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <cstring>
+#include <tuple>
+#include <xxhash.h>
+
+#include "common/config.h"
+#include "common/elf_info.h"
+#include "common/logging/log.h"
+#include "common/path_util.h"
+#include "common/scm_rev.h"
+#include "shader_recompiler/info.h"
+#include "shader_recompiler/profile.h"
+#include "shader_recompiler/specialization.h"
+#include "video_core/renderer_vulkan/vk_instance.h"
+#include "video_core/renderer_vulkan/vk_shader_cache.h"
+
+namespace Vulkan {
+
+namespace {
+
+// Bump when the layout of the serialized data changes.
+constexpr u32 CacheVersion = 1;
+constexpr u32 CacheMagic = 0x48535053; // "SPSH"
+
+struct CacheHeader {
+    u32 magic;
+    u32 version;
+    u64 build_hash;
+    u64 profile_hash;
+};
+
+struct EntryHeader {
+    u64 pgm_hash;
+    u32 info_size;
+    u32 spec_size;
+    u32 spv_size;
+    u32 checksum;
+};
+
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::vector<u8>& data_) : data{data_} {}
+
+    template <typename T>
+    void Write(const T& value) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            const auto* bytes = reinterpret_cast<const u8*>(&value);
+            data.insert(data.end(), bytes, bytes + sizeof(T));
+        } else {
+            Write(static_cast<u32>(value.size()));
+            for (const auto& element : value) {
+                Write(element);
+            }
+        }
+    }
+
+private:
+    std::vector<u8>& data;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::span<const u8> data_) : data{data_} {}
+
+    template <typename T>
+    bool Read(T& value) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (offset + sizeof(T) > data.size()) {
+                return false;
+            }
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        } else {
+            u32 size{};
+            if (!Read(size) || size > value.max_size()) {
+                return false;
+            }
+            value.clear();
+            value.resize(size);
+            for (auto& element : value) {
+                if (!Read(element)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+private:
+    std::span<const u8> data;
+    size_t offset{};
+};
+
+/// Fields of Shader::Info that are produced by translation. The rest is derived from the
+/// shader parameters of the running program.
+auto TranslatedFields(auto& info) {
+    return std::tie(info.vs_inputs, info.loads, info.stores, info.ud_mask, info.vertex_offset_sgpr,
+                    info.instance_offset_sgpr, info.buffers, info.texture_buffers, info.images,
+                    info.samplers, info.has_storage_images, info.has_image_buffers,
+                    info.has_texel_buffers, info.has_discard, info.has_image_gather,
+                    info.has_image_query, info.uses_lane_id, info.uses_group_quad,
+                    info.uses_group_ballot, info.uses_shared, info.uses_fp16, info.uses_fp64,
+                    info.uses_step_rates, info.translation_failed, info.mrt_mask);
+}
+
+std::vector<u8> SerializeInfo(const Shader::Info& info) {
+    std::vector<u8> data;
+    BinaryWriter writer{data};
+    std::apply([&](const auto&... fields) { (writer.Write(fields), ...); },
+               TranslatedFields(info));
+    return data;
+}
+
+bool DeserializeInfo(std::span<const u8> data, Shader::Info& info) {
+    BinaryReader reader{data};
+    return std::apply([&](auto&... fields) { return (reader.Read(fields) && ...); },
+                      TranslatedFields(info));
+}
+
+/// Serializes the specialization field by field, so that the result can be compared bytewise.
+std::vector<u8> SerializeSpec(const Shader::StageSpecialization& spec) {
+    std::vector<u8> data;
+    BinaryWriter writer{data};
+    writer.Write(spec.start.unified);
+    writer.Write(spec.start.buffer);
+    writer.Write(spec.start.user_data);
+
+    const auto& runtime_info = spec.runtime_info;
+    writer.Write(runtime_info.stage);
+    writer.Write(runtime_info.num_user_data);
+    writer.Write(runtime_info.num_allocated_vgprs);
+    switch (runtime_info.stage) {
+    case Shader::Stage::Vertex: {
+        const auto& vs_info = runtime_info.vs_info;
+        writer.Write(runtime_info.num_input_vgprs);
+        writer.Write(vs_info.emulate_depth_negative_one_to_one);
+        writer.Write(vs_info.outputs);
+        break;
+    }
+    case Shader::Stage::Fragment: {
+        const auto& fs_info = runtime_info.fs_info;
+        writer.Write(fs_info.mrt_swizzles);
+        writer.Write(static_cast<u32>(fs_info.inputs.size()));
+        for (const auto& input : fs_info.inputs) {
+            writer.Write(input.param_index);
+            writer.Write(input.is_default);
+            writer.Write(input.is_flat);
+            writer.Write(input.default_value);
+        }
+        break;
+    }
+    case Shader::Stage::Compute: {
+        const auto& cs_info = runtime_info.cs_info;
+        writer.Write(cs_info.shared_memory_size);
+        writer.Write(cs_info.workgroup_size);
+        writer.Write(cs_info.tgid_enable);
+        break;
+    }
+    default:
+        break;
+    }
+
+    u32 binding{};
+    for (const auto& buffer : spec.buffers) {
+        const bool is_bound = spec.bitset[binding++];
+        writer.Write(is_bound);
+        if (is_bound) {
+            writer.Write(static_cast<u16>(buffer.stride));
+            writer.Write(static_cast<bool>(buffer.is_storage));
+        }
+    }
+    for (const auto& tex_buffer : spec.tex_buffers) {
+        const bool is_bound = spec.bitset[binding++];
+        writer.Write(is_bound);
+        if (is_bound) {
+            writer.Write(tex_buffer.is_integer);
+        }
+    }
+    for (const auto& image : spec.images) {
+        const bool is_bound = spec.bitset[binding++];
+        writer.Write(is_bound);
+        if (is_bound) {
+            writer.Write(image.type);
+            writer.Write(image.is_integer);
+        }
+    }
+    return data;
+}
+
+u64 HashProfile(const Shader::Profile& profile) {
+    const std::array fields = {
+        u64(profile.supported_spirv),
+        u64(profile.subgroup_size),
+        u64(profile.unified_descriptor_binding),
+        u64(profile.support_descriptor_aliasing),
+        u64(profile.support_int8),
+        u64(profile.support_int16),
+        u64(profile.support_int64),
+        u64(profile.support_vertex_instance_id),
+        u64(profile.support_float_controls),
+        u64(profile.support_separate_denorm_behavior),
+        u64(profile.support_separate_rounding_mode),
+        u64(profile.support_fp16_denorm_preserve),
+        u64(profile.support_fp32_denorm_preserve),
+        u64(profile.support_fp16_denorm_flush),
+        u64(profile.support_fp32_denorm_flush),
+        u64(profile.support_fp16_signed_zero_nan_preserve),
+        u64(profile.support_fp32_signed_zero_nan_preserve),
+        u64(profile.support_fp64_signed_zero_nan_preserve),
+        u64(profile.support_explicit_workgroup_layout),
+        u64(profile.has_broken_spirv_clamp),
+        u64(profile.lower_left_origin_mode),
+        u64(profile.min_ssbo_alignment),
+    };
+    return XXH3_64bits(fields.data(), sizeof(fields));
+}
+
+CacheHeader MakeHeader(const Shader::Profile& profile) {
+    return CacheHeader{
+        .magic = CacheMagic,
+        .version = CacheVersion,
+        .build_hash = XXH3_64bits(Common::g_scm_rev, std::strlen(Common::g_scm_rev)),
+        .profile_hash = HashProfile(profile),
+    };
+}
+
+} // Anonymous namespace
+
+ShaderCache::ShaderCache(const Instance& instance_) : instance{instance_} {}
+
+ShaderCache::~ShaderCache() = default;
+
+void ShaderCache::Load(const Shader::Profile& profile) {
+    const auto serial = Common::ElfInfo::Instance().GameSerial();
+    enabled = Config::shaderCacheEnabled() && !serial.empty();
+    if (!enabled) {
+        return;
+    }
+
+    const auto cache_dir = Common::FS::GetUserPath(Common::FS::PathType::ShaderDir) / "cache";
+    if (!std::filesystem::exists(cache_dir)) {
+        std::filesystem::create_directories(cache_dir);
+    }
+    cache_path = cache_dir / fmt::format("{}.bin", serial);
+    pipeline_path = cache_dir / fmt::format("{}_pipelines.bin", serial);
+
+    ReadEntries(profile);
+
+    using namespace Common::FS;
+    if (entries.empty()) {
+        cache_file.Open(cache_path, FileAccessMode::Write);
+        cache_file.WriteObject(MakeHeader(profile));
+    } else {
+        cache_file.Open(cache_path, FileAccessMode::Append);
+    }
+    if (!cache_file.IsOpen()) {
+        LOG_ERROR(Render_Vulkan, "Unable to open shader cache file {}", cache_path.string());
+        enabled = false;
+    }
+}
+
+void ShaderCache::ReadEntries(const Shader::Profile& profile) {
+    using namespace Common::FS;
+    std::vector<u8> data;
+    {
+        const IOFile file{cache_path, FileAccessMode::Read};
+        if (!file.IsOpen()) {
+            return;
+        }
+        data.resize(file.GetSize());
+        file.ReadSpan<u8>(data);
+    }
+
+    const auto expected = MakeHeader(profile);
+    CacheHeader header{};
+    if (data.size() < sizeof(header)) {
+        return;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != expected.magic || header.version != expected.version ||
+        header.build_hash != expected.build_hash || header.profile_hash != expected.profile_hash) {
+        LOG_INFO(Render_Vulkan, "Shader cache is outdated, discarding it");
+        return;
+    }
+
+    size_t offset = sizeof(header);
+    size_t num_entries{};
+    while (offset + sizeof(EntryHeader) <= data.size()) {
+        EntryHeader entry_header;
+        std::memcpy(&entry_header, data.data() + offset, sizeof(entry_header));
+        const size_t spv_bytes = size_t(entry_header.spv_size) * sizeof(u32);
+        const size_t payload_size = entry_header.info_size + entry_header.spec_size + spv_bytes;
+        const u8* payload = data.data() + offset + sizeof(entry_header);
+        if (offset + sizeof(entry_header) + payload_size > data.size() ||
+            u32(XXH3_64bits(payload, payload_size)) != entry_header.checksum) {
+            break;
+        }
+
+        auto& entry = entries[entry_header.pgm_hash].emplace_back();
+        entry.info.assign(payload, payload + entry_header.info_size);
+        payload += entry_header.info_size;
+        entry.spec.assign(payload, payload + entry_header.spec_size);
+        payload += entry_header.spec_size;
+        entry.spv.resize(entry_header.spv_size);
+        std::memcpy(entry.spv.data(), payload, spv_bytes);
+
+        offset += sizeof(entry_header) + payload_size;
+        ++num_entries;
+    }
+
+    // Drop a partially written tail, e.g. when the previous session was terminated mid-write.
+    if (offset != data.size()) {
+        LOG_WARNING(Render_Vulkan, "Shader cache has {} bytes of trailing garbage, truncating",
+                    data.size() - offset);
+        const IOFile file{cache_path, FileAccessMode::ReadWrite};
+        file.SetSize(offset);
+    }
+    LOG_INFO(Render_Vulkan, "Loaded {} cached shader modules for {} programs", num_entries,
+             entries.size());
+}
+
+std::vector<u8> ShaderCache::LoadPipelineData() const {
+    using namespace Common::FS;
+    if (!enabled) {
+        return {};
+    }
+    const IOFile file{pipeline_path, FileAccessMode::Read};
+    if (!file.IsOpen()) {
+        return {};
+    }
+    std::vector<u8> data(file.GetSize());
+    file.ReadSpan<u8>(data);
+
+    // Validate the header ourselves instead of relying on the driver to reject foreign data.
+    struct {
+        u32 header_size;
+        vk::PipelineCacheHeaderVersion header_version;
+        u32 vendor_id;
+        u32 device_id;
+        std::array<u8, VK_UUID_SIZE> uuid;
+    } header{};
+    if (data.size() < sizeof(header)) {
+        return {};
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    const auto uuid = instance.GetPipelineCacheUUID();
+    if (header.header_version != vk::PipelineCacheHeaderVersion::eOne ||
+        header.vendor_id != instance.GetVendorID() || header.device_id != instance.GetDeviceID() ||
+        !std::equal(header.uuid.begin(), header.uuid.end(), uuid.begin())) {
+        LOG_INFO(Render_Vulkan, "Pipeline cache was created by a different driver, discarding it");
+        return {};
+    }
+    LOG_INFO(Render_Vulkan, "Loaded pipeline cache of {} KiB", data.size() / 1024);
+    return data;
+}
+
+void ShaderCache::SavePipelineData(vk::PipelineCache pipeline_cache) const {
+    if (!enabled) {
+        return;
+    }
+    try {
+        const auto data = instance.GetDevice().getPipelineCacheData(pipeline_cache);
+        Common::FS::IOFile::WriteBytes(pipeline_path, data);
+    } catch (vk::SystemError& err) {
+        LOG_ERROR(Render_Vulkan, "Failed to retrieve pipeline cache data: {}", err.what());
+    }
+}
+
+std::span<const u32> ShaderCache::FindProgram(Shader::Info& info,
+                                              const Shader::RuntimeInfo& runtime_info,
+                                              Shader::Backend::Bindings start) const {
+    const auto it = entries.find(info.pgm_hash);
+    if (it == entries.end()) {
+        return {};
+    }
+    for (const auto& entry : it->second) {
+        // The resource layout is needed to read the bound sharps, so restore the translated
+        // information of each candidate before checking if the specialization matches.
+        auto candidate = info;
+        if (!DeserializeInfo(entry.info, candidate)) {
+            continue;
+        }
+        const auto spec = Shader::StageSpecialization(candidate, runtime_info, start);
+        if (SerializeSpec(spec) == entry.spec) {
+            info = std::move(candidate);
+            return entry.spv;
+        }
+    }
+    return {};
+}
+
+std::span<const u32> ShaderCache::FindPermutation(const Shader::StageSpecialization& spec,
+                                                  Shader::Backend::Bindings& binding) const {
+    const auto it = entries.find(spec.info->pgm_hash);
+    if (it == entries.end()) {
+        return {};
+    }
+    const auto key = SerializeSpec(spec);
+    for (const auto& entry : it->second) {
+        if (entry.spec == key) {
+            spec.info->AddBindings(binding);
+            return entry.spv;
+        }
+    }
+    return {};
+}
+
+void ShaderCache::Store(const Shader::Info& info, const Shader::StageSpecialization& spec,
+                        std::span<const u32> spv) {
+    if (!enabled) {
+        return;
+    }
+    Entry entry{
+        .info = SerializeInfo(info),
+        .spec = SerializeSpec(spec),
+        .spv{spv.begin(), spv.end()},
+    };
+
+    std::vector<u8> payload;
+    payload.reserve(entry.info.size() + entry.spec.size() + spv.size_bytes());
+    payload.insert(payload.end(), entry.info.begin(), entry.info.end());
+    payload.insert(payload.end(), entry.spec.begin(), entry.spec.end());
+    const auto* spv_bytes = reinterpret_cast<const u8*>(spv.data());
+    payload.insert(payload.end(), spv_bytes, spv_bytes + spv.size_bytes());
+
+    const EntryHeader header{
+        .pgm_hash = info.pgm_hash,
+        .info_size = static_cast<u32>(entry.info.size()),
+        .spec_size = static_cast<u32>(entry.spec.size()),
+        .spv_size = static_cast<u32>(spv.size()),
+        .checksum = static_cast<u32>(XXH3_64bits(payload.data(), payload.size())),
+    };
+    cache_file.WriteObject(header);
+    cache_file.WriteSpan<u8>(payload);
+    cache_file.Flush();
+
+    entries[info.pgm_hash].emplace_back(std::move(entry));
+}
+
+} // namespace Vulkan
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+#include <tsl/robin_map.h>
+
+#include "common/io_file.h"
+#include "common/types.h"
+#include "shader_recompiler/backend/bindings.h"
+#include "video_core/renderer_vulkan/vk_common.h"
+
+namespace Shader {
+struct Info;
+struct Profile;
+struct RuntimeInfo;
+struct StageSpecialization;
+} // namespace Shader
+
+namespace Vulkan {
+
+class Instance;
+
+/**
+ * Persistent storage of translated shader modules and of the Vulkan pipeline cache.
+ * Every translated permutation is appended to a per-title file as soon as it is compiled,
+ * keyed on the guest shader hash and the serialized stage specialization. The whole file is
+ * read back on boot so that known permutations skip recompilation.
+ */
+class ShaderCache {
+public:
+    explicit ShaderCache(const Instance& instance);
+    ~ShaderCache();
+
+    /// Opens the cache files of the running title, discarding them if they were produced by a
+    /// different build of the recompiler or with a different profile.
+    void Load(const Shader::Profile& profile);
+
+    /// Returns the serialized Vulkan pipeline cache of the previous session, if compatible.
+    [[nodiscard]] std::vector<u8> LoadPipelineData() const;
+
+    /// Writes the contents of the Vulkan pipeline cache to disk.
+    void SavePipelineData(vk::PipelineCache pipeline_cache) const;
+
+    /// Looks up the first permutation of a program. On a hit the resource information of the
+    /// cached translation is written to info and its SPIR-V is returned.
+    [[nodiscard]] std::span<const u32> FindProgram(Shader::Info& info,
+                                                   const Shader::RuntimeInfo& runtime_info,
+                                                   Shader::Backend::Bindings start) const;
+
+    /// Looks up an additional permutation of an already known program. On a hit the binding
+    /// counters are advanced as if the module was compiled.
+    [[nodiscard]] std::span<const u32> FindPermutation(const Shader::StageSpecialization& spec,
+                                                       Shader::Backend::Bindings& binding) const;
+
+    /// Persists a freshly translated module.
+    void Store(const Shader::Info& info, const Shader::StageSpecialization& spec,
+               std::span<const u32> spv);
+
+private:
+    struct Entry {
+        std::vector<u8> info;
+        std::vector<u8> spec;
+        std::vector<u32> spv;
+    };
+
+    void ReadEntries(const Shader::Profile& profile);
+
+private:
+    const Instance& instance;
+    bool enabled{};
+    std::filesystem::path cache_path;
+    std::filesystem::path pipeline_path;
+    Common::FS::IOFile cache_file;
+    tsl::robin_map<u64, std::vector<Entry>> entries;
+};
+
+} // namespace Vulkan
@@ -4,6 +4,7 @@
 #include <optional>
 #include <xxhash.h>
 #include "common/assert.h"
+#include "common/metrics.h"
 #include "video_core/buffer_cache/buffer_cache.h"
 #include "video_core/page_manager.h"
 #include "video_core/renderer_vulkan/vk_instance.h"
@@ -225,6 +226,10 @@ ImageId TextureCache::FindImage(const ImageInfo& info, FindFlags flags) {
         image_id = cache_id;
     }
 
+    static auto& num_hits = Common::Metrics::GetCounter("texture_cache.hits");
+    static auto& num_misses = Common::Metrics::GetCounter("texture_cache.misses");
+    (image_id ? num_hits : num_misses).Add();
+
     if (True(flags & FindFlags::NoCreate) && !image_id) {
         return {};
     }
@@ -1,6 +1,10 @@
 // SPDX-FileCopyrightText: Copyright 2024 shadPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <latch>
+#include <thread>
+
+#include "common/thread_worker.h"
 #include "video_core/renderer_vulkan/vk_instance.h"
 #include "video_core/renderer_vulkan/vk_scheduler.h"
 #include "video_core/renderer_vulkan/vk_shader_util.h"
@@ -22,154 +26,122 @@
 
 namespace VideoCore {
 
-class TileManager32 {
-public:
-    u32 m_macro_tile_height = 0;
-    u32 m_bank_height = 0;
-    u32 m_num_banks = 0;
-    u32 m_num_pipes = 0;
-    u32 m_padded_width = 0;
-    u32 m_padded_height = 0;
-    u32 m_pipe_bits = 0;
-    u32 m_bank_bits = 0;
-
-    void Init(u32 width, u32 height, bool is_neo) {
-        m_macro_tile_height = (is_neo ? 128 : 64);
-        m_bank_height = is_neo ? 2 : 1;
-        m_num_banks = is_neo ? 8 : 16;
-        m_num_pipes = is_neo ? 16 : 8;
-        m_padded_width = width;
-        if (height == 1080) {
-            m_padded_height = is_neo ? 1152 : 1088;
-        }
-        if (height == 720) {
-            m_padded_height = 768;
-        }
-        m_pipe_bits = is_neo ? 4 : 3;
-        m_bank_bits = is_neo ? 3 : 4;
-    }
+namespace {
 
-    static u32 getElementIdx(u32 x, u32 y) {
-        u32 elem = 0;
-        elem |= ((x >> 0u) & 0x1u) << 0u;
-        elem |= ((x >> 1u) & 0x1u) << 1u;
-        elem |= ((y >> 0u) & 0x1u) << 2u;
-        elem |= ((x >> 2u) & 0x1u) << 3u;
-        elem |= ((y >> 1u) & 0x1u) << 4u;
-        elem |= ((y >> 2u) & 0x1u) << 5u;
+Common::ThreadWorker& DetileWorkers() {
+    static Common::ThreadWorker workers{std::max(std::thread::hardware_concurrency() / 2, 1U),
+                                        "CpuDetiler"};
+    return workers;
+}
 
-        return elem;
+/// Runs func over [0, count) in chunks of at least min_chunk, spread across the detiler workers
+/// and the calling thread. Only waits for its own chunks, the workers may be shared with other
+/// callers.
+template <typename Func>
+void ParallelFor(u32 count, u32 min_chunk, const Func& func) {
+    auto& workers = DetileWorkers();
+    const u32 num_threads = std::thread::hardware_concurrency() / 2 + 1;
+    const u32 chunk = std::max((count + num_threads - 1) / num_threads, min_chunk);
+    if (chunk >= count) {
+        func(0U, count);
+        return;
     }
-
-    static u32 getPipeIdx(u32 x, u32 y, bool is_neo) {
-        u32 pipe = 0;
-
-        if (!is_neo) {
-            pipe |= (((x >> 3u) ^ (y >> 3u) ^ (x >> 4u)) & 0x1u) << 0u;
-            pipe |= (((x >> 4u) ^ (y >> 4u)) & 0x1u) << 1u;
-            pipe |= (((x >> 5u) ^ (y >> 5u)) & 0x1u) << 2u;
-        } else {
-            pipe |= (((x >> 3u) ^ (y >> 3u) ^ (x >> 4u)) & 0x1u) << 0u;
-            pipe |= (((x >> 4u) ^ (y >> 4u)) & 0x1u) << 1u;
-            pipe |= (((x >> 5u) ^ (y >> 5u)) & 0x1u) << 2u;
-            pipe |= (((x >> 6u) ^ (y >> 5u)) & 0x1u) << 3u;
-        }
-
-        return pipe;
+    const u32 num_chunks = (count + chunk - 1) / chunk;
+    std::latch done{num_chunks - 1};
+    for (u32 begin = chunk; begin < count; begin += chunk) {
+        const u32 end = std::min(begin + chunk, count);
+        workers.QueueWork([&func, &done, begin, end] {
+            func(begin, end);
+            done.count_down();
+        });
     }
+    func(0U, chunk);
+    done.wait();
+}
 
-    static u32 getBankIdx(u32 x, u32 y, u32 bank_width, u32 bank_height, u32 num_banks,
-                          u32 num_pipes) {
-        const u32 x_shift_offset = std::bit_width(bank_width * num_pipes) - 1;
-        const u32 y_shift_offset = std::bit_width(bank_height) - 1;
-        const u32 xs = x >> x_shift_offset;
-        const u32 ys = y >> y_shift_offset;
-        u32 bank = 0;
-        switch (num_banks) {
-        case 8:
-            bank |= (((xs >> 3u) ^ (ys >> 5u)) & 0x1u) << 0u;
-            bank |= (((xs >> 4u) ^ (ys >> 4u) ^ (ys >> 5u)) & 0x1u) << 1u;
-            bank |= (((xs >> 5u) ^ (ys >> 3u)) & 0x1u) << 2u;
-            break;
-        case 16:
-            bank |= (((xs >> 3u) ^ (ys >> 6u)) & 0x1u) << 0u;
-            bank |= (((xs >> 4u) ^ (ys >> 5u) ^ (ys >> 6u)) & 0x1u) << 1u;
-            bank |= (((xs >> 5u) ^ (ys >> 4u)) & 0x1u) << 2u;
-            bank |= (((xs >> 6u) ^ (ys >> 3u)) & 0x1u) << 3u;
-            break;
-        default:;
+/// Byte offsets of the first texel of every horizontal texel pair of an 8x8 micro tile, in row
+/// major order. Both texels of a pair are always adjacent in the tiled data.
+template <u32 TexelSize>
+consteval std::array<u32, 32> MakeMicroTilePairOffsets() {
+    std::array<u32, 32> offsets{};
+    for (u32 y = 0; y < 8; y++) {
+        for (u32 x = 0; x < 8; x += 2) {
+            u32 offset{};
+            if constexpr (TexelSize == 1) {
+                // 8bpp tiles are stored as interleaved halves of dwords, see detile_m8x1.comp
+                const u32 dword = (y / 4) * 8 + (x / 4) * 4 + y % 4;
+                const u32 half = (x % 4) / 2;
+                offset = (dword & 1) ? 4 * dword - 2 + 4 * half : 4 * dword + 4 * half;
+            } else {
+                const u32 texel = ((x >> 0) & 1) | ((y & 1) << 1) | (((x >> 1) & 1) << 2) |
+                                  (((y >> 1) & 1) << 3) | (((x >> 2) & 1) << 4) |
+                                  (((y >> 2) & 1) << 5);
+                offset = texel * TexelSize;
+            }
+            offsets[y * 4 + x / 2] = offset;
         }
-
-        return bank;
     }
+    return offsets;
+}
 
-    u64 getTiledOffs(u32 x, u32 y, bool is_neo) const {
-        u64 element_index = getElementIdx(x, y);
-
-        u32 xh = x;
-        u32 yh = y;
-        u64 pipe = getPipeIdx(xh, yh, is_neo);
-        u64 bank = getBankIdx(xh, yh, 1, m_bank_height, m_num_banks, m_num_pipes);
-        u32 tile_bytes = (8 * 8 * 32 + 7) / 8;
-        u64 element_offset = (element_index * 32);
-        u64 tile_split_slice = 0;
-
-        if (tile_bytes > 512) {
-            tile_split_slice = element_offset / (static_cast<u64>(512) * 8);
-            element_offset %= (static_cast<u64>(512) * 8);
-            tile_bytes = 512;
+template <u32 TexelSize>
+void DetileMicroTiles(u8* dst, size_t dst_size, const u8* src, u32 pitch,
+                      std::span<const u32> level_sizes, u32 begin, u32 end) {
+    static constexpr auto PairOffsets = MakeMicroTilePairOffsets<TexelSize>();
+    static constexpr u32 TileSize = 64 * TexelSize;
+    static constexpr u32 RowSize = 8 * TexelSize;
+
+    for (u32 tile = begin; tile < end; tile++) {
+        // Mirror the addressing of the detiler shaders, which derive the pitch from the level of
+        // the first texel and place tiles relative to the start of the image.
+        u32 mip = 0;
+        for (const u32 level_end : level_sizes) {
+            mip += u64(tile) * TileSize >= level_end ? 1 : 0;
+        }
+        const u32 tiles_per_pitch = std::max((pitch >> mip) / 8, 1U);
+        const u64 dst_tile = (u64(tile / tiles_per_pitch) * tiles_per_pitch * 64 +
+                              u64(tile % tiles_per_pitch) * 8) *
+                             TexelSize;
+        const u64 dst_pitch = u64(tiles_per_pitch) * RowSize;
+        const u8* src_tile = src + u64(tile) * TileSize;
+
+        for (u32 y = 0; y < 8; y++) {
+            const u64 dst_offset = dst_tile + y * dst_pitch;
+            if (dst_offset + RowSize > dst_size) {
+                break;
+            }
+            u8* dst_row = dst + dst_offset;
+            for (u32 pair = 0; pair < 4; pair++) {
+                std::memcpy(dst_row + pair * 2 * TexelSize, src_tile + PairOffsets[y * 4 + pair],
+                            2 * TexelSize);
+            }
         }
-
-        u64 macro_tile_bytes =
-            (128 / 8) * (m_macro_tile_height / 8) * tile_bytes / (m_num_pipes * m_num_banks);
-        u64 macro_tiles_per_row = m_padded_width / 128;
-        u64 macro_tile_row_index = y / m_macro_tile_height;
-        u64 macro_tile_column_index = x / 128;
-        u64 macro_tile_index =
-            (macro_tile_row_index * macro_tiles_per_row) + macro_tile_column_index;
-        u64 macro_tile_offset = macro_tile_index * macro_tile_bytes;
-        u64 macro_tiles_per_slice = macro_tiles_per_row * (m_padded_height / m_macro_tile_height);
-        u64 slice_bytes = macro_tiles_per_slice * macro_tile_bytes;
-        u64 slice_offset = tile_split_slice * slice_bytes;
-        u64 tile_row_index = (y / 8) % m_bank_height;
-        u64 tile_index = tile_row_index;
-        u64 tile_offset = tile_index * tile_bytes;
-
-        u64 tile_split_slice_rotation = ((m_num_banks / 2) + 1) * tile_split_slice;
-        bank ^= tile_split_slice_rotation;
-        bank &= (m_num_banks - 1);
-
-        u64 total_offset = (slice_offset + macro_tile_offset + tile_offset) * 8 + element_offset;
-        u64 bit_offset = total_offset & 0x7u;
-        total_offset /= 8;
-
-        u64 pipe_interleave_offset = total_offset & 0xffu;
-        u64 offset = total_offset >> 8u;
-        u64 byte_offset = pipe_interleave_offset | (pipe << (8u)) | (bank << (8u + m_pipe_bits)) |
-                          (offset << (8u + m_pipe_bits + m_bank_bits));
-
-        return ((byte_offset << 3u) | bit_offset) / 8;
     }
-};
-
-void ConvertTileToLinear(u8* dst, const u8* src, u32 width, u32 height, bool is_neo) {
-    TileManager32 t;
-    t.Init(width, height, is_neo);
-
-    for (u32 y = 0; y < height; y++) {
-        u32 x = 0;
-        u64 linear_offset = y * width * 4;
+}
 
-        for (; x + 1 < width; x += 2) {
-            auto tiled_offset = t.getTiledOffs(x, y, is_neo);
+} // Anonymous namespace
 
-            std::memcpy(dst + linear_offset, src + tiled_offset, sizeof(u64));
-            linear_offset += 8;
-        }
-        if (x < width) {
-            auto tiled_offset = t.getTiledOffs(x, y, is_neo);
-            std::memcpy(dst + linear_offset, src + tiled_offset, sizeof(u32));
-        }
+void ConvertMicroTileToLinear(u8* dst, const u8* src, u32 size, u32 texel_size, u32 pitch,
+                              std::span<const u32> level_sizes) {
+    const u32 num_tiles = size / (64 * texel_size);
+    const auto detile = [&]<u32 TexelSize>() {
+        ParallelFor(num_tiles, 256, [&](u32 begin, u32 end) {
+            DetileMicroTiles<TexelSize>(dst, size, src, pitch, level_sizes, begin, end);
+        });
+    };
+    switch (texel_size) {
+    case 1:
+        return detile.template operator()<1>();
+    case 2:
+        return detile.template operator()<2>();
+    case 4:
+        return detile.template operator()<4>();
+    case 8:
+        return detile.template operator()<8>();
+    case 16:
+        return detile.template operator()<16>();
+    default:
+        UNREACHABLE_MSG("Unsupported texel size {}", texel_size);
     }
 }
 
@@ -254,6 +226,20 @@ struct DetilerParams {
     u32 sizes[14];
 };
 
+static DetilerParams MakeDetilerParams(const ImageInfo& info) {
+    DetilerParams params;
+    params.pitch0 = info.pitch >> (info.props.is_block ? 2u : 0u);
+    params.num_levels = info.resources.levels;
+
+    ASSERT(info.resources.levels <= 14);
+    std::memset(&params.sizes, 0, sizeof(params.sizes));
+    for (int m = 0; m < info.resources.levels; ++m) {
+        params.sizes[m] =
+            info.mips_layout[m].size * info.resources.layers + (m > 0 ? params.sizes[m - 1] : 0);
+    }
+    return params;
+}
+
 TileManager::TileManager(const Vulkan::Instance& instance, Vulkan::Scheduler& scheduler)
     : instance{instance}, scheduler{scheduler} {
     static const std::array detiler_shaders{
@@ -267,6 +253,11 @@ TileManager::TileManager(const Vulkan::Instance& instance, Vulkan::Scheduler& sc
 
         const auto& module = Vulkan::Compile(
             detiler_shaders[pl_id], vk::ShaderStageFlagBits::eCompute, instance.GetDevice());
+        if (!module) {
+            LOG_ERROR(Render_Vulkan, "Failed to compile detiler {}, detiling on the CPU instead",
+                      magic_enum::enum_name(static_cast<DetilerType>(pl_id)));
+            continue;
+        }
 
         // Set module debug name
         auto module_name = magic_enum::enum_name(static_cast<DetilerType>(pl_id));
@@ -325,7 +316,8 @@ TileManager::TileManager(const Vulkan::Instance& instance, Vulkan::Scheduler& sc
         if (result.result == vk::Result::eSuccess) {
             ctx.pl = std::move(result.value);
         } else {
-            UNREACHABLE_MSG("Detiler pipeline creation failed!");
+            LOG_ERROR(Render_Vulkan, "Detiler pipeline creation failed: {}, detiling on the CPU",
+                      vk::to_string(result.result));
         }
 
         // Once pipeline is compiled, we don't need the shader module anymore
@@ -336,9 +328,11 @@ TileManager::TileManager(const Vulkan::Instance& instance, Vulkan::Scheduler& sc
 TileManager::~TileManager() = default;
 
 TileManager::ScratchBuffer TileManager::AllocBuffer(u32 size, bool is_storage /*= false*/) {
-    const auto usage = vk::BufferUsageFlagBits::eStorageBuffer |
-                       (is_storage ? vk::BufferUsageFlagBits::eTransferSrc
-                                   : vk::BufferUsageFlagBits::eTransferDst);
+    // Host visible buffers may also be copied from, when they hold data detiled on the CPU.
+    auto usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+    if (!is_storage) {
+        usage |= vk::BufferUsageFlagBits::eTransferDst;
+    }
     const vk::BufferCreateInfo buffer_ci{
         .size = size,
         .usage = usage,
@@ -395,6 +389,21 @@ std::pair<vk::Buffer, u32> TileManager::TryDetile(vk::Buffer in_buffer, u32 in_o
 
     const u32 image_size = image.info.guest_size_bytes;
 
+    if (!detiler->pl) [[unlikely]] {
+        // The compute detiler is unavailable, detile the guest copy of the image into a host
+        // visible buffer instead. Data that was only written by the GPU is not visible here.
+        auto out_buffer = AllocBuffer(image_size);
+        scheduler.DeferOperation([=, this]() { FreeBuffer(out_buffer); });
+        void* ptr{};
+        const auto result = vmaMapMemory(instance.GetAllocator(), out_buffer.second, &ptr);
+        ASSERT(result == VK_SUCCESS);
+        const auto* guest_data = reinterpret_cast<const u8*>(image.info.guest_address);
+        DetileOnCpu(image, {guest_data, image_size}, {static_cast<u8*>(ptr), image_size});
+        vmaFlushAllocation(instance.GetAllocator(), out_buffer.second, 0, VK_WHOLE_SIZE);
+        vmaUnmapMemory(instance.GetAllocator(), out_buffer.second);
+        return {out_buffer.first, 0};
+    }
+
     // Prepare output buffer
     auto out_buffer = AllocBuffer(image_size, true);
     scheduler.DeferOperation([=, this]() { FreeBuffer(out_buffer); });
@@ -435,17 +444,7 @@ std::pair<vk::Buffer, u32> TileManager::TryDetile(vk::Buffer in_buffer, u32 in_o
     cmdbuf.pushDescriptorSetKHR(vk::PipelineBindPoint::eCompute, *detiler->pl_layout, 0,
                                 set_writes);
 
-    DetilerParams params;
-    params.pitch0 = image.info.pitch >> (image.info.props.is_block ? 2u : 0u);
-    params.num_levels = image.info.resources.levels;
-
-    ASSERT(image.info.resources.levels <= 14);
-    std::memset(&params.sizes, 0, sizeof(params.sizes));
-    for (int m = 0; m < image.info.resources.levels; ++m) {
-        params.sizes[m] = image.info.mips_layout[m].size * image.info.resources.layers +
-                          (m > 0 ? params.sizes[m - 1] : 0);
-    }
-
+    const DetilerParams params = MakeDetilerParams(image.info);
     cmdbuf.pushConstants(*detiler->pl_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(params),
                          &params);
 
@@ -467,4 +466,22 @@ std::pair<vk::Buffer, u32> TileManager::TryDetile(vk::Buffer in_buffer, u32 in_o
     return {out_buffer.first, 0};
 }
 
+bool TileManager::DetileOnCpu(const Image& image, std::span<const u8> src,
+                              std::span<u8> dst) const {
+    const auto* detiler = GetDetiler(image);
+    if (!detiler) {
+        return false;
+    }
+
+    static constexpr std::array<u32, DetilerType::Max> TexelSizes = {1, 2, 4, 8, 16};
+    const u32 texel_size = TexelSizes[std::distance(detilers.data(), detiler)];
+    const u32 image_size = image.info.guest_size_bytes;
+    ASSERT(src.size() >= image_size && dst.size() >= image_size);
+
+    const DetilerParams params = MakeDetilerParams(image.info);
+    ConvertMicroTileToLinear(dst.data(), src.data(), image_size, texel_size, params.pitch0,
+                             std::span{params.sizes, params.num_levels});
+    return true;
+}
+
 } // namespace VideoCore
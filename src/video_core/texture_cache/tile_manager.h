@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <span>
+
 #include "common/types.h"
 #include "video_core/buffer_cache/buffer.h"
 #include "video_core/texture_cache/image.h"
@@ -11,8 +13,10 @@ namespace VideoCore {
 
 class TextureCache;
 
-/// Converts tiled texture data to linear format.
-void ConvertTileToLinear(u8* dst, const u8* src, u32 width, u32 height, bool neo);
+/// Converts micro tiled data to linear format on the CPU. The output matches the one of the
+/// detiler compute shaders. level_sizes holds the end offset of every mip level.
+void ConvertMicroTileToLinear(u8* dst, const u8* src, u32 size, u32 texel_size, u32 pitch,
+                              std::span<const u32> level_sizes);
 
 /// Converts image format to the one used internally by detiler.
 vk::Format DemoteImageFormatForDetiling(vk::Format format);
@@ -41,6 +45,10 @@ public:
 
     std::pair<vk::Buffer, u32> TryDetile(vk::Buffer in_buffer, u32 in_offset, Image& image);
 
+    /// Detiles guest image data on the host, for when the data is consumed by the CPU or the
+    /// compute detiler can't be used. Returns false if the tiling of the image is unsupported.
+    bool DetileOnCpu(const Image& image, std::span<const u8> src, std::span<u8> dst) const;
+
     ScratchBuffer AllocBuffer(u32 size, bool is_storage = false);
     void Upload(ScratchBuffer buffer, const void* data, size_t size);
     void FreeBuffer(ScratchBuffer buffer);